@@ -0,0 +1,76 @@
+#ifndef ATOMIC_TRANSFORMATION_H
+#define ATOMIC_TRANSFORMATION_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <array>
+#include <atomic>
+#include <mutex>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Transformation shared through a sequence lock: readers never block and retry only when they overlap a write
+class AtomicTransformation
+{
+private:
+	static const int MAX_HOMOGENEOUS_DIM = 4;
+	
+	std::atomic_uint sequence;
+	std::atomic_int homogeneousDim;
+	std::array<std::atomic<T>, MAX_HOMOGENEOUS_DIM * MAX_HOMOGENEOUS_DIM> coefficients;
+	std::mutex writeLock;
+	
+public:
+	AtomicTransformation():
+			sequence(0),
+			homogeneousDim(0)
+	{
+		for(std::atomic<T>& coefficient: coefficients)
+		{
+			coefficient.store(0, std::memory_order_relaxed);
+		}
+	}
+	
+	void store(const PM::TransformationParameters& transformation)
+	{
+		std::lock_guard<std::mutex> lock(writeLock);
+		
+		sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		homogeneousDim.store(transformation.rows(), std::memory_order_relaxed);
+		for(int i = 0; i < transformation.rows(); i++)
+		{
+			for(int j = 0; j < transformation.cols(); j++)
+			{
+				coefficients[i * MAX_HOMOGENEOUS_DIM + j].store(transformation(i, j), std::memory_order_relaxed);
+			}
+		}
+		sequence.fetch_add(1, std::memory_order_release);
+	}
+	
+	PM::TransformationParameters load() const
+	{
+		PM::TransformationParameters transformation;
+		unsigned sequenceBefore;
+		unsigned sequenceAfter;
+		do
+		{
+			sequenceBefore = sequence.load(std::memory_order_acquire);
+			const int dim = homogeneousDim.load(std::memory_order_relaxed);
+			transformation.resize(dim, dim);
+			for(int i = 0; i < dim; i++)
+			{
+				for(int j = 0; j < dim; j++)
+				{
+					transformation(i, j) = coefficients[i * MAX_HOMOGENEOUS_DIM + j].load(std::memory_order_relaxed);
+				}
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			sequenceAfter = sequence.load(std::memory_order_relaxed);
+		}
+		while(sequenceBefore != sequenceAfter || sequenceBefore % 2 == 1);
+		return transformation;
+	}
+};
+
+#endif
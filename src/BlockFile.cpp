@@ -0,0 +1,78 @@
+#include "BlockFile.h"
+#include <fstream>
+#include <stdexcept>
+
+void BlockFile::append(const std::string& fileName, const PM::DataPoints& points, const std::vector<int>& pointIndexes, std::uint32_t tag)
+{
+	PM::DataPoints block = points.createSimilarEmpty(pointIndexes.size());
+	for(size_t i = 0; i < pointIndexes.size(); i++)
+	{
+		block.setColFrom(i, points, pointIndexes[i]);
+	}
+	
+	// a block is its header followed by its features, descriptors and times, which are contiguous in column-major matrices
+	std::ofstream stream(fileName.c_str(), std::ios::binary | std::ios::app);
+	const std::uint32_t pointCount = pointIndexes.size();
+	stream.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+	stream.write(reinterpret_cast<const char*>(&pointCount), sizeof(pointCount));
+	stream.write(reinterpret_cast<const char*>(block.features.data()), block.features.size() * sizeof(T));
+	stream.write(reinterpret_cast<const char*>(block.descriptors.data()), block.descriptors.size() * sizeof(T));
+	stream.write(reinterpret_cast<const char*>(block.times.data()), block.times.size() * sizeof(std::int64_t));
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to write " + fileName + ".");
+	}
+}
+
+PM::DataPoints BlockFile::read(const std::string& fileName, const PM::DataPoints::Labels& featureLabels, const PM::DataPoints::Labels& descriptorLabels,
+							   const PM::DataPoints::Labels& timeLabels, std::vector<std::uint32_t>& pointTags)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open " + fileName + ".");
+	}
+	
+	PM::DataPoints points;
+	std::uint32_t tag;
+	while(stream.read(reinterpret_cast<char*>(&tag), sizeof(tag)))
+	{
+		std::uint32_t pointCount;
+		stream.read(reinterpret_cast<char*>(&pointCount), sizeof(pointCount));
+		PM::Matrix features(featureLabels.totalDim(), pointCount);
+		PM::Matrix descriptors(descriptorLabels.totalDim(), pointCount);
+		PM::Int64Matrix times(timeLabels.totalDim(), pointCount);
+		stream.read(reinterpret_cast<char*>(features.data()), features.size() * sizeof(T));
+		stream.read(reinterpret_cast<char*>(descriptors.data()), descriptors.size() * sizeof(T));
+		stream.read(reinterpret_cast<char*>(times.data()), times.size() * sizeof(std::int64_t));
+		if(!stream)
+		{
+			throw std::runtime_error("Unexpected end of " + fileName + ".");
+		}
+		
+		PM::DataPoints block(features, featureLabels);
+		int startingRow = 0;
+		for(const PM::DataPoints::Label& label: descriptorLabels)
+		{
+			block.addDescriptor(label.text, descriptors.middleRows(startingRow, label.span));
+			startingRow += label.span;
+		}
+		startingRow = 0;
+		for(const PM::DataPoints::Label& label: timeLabels)
+		{
+			block.addTime(label.text, times.middleRows(startingRow, label.span));
+			startingRow += label.span;
+		}
+		
+		if(points.getNbPoints() == 0)
+		{
+			points = block;
+		}
+		else
+		{
+			points.concatenate(block);
+		}
+		pointTags.insert(pointTags.end(), pointCount, tag);
+	}
+	return points;
+}
@@ -0,0 +1,23 @@
+#ifndef BLOCK_FILE_H
+#define BLOCK_FILE_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Temporary file to which points are appended by tagged block, so that the points of a large map are grouped on disk rather than in memory
+class BlockFile
+{
+public:
+	static void append(const std::string& fileName, const PM::DataPoints& points, const std::vector<int>& pointIndexes, std::uint32_t tag);
+	
+	// all blocks must have these labels in this order, the tag of each point being that of its block
+	static PM::DataPoints read(const std::string& fileName, const PM::DataPoints::Labels& featureLabels, const PM::DataPoints::Labels& descriptorLabels,
+							   const PM::DataPoints::Labels& timeLabels, std::vector<std::uint32_t>& pointTags);
+};
+
+#endif
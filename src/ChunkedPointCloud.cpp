@@ -0,0 +1,274 @@
+#include "ChunkedPointCloud.h"
+#include <algorithm>
+#include <stdexcept>
+
+ChunkedPointCloud::ChunkedPointCloud(unsigned chunkCapacity):
+		chunkCapacity(chunkCapacity),
+		pointCount(0)
+{
+}
+
+ChunkedPointCloud::ChunkedPointCloud(const PM::DataPoints& points, unsigned chunkCapacity):
+		chunkCapacity(chunkCapacity),
+		pointCount(0)
+{
+	append(points);
+}
+
+ChunkedPointCloud::Chunk ChunkedPointCloud::createChunk(const PM::DataPoints& points)
+{
+	const int euclideanDim = points.getEuclideanDim();
+	
+	Chunk chunk;
+	chunk.points = std::make_shared<const PM::DataPoints>(points);
+	chunk.minCorner = points.features.topRows(euclideanDim).rowwise().minCoeff();
+	chunk.maxCorner = points.features.topRows(euclideanDim).rowwise().maxCoeff();
+	return chunk;
+}
+
+PM::DataPoints ChunkedPointCloud::extractRange(const PM::DataPoints& points, int firstPointIndex, int rangePointCount)
+{
+	PM::DataPoints range = points.createSimilarEmpty(rangePointCount);
+	range.features = points.features.middleCols(firstPointIndex, rangePointCount);
+	if(points.descriptors.rows() > 0)
+	{
+		range.descriptors = points.descriptors.middleCols(firstPointIndex, rangePointCount);
+	}
+	if(points.times.rows() > 0)
+	{
+		range.times = points.times.middleCols(firstPointIndex, rangePointCount);
+	}
+	return range;
+}
+
+bool ChunkedPointCloud::haveSameLabels(const PM::DataPoints::Labels& labels, const PM::DataPoints::Labels& otherLabels)
+{
+	if(labels.size() != otherLabels.size())
+	{
+		return false;
+	}
+	for(size_t i = 0; i < labels.size(); i++)
+	{
+		if(labels[i].text != otherLabels[i].text || labels[i].span != otherLabels[i].span)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ChunkedPointCloud::hasCloudLabels(const PM::DataPoints& points) const
+{
+	return haveSameLabels(points.descriptorLabels, descriptorLabels) && haveSameLabels(points.timeLabels, timeLabels);
+}
+
+PM::DataPoints ChunkedPointCloud::normalize(const PM::DataPoints& points) const
+{
+	PM::DataPoints normalizedPoints(points.features, points.featureLabels);
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		if(!points.descriptorExists(label.text) || points.getDescriptorDimension(label.text) != label.span)
+		{
+			throw std::runtime_error("Points have no " + label.text + " descriptor of the chunked point cloud.");
+		}
+		normalizedPoints.addDescriptor(label.text, points.getDescriptorCopyByName(label.text));
+	}
+	for(const PM::DataPoints::Label& label: timeLabels)
+	{
+		if(!points.timeExists(label.text) || points.getTimeDimension(label.text) != label.span)
+		{
+			throw std::runtime_error("Points have no " + label.text + " time of the chunked point cloud.");
+		}
+		normalizedPoints.addTime(label.text, points.getTimeCopyByName(label.text));
+	}
+	return normalizedPoints;
+}
+
+void ChunkedPointCloud::dropMissingLabels(const PM::DataPoints& points)
+{
+	PM::DataPoints::Labels keptDescriptorLabels;
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		if(points.descriptorExists(label.text) && points.getDescriptorDimension(label.text) == label.span)
+		{
+			keptDescriptorLabels.push_back(label);
+		}
+	}
+	PM::DataPoints::Labels keptTimeLabels;
+	for(const PM::DataPoints::Label& label: timeLabels)
+	{
+		if(points.timeExists(label.text) && points.getTimeDimension(label.text) == label.span)
+		{
+			keptTimeLabels.push_back(label);
+		}
+	}
+	if(keptDescriptorLabels.size() == descriptorLabels.size() && keptTimeLabels.size() == timeLabels.size())
+	{
+		return;
+	}
+	
+	// every chunk is copied, which only happens when the layout of the inputs changes
+	descriptorLabels = keptDescriptorLabels;
+	timeLabels = keptTimeLabels;
+	for(Chunk& chunk: chunks)
+	{
+		chunk = createChunk(normalize(*chunk.points));
+	}
+}
+
+void ChunkedPointCloud::append(const PM::DataPoints& points)
+{
+	if(chunks.empty())
+	{
+		descriptorLabels = points.descriptorLabels;
+		timeLabels = points.timeLabels;
+	}
+	else
+	{
+		dropMissingLabels(points);
+	}
+	
+	if(hasCloudLabels(points))
+	{
+		appendNormalized(points);
+	}
+	else
+	{
+		appendNormalized(normalize(points));
+	}
+}
+
+void ChunkedPointCloud::appendNormalized(const PM::DataPoints& points)
+{
+	int appendedPointCount = 0;
+	while(appendedPointCount < points.getNbPoints())
+	{
+		if(chunks.empty() || chunks.back().points->getNbPoints() >= chunkCapacity)
+		{
+			int chunkPointCount = std::min<int>(chunkCapacity, points.getNbPoints() - appendedPointCount);
+			chunks.push_back(createChunk(extractRange(points, appendedPointCount, chunkPointCount)));
+			appendedPointCount += chunkPointCount;
+		}
+		else
+		{
+			int chunkPointCount = std::min<int>(chunkCapacity - chunks.back().points->getNbPoints(), points.getNbPoints() - appendedPointCount);
+			PM::DataPoints lastChunkPoints = *chunks.back().points;
+			lastChunkPoints.concatenate(extractRange(points, appendedPointCount, chunkPointCount));
+			chunks.back() = createChunk(lastChunkPoints);
+			appendedPointCount += chunkPointCount;
+		}
+	}
+	pointCount += points.getNbPoints();
+}
+
+std::vector<unsigned> ChunkedPointCloud::findChunksInRange(const PM::Vector& center, float radius) const
+{
+	std::vector<unsigned> chunkIndexes;
+	for(unsigned i = 0; i < chunks.size(); i++)
+	{
+		PM::Vector closestPoint = center.cwiseMax(chunks[i].minCorner).cwiseMin(chunks[i].maxCorner);
+		if((closestPoint - center).norm() < radius)
+		{
+			chunkIndexes.push_back(i);
+		}
+	}
+	return chunkIndexes;
+}
+
+const PM::DataPoints& ChunkedPointCloud::getChunk(unsigned chunkIndex) const
+{
+	return *chunks[chunkIndex].points;
+}
+
+void ChunkedPointCloud::setChunk(unsigned chunkIndex, const PM::DataPoints& points)
+{
+	if(hasCloudLabels(points))
+	{
+		chunks[chunkIndex] = createChunk(points);
+	}
+	else
+	{
+		chunks[chunkIndex] = createChunk(normalize(points));
+	}
+}
+
+void ChunkedPointCloud::setChunks(const std::vector<unsigned>& chunkIndexes, const PM::DataPoints& points)
+{
+	int firstPointIndex = 0;
+	for(unsigned chunkIndex: chunkIndexes)
+	{
+		const int chunkPointCount = chunks[chunkIndex].points->getNbPoints();
+		setChunk(chunkIndex, extractRange(points, firstPointIndex, chunkPointCount));
+		firstPointIndex += chunkPointCount;
+	}
+}
+
+std::vector<unsigned> ChunkedPointCloud::findChangedChunks(const ChunkedPointCloud& previousCloud) const
+{
+	std::vector<unsigned> chunkIndexes;
+	for(unsigned i = 0; i < chunks.size(); i++)
+	{
+		if(i >= previousCloud.chunks.size() || chunks[i].points != previousCloud.chunks[i].points)
+		{
+			chunkIndexes.push_back(i);
+		}
+	}
+	return chunkIndexes;
+}
+
+PM::DataPoints ChunkedPointCloud::extract(const std::vector<unsigned>& chunkIndexes) const
+{
+	if(chunks.empty())
+	{
+		return PM::DataPoints();
+	}
+	
+	int extractedPointCount = 0;
+	for(unsigned chunkIndex: chunkIndexes)
+	{
+		extractedPointCount += chunks[chunkIndex].points->getNbPoints();
+	}
+	
+	// all chunks have the descriptors and times of the cloud, in the same order
+	PM::DataPoints extractedPoints = chunks[0].points->createSimilarEmpty(extractedPointCount);
+	int firstPointIndex = 0;
+	for(unsigned chunkIndex: chunkIndexes)
+	{
+		const PM::DataPoints& chunkPoints = *chunks[chunkIndex].points;
+		if(!hasCloudLabels(chunkPoints))
+		{
+			throw std::runtime_error("Chunk " + std::to_string(chunkIndex) + " does not have the descriptors and times of the chunked point cloud.");
+		}
+		extractedPoints.features.middleCols(firstPointIndex, chunkPoints.getNbPoints()) = chunkPoints.features;
+		if(chunkPoints.descriptors.rows() > 0)
+		{
+			extractedPoints.descriptors.middleCols(firstPointIndex, chunkPoints.getNbPoints()) = chunkPoints.descriptors;
+		}
+		if(chunkPoints.times.rows() > 0)
+		{
+			extractedPoints.times.middleCols(firstPointIndex, chunkPoints.getNbPoints()) = chunkPoints.times;
+		}
+		firstPointIndex += chunkPoints.getNbPoints();
+	}
+	return extractedPoints;
+}
+
+PM::DataPoints ChunkedPointCloud::toDataPoints() const
+{
+	std::vector<unsigned> chunkIndexes(chunks.size());
+	for(unsigned i = 0; i < chunks.size(); i++)
+	{
+		chunkIndexes[i] = i;
+	}
+	return extract(chunkIndexes);
+}
+
+unsigned ChunkedPointCloud::getPointCount() const
+{
+	return pointCount;
+}
+
+unsigned ChunkedPointCloud::getChunkCount() const
+{
+	return chunks.size();
+}
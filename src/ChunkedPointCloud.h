@@ -0,0 +1,75 @@
+#ifndef CHUNKED_POINT_CLOUD_H
+#define CHUNKED_POINT_CLOUD_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <memory>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Point cloud stored as chunks of bounded size shared between copies, so that copying the cloud copies no point and appending copies only the last chunk
+class ChunkedPointCloud
+{
+private:
+	struct Chunk
+	{
+		std::shared_ptr<const PM::DataPoints> points;
+		PM::Vector minCorner;
+		PM::Vector maxCorner;
+	};
+	
+	unsigned chunkCapacity;
+	std::vector<Chunk> chunks;
+	unsigned pointCount;
+	// descriptors and times of every chunk, in this order
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	
+	static Chunk createChunk(const PM::DataPoints& points);
+	
+	static PM::DataPoints extractRange(const PM::DataPoints& points, int firstPointIndex, int rangePointCount);
+	
+	static bool haveSameLabels(const PM::DataPoints::Labels& labels, const PM::DataPoints::Labels& otherLabels);
+	
+	bool hasCloudLabels(const PM::DataPoints& points) const;
+	
+	PM::DataPoints normalize(const PM::DataPoints& points) const;
+	
+	void dropMissingLabels(const PM::DataPoints& points);
+	
+	void appendNormalized(const PM::DataPoints& points);
+	
+public:
+	ChunkedPointCloud(unsigned chunkCapacity);
+	
+	ChunkedPointCloud(const PM::DataPoints& points, unsigned chunkCapacity);
+	
+	// like DataPoints::concatenate, descriptors and times missing from the points are dropped from the cloud, and those missing from the cloud are dropped
+	// from the points
+	void append(const PM::DataPoints& points);
+	
+	// chunks whose bounding box is closer than radius to center
+	std::vector<unsigned> findChunksInRange(const PM::Vector& center, float radius) const;
+	
+	const PM::DataPoints& getChunk(unsigned chunkIndex) const;
+	
+	// the point count of the chunk must not change, and the points must have the descriptors and times of the cloud
+	void setChunk(unsigned chunkIndex, const PM::DataPoints& points);
+	
+	// the points are the concatenation of the chunks, as returned by extract
+	void setChunks(const std::vector<unsigned>& chunkIndexes, const PM::DataPoints& points);
+	
+	// chunks that are not shared with previousCloud, which only compares their addresses since copies and appends keep the other chunks shared
+	std::vector<unsigned> findChangedChunks(const ChunkedPointCloud& previousCloud) const;
+	
+	PM::DataPoints extract(const std::vector<unsigned>& chunkIndexes) const;
+	
+	PM::DataPoints toDataPoints() const;
+	
+	unsigned getPointCount() const;
+	
+	unsigned getChunkCount() const;
+};
+
+#endif
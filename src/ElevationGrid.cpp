@@ -0,0 +1,166 @@
+#include "ElevationGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ElevationGrid::ElevationGrid(float resolution, float radius):
+		resolution(resolution),
+		size(std::max(1, static_cast<int>(std::ceil(2 * radius / resolution)))),
+		originCellX(0),
+		originCellY(0),
+		isPlaced(false),
+		cells(size * size)
+{
+	clear();
+}
+
+void ElevationGrid::resetCell(Cell& cell)
+{
+	cell.minHeight = std::numeric_limits<float>::infinity();
+	cell.maxHeight = -std::numeric_limits<float>::infinity();
+	cell.heightSum = 0;
+	cell.pointCount = 0;
+	cell.isStale = true;
+}
+
+int ElevationGrid::retrieveStorageIndex(int cellX, int cellY) const
+{
+	const int storageX = ((cellX % size) + size) % size;
+	const int storageY = ((cellY % size) + size) % size;
+	return storageY * size + storageX;
+}
+
+bool ElevationGrid::recenter(T x, T y)
+{
+	const int newOriginCellX = static_cast<int>(std::floor(x / resolution)) - size / 2;
+	const int newOriginCellY = static_cast<int>(std::floor(y / resolution)) - size / 2;
+	
+	// the window only moves after the robot travelled a quarter of it, so that refills stay rare
+	if(isPlaced && std::abs(newOriginCellX - originCellX) < size / 4 && std::abs(newOriginCellY - originCellY) < size / 4)
+	{
+		return false;
+	}
+	
+	bool hasStaleCells = !isPlaced;
+	if(isPlaced)
+	{
+		for(int cellY = originCellY; cellY < originCellY + size; cellY++)
+		{
+			for(int cellX = originCellX; cellX < originCellX + size; cellX++)
+			{
+				if(cellX < newOriginCellX || cellX >= newOriginCellX + size || cellY < newOriginCellY || cellY >= newOriginCellY + size)
+				{
+					resetCell(cells[retrieveStorageIndex(cellX, cellY)]);
+					hasStaleCells = true;
+				}
+			}
+		}
+	}
+	
+	originCellX = newOriginCellX;
+	originCellY = newOriginCellY;
+	isPlaced = true;
+	return hasStaleCells;
+}
+
+void ElevationGrid::clear()
+{
+	for(Cell& cell: cells)
+	{
+		resetCell(cell);
+	}
+	isPlaced = false;
+}
+
+void ElevationGrid::addPoint(Cell& cell, T height)
+{
+	cell.minHeight = std::min(cell.minHeight, height);
+	cell.maxHeight = std::max(cell.maxHeight, height);
+	cell.heightSum += height;
+	cell.pointCount++;
+}
+
+void ElevationGrid::addPoints(const PM::DataPoints& points)
+{
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		const int cellX = std::floor(points.features(0, i) / resolution);
+		const int cellY = std::floor(points.features(1, i) / resolution);
+		if(cellX >= originCellX && cellX < originCellX + size && cellY >= originCellY && cellY < originCellY + size)
+		{
+			addPoint(cells[retrieveStorageIndex(cellX, cellY)], points.features(2, i));
+		}
+	}
+}
+
+void ElevationGrid::refillStaleCells(const PM::DataPoints& points)
+{
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		const int cellX = std::floor(points.features(0, i) / resolution);
+		const int cellY = std::floor(points.features(1, i) / resolution);
+		if(cellX >= originCellX && cellX < originCellX + size && cellY >= originCellY && cellY < originCellY + size)
+		{
+			Cell& cell = cells[retrieveStorageIndex(cellX, cellY)];
+			if(cell.isStale)
+			{
+				addPoint(cell, points.features(2, i));
+			}
+		}
+	}
+}
+
+void ElevationGrid::markStaleCellsFilled()
+{
+	for(Cell& cell: cells)
+	{
+		cell.isStale = false;
+	}
+}
+
+PM::DataPoints ElevationGrid::toDataPoints() const
+{
+	PM::DataPoints::Labels featureLabels;
+	featureLabels.push_back(PM::DataPoints::Label("x", 1));
+	featureLabels.push_back(PM::DataPoints::Label("y", 1));
+	featureLabels.push_back(PM::DataPoints::Label("z", 1));
+	featureLabels.push_back(PM::DataPoints::Label("pad", 1));
+	PM::DataPoints::Labels descriptorLabels;
+	descriptorLabels.push_back(PM::DataPoints::Label("minHeight", 1));
+	descriptorLabels.push_back(PM::DataPoints::Label("maxHeight", 1));
+	descriptorLabels.push_back(PM::DataPoints::Label("pointCount", 1));
+	
+	PM::DataPoints points(featureLabels, descriptorLabels, size * size);
+	int pointCount = 0;
+	for(int cellY = originCellY; cellY < originCellY + size; cellY++)
+	{
+		for(int cellX = originCellX; cellX < originCellX + size; cellX++)
+		{
+			const Cell& cell = cells[retrieveStorageIndex(cellX, cellY)];
+			if(cell.pointCount > 0)
+			{
+				points.features(0, pointCount) = (cellX + 0.5) * resolution;
+				points.features(1, pointCount) = (cellY + 0.5) * resolution;
+				points.features(2, pointCount) = cell.heightSum / cell.pointCount;
+				points.features(3, pointCount) = 1;
+				points.descriptors(0, pointCount) = cell.minHeight;
+				points.descriptors(1, pointCount) = cell.maxHeight;
+				points.descriptors(2, pointCount) = cell.pointCount;
+				pointCount++;
+			}
+		}
+	}
+	points.conservativeResize(pointCount);
+	
+	return points;
+}
+
+float ElevationGrid::getRadius() const
+{
+	return size * resolution / 2.0;
+}
+
+size_t ElevationGrid::getBytes() const
+{
+	return cells.size() * sizeof(Cell);
+}
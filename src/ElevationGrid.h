@@ -0,0 +1,62 @@
+#ifndef ELEVATION_GRID_H
+#define ELEVATION_GRID_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// 2.5D grid of height statistics over a square window following the robot, stored as a ring buffer so that moving the window only clears the cells leaving it
+class ElevationGrid
+{
+private:
+	struct Cell
+	{
+		float minHeight;
+		float maxHeight;
+		float heightSum;
+		std::uint32_t pointCount;
+		// cells entering the window are filled again from the map before receiving new points
+		bool isStale;
+	};
+	
+	float resolution;
+	int size;
+	int originCellX;
+	int originCellY;
+	bool isPlaced;
+	std::vector<Cell> cells;
+	
+	static void resetCell(Cell& cell);
+	
+	int retrieveStorageIndex(int cellX, int cellY) const;
+	
+	void addPoint(Cell& cell, T height);
+	
+public:
+	ElevationGrid(float resolution, float radius);
+	
+	// returns true when cells entered the window, in which case they must be filled with refillStaleCells
+	bool recenter(T x, T y);
+	
+	// clears every cell, so that they are all refilled after the next recenter
+	void clear();
+	
+	void addPoints(const PM::DataPoints& points);
+	
+	// adds points to stale cells only, must be called with all the map points in the window before markStaleCellsFilled
+	void refillStaleCells(const PM::DataPoints& points);
+	
+	void markStaleCellsFilled();
+	
+	// one point per non-empty cell at its mean height, with the min height, max height and point count as descriptors
+	PM::DataPoints toDataPoints() const;
+	
+	float getRadius() const;
+	
+	size_t getBytes() const;
+};
+
+#endif
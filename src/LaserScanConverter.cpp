@@ -0,0 +1,63 @@
+#include "LaserScanConverter.h"
+
+LaserScanConverter::LaserScanConverter():
+		angleMin(0),
+		angleIncrement(0)
+{
+	featureLabels.push_back(PM::DataPoints::Label("x", 1));
+	featureLabels.push_back(PM::DataPoints::Label("y", 1));
+	featureLabels.push_back(PM::DataPoints::Label("pad", 1));
+}
+
+void LaserScanConverter::updateTrigTables(const sensor_msgs::LaserScan& scan)
+{
+	if(scan.angle_min == angleMin && scan.angle_increment == angleIncrement && scan.ranges.size() == static_cast<size_t>(cosines.size()))
+	{
+		return;
+	}
+	
+	angleMin = scan.angle_min;
+	angleIncrement = scan.angle_increment;
+	Eigen::ArrayXf angles = Eigen::ArrayXf::LinSpaced(scan.ranges.size(), 0, scan.ranges.size() - 1) * angleIncrement + angleMin;
+	cosines = angles.cos();
+	sines = angles.sin();
+}
+
+PM::DataPoints LaserScanConverter::convert(const sensor_msgs::LaserScan& scan)
+{
+	updateTrigTables(scan);
+	
+	const int beamCount = scan.ranges.size();
+	Eigen::Map<const Eigen::ArrayXf> ranges(scan.ranges.data(), beamCount);
+	xs = ranges * cosines;
+	ys = ranges * sines;
+	
+	// comparisons with NaN are false, so invalid ranges fail both bounds
+	const int pointCount = ((ranges >= scan.range_min) && (ranges <= scan.range_max)).count();
+	const bool hasIntensities = scan.intensities.size() == scan.ranges.size();
+	
+	PM::DataPoints::Labels descriptorLabels;
+	if(hasIntensities)
+	{
+		descriptorLabels.push_back(PM::DataPoints::Label("intensity", 1));
+	}
+	PM::DataPoints points(featureLabels, descriptorLabels, pointCount);
+	points.features.row(2).setOnes();
+	
+	int pointIndex = 0;
+	for(int i = 0; i < beamCount; i++)
+	{
+		if(ranges(i) >= scan.range_min && ranges(i) <= scan.range_max)
+		{
+			points.features(0, pointIndex) = xs(i);
+			points.features(1, pointIndex) = ys(i);
+			if(hasIntensities)
+			{
+				points.descriptors(0, pointIndex) = scan.intensities[i];
+			}
+			pointIndex++;
+		}
+	}
+	
+	return points;
+}
@@ -0,0 +1,31 @@
+#ifndef LASER_SCAN_CONVERTER_H
+#define LASER_SCAN_CONVERTER_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <sensor_msgs/LaserScan.h>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Converts laser scans to 2D points, reusing the sines and cosines of the beam angles as long as the scan geometry does not change
+class LaserScanConverter
+{
+private:
+	float angleMin;
+	float angleIncrement;
+	Eigen::ArrayXf cosines;
+	Eigen::ArrayXf sines;
+	Eigen::ArrayXf xs;
+	Eigen::ArrayXf ys;
+	PM::DataPoints::Labels featureLabels;
+	
+	void updateTrigTables(const sensor_msgs::LaserScan& scan);
+	
+public:
+	LaserScanConverter();
+	
+	// ranges outside [range_min, range_max] and non-finite ranges are dropped
+	PM::DataPoints convert(const sensor_msgs::LaserScan& scan);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "LatencyWatchdog.h"
+#include <algorithm>
+
+LatencyWatchdog::LatencyWatchdog(const std::vector<std::string>& stageNames, float deadline, float maxOverrunRate, unsigned windowSize):
+		stageNames(stageNames),
+		deadline(deadline),
+		maxOverrunRate(maxOverrunRate),
+		windowSize(windowSize),
+		windowOverrunCount(0),
+		scansSinceLastSnapshot(windowSize),
+		scanCount(0),
+		overrunCount(0),
+		stageOverrunCounts(stageNames.size(), 0),
+		periodScanCount(0),
+		periodLatencySum(0),
+		periodMaxLatency(0),
+		periodStageDurationSums(stageNames.size(), 0),
+		periodStageMaxDurations(stageNames.size(), 0)
+{
+}
+
+bool LatencyWatchdog::reportScan(float latency, const std::vector<float>& stageDurations)
+{
+	std::lock_guard<std::mutex> lock(statisticsLock);
+	
+	scanCount++;
+	periodScanCount++;
+	periodLatencySum += latency;
+	periodMaxLatency = std::max(periodMaxLatency, latency);
+	for(size_t i = 0; i < stageNames.size() && i < stageDurations.size(); i++)
+	{
+		periodStageDurationSums[i] += stageDurations[i];
+		periodStageMaxDurations[i] = std::max(periodStageMaxDurations[i], stageDurations[i]);
+	}
+	
+	bool isOverrun = deadline > 0 && latency > deadline;
+	if(isOverrun)
+	{
+		overrunCount++;
+		
+		// the overrun is blamed on the stage which took the longest
+		size_t slowestStage = std::max_element(stageDurations.begin(), stageDurations.end()) - stageDurations.begin();
+		if(slowestStage < stageOverrunCounts.size())
+		{
+			stageOverrunCounts[slowestStage]++;
+		}
+	}
+	
+	window.push_back(isOverrun);
+	windowOverrunCount += isOverrun;
+	if(window.size() > windowSize)
+	{
+		windowOverrunCount -= window.front();
+		window.pop_front();
+	}
+	
+	scansSinceLastSnapshot++;
+	if(isOverrun && scansSinceLastSnapshot >= windowSize && windowOverrunCount > maxOverrunRate * window.size())
+	{
+		scansSinceLastSnapshot = 0;
+		return true;
+	}
+	return false;
+}
+
+LatencyWatchdog::Statistics LatencyWatchdog::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(statisticsLock);
+	
+	Statistics statistics;
+	statistics.scanCount = scanCount;
+	statistics.overrunCount = overrunCount;
+	statistics.meanLatency = periodScanCount > 0 ? periodLatencySum / periodScanCount : 0;
+	statistics.maxLatency = periodMaxLatency;
+	for(size_t i = 0; i < stageNames.size(); i++)
+	{
+		StageStatistics stage;
+		stage.name = stageNames[i];
+		stage.meanDuration = periodScanCount > 0 ? periodStageDurationSums[i] / periodScanCount : 0;
+		stage.maxDuration = periodStageMaxDurations[i];
+		stage.overrunCount = stageOverrunCounts[i];
+		statistics.stages.push_back(stage);
+	}
+	
+	periodScanCount = 0;
+	periodLatencySum = 0;
+	periodMaxLatency = 0;
+	std::fill(periodStageDurationSums.begin(), periodStageDurationSums.end(), 0);
+	std::fill(periodStageMaxDurations.begin(), periodStageMaxDurations.end(), 0);
+	
+	return statistics;
+}
@@ -0,0 +1,55 @@
+#ifndef LATENCY_WATCHDOG_H
+#define LATENCY_WATCHDOG_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class LatencyWatchdog
+{
+public:
+	struct StageStatistics
+	{
+		std::string name;
+		float meanDuration;
+		float maxDuration;
+		unsigned long overrunCount;
+	};
+	
+	struct Statistics
+	{
+		unsigned long scanCount;
+		unsigned long overrunCount;
+		float meanLatency;
+		float maxLatency;
+		std::vector<StageStatistics> stages;
+	};
+	
+private:
+	std::vector<std::string> stageNames;
+	float deadline;
+	float maxOverrunRate;
+	unsigned windowSize;
+	std::deque<bool> window;
+	unsigned windowOverrunCount;
+	unsigned scansSinceLastSnapshot;
+	unsigned long scanCount;
+	unsigned long overrunCount;
+	std::vector<unsigned long> stageOverrunCounts;
+	unsigned long periodScanCount;
+	float periodLatencySum;
+	float periodMaxLatency;
+	std::vector<float> periodStageDurationSums;
+	std::vector<float> periodStageMaxDurations;
+	std::mutex statisticsLock;
+	
+public:
+	LatencyWatchdog(const std::vector<std::string>& stageNames, float deadline, float maxOverrunRate, unsigned windowSize);
+	
+	bool reportScan(float latency, const std::vector<float>& stageDurations);
+	
+	Statistics getStatistics();
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "LikelihoodFieldMatcher.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+const unsigned MAX_ITERATION_COUNT = 20;
+const unsigned MAX_STEP_HALVING_COUNT = 10;
+const float MIN_TRANSLATION_STEP = 1e-4;
+const float MIN_ROTATION_STEP = 1e-5;
+
+LikelihoodFieldMatcher::LikelihoodFieldMatcher(float resolution, float maxDistance, float windowMargin):
+		resolution(resolution),
+		maxDistance(maxDistance),
+		windowMargin(windowMargin),
+		originX(0),
+		originY(0),
+		width(0),
+		height(0),
+		referencePointCount(0)
+{
+}
+
+void LikelihoodFieldMatcher::setReference(const PM::DataPoints& reference)
+{
+	referencePointCount = 0;
+	if(reference.getNbPoints() == 0)
+	{
+		width = 0;
+		height = 0;
+		distances.clear();
+		return;
+	}
+	
+	const float margin = windowMargin + maxDistance;
+	originX = reference.features.row(0).minCoeff() - margin;
+	originY = reference.features.row(1).minCoeff() - margin;
+	width = std::ceil((reference.features.row(0).maxCoeff() + margin - originX) / resolution) + 1;
+	height = std::ceil((reference.features.row(1).maxCoeff() + margin - originY) / resolution) + 1;
+	distances.assign(width * height, maxDistance);
+	
+	addPointsToGrid(reference);
+}
+
+bool LikelihoodFieldMatcher::addReferencePoints(const PM::DataPoints& points)
+{
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		const float x = (points.features(0, i) - originX) / resolution;
+		const float y = (points.features(1, i) - originY) / resolution;
+		if(x < 0 || y < 0 || x >= width || y >= height)
+		{
+			return false;
+		}
+	}
+	
+	addPointsToGrid(points);
+	return true;
+}
+
+void LikelihoodFieldMatcher::addPointsToGrid(const PM::DataPoints& points)
+{
+	// only the cells closer than the max distance to a new point can change
+	const int kernelRadius = std::ceil(maxDistance / resolution);
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		const float pointX = points.features(0, i);
+		const float pointY = points.features(1, i);
+		const int cellX = std::floor((pointX - originX) / resolution);
+		const int cellY = std::floor((pointY - originY) / resolution);
+		for(int y = std::max(0, cellY - kernelRadius); y <= std::min(height - 1, cellY + kernelRadius); y++)
+		{
+			for(int x = std::max(0, cellX - kernelRadius); x <= std::min(width - 1, cellX + kernelRadius); x++)
+			{
+				const float distance = std::hypot(originX + (x + 0.5f) * resolution - pointX, originY + (y + 0.5f) * resolution - pointY);
+				float& cellDistance = distances[y * width + x];
+				if(distance < cellDistance)
+				{
+					cellDistance = distance;
+				}
+			}
+		}
+	}
+	referencePointCount += points.getNbPoints();
+}
+
+float LikelihoodFieldMatcher::interpolateDistance(float x, float y, float& gradientX, float& gradientY) const
+{
+	// coordinates relative to cell centers
+	const float u = (x - originX) / resolution - 0.5f;
+	const float v = (y - originY) / resolution - 0.5f;
+	const int cellX = std::floor(u);
+	const int cellY = std::floor(v);
+	if(cellX < 0 || cellY < 0 || cellX + 1 >= width || cellY + 1 >= height)
+	{
+		gradientX = 0;
+		gradientY = 0;
+		return maxDistance;
+	}
+	
+	const float fractionX = u - cellX;
+	const float fractionY = v - cellY;
+	const float d00 = distances[cellY * width + cellX];
+	const float d10 = distances[cellY * width + cellX + 1];
+	const float d01 = distances[(cellY + 1) * width + cellX];
+	const float d11 = distances[(cellY + 1) * width + cellX + 1];
+	
+	gradientX = ((1 - fractionY) * (d10 - d00) + fractionY * (d11 - d01)) / resolution;
+	gradientY = ((1 - fractionX) * (d01 - d00) + fractionX * (d11 - d10)) / resolution;
+	return (1 - fractionY) * ((1 - fractionX) * d00 + fractionX * d10) + fractionY * ((1 - fractionX) * d01 + fractionX * d11);
+}
+
+LikelihoodFieldMatcher::Evaluation LikelihoodFieldMatcher::evaluate(const PM::DataPoints& reading, const Eigen::Vector2f& center, const Eigen::Vector3f& pose) const
+{
+	const float cosTheta = std::cos(pose(2));
+	const float sinTheta = std::sin(pose(2));
+	
+	Evaluation evaluation;
+	evaluation.hessian.setZero();
+	evaluation.gradient.setZero();
+	evaluation.cost = 0;
+	evaluation.squaredDistanceSum = 0;
+	evaluation.fieldPointCount = 0;
+	evaluation.closePointCount = 0;
+	for(int i = 0; i < reading.getNbPoints(); i++)
+	{
+		const float offsetX = reading.features(0, i) - center(0);
+		const float offsetY = reading.features(1, i) - center(1);
+		const float x = cosTheta * offsetX - sinTheta * offsetY + center(0) + pose(0);
+		const float y = sinTheta * offsetX + cosTheta * offsetY + center(1) + pose(1);
+		
+		float distanceGradientX;
+		float distanceGradientY;
+		const float distance = interpolateDistance(x, y, distanceGradientX, distanceGradientY);
+		
+		// points further than the max distance from the reference have a flat field and do not constrain the pose
+		evaluation.cost += distance * distance;
+		if(distance >= maxDistance)
+		{
+			continue;
+		}
+		
+		Eigen::Vector3f jacobian(distanceGradientX, distanceGradientY,
+								 distanceGradientX * (-sinTheta * offsetX - cosTheta * offsetY) + distanceGradientY * (cosTheta * offsetX - sinTheta * offsetY));
+		evaluation.hessian += jacobian * jacobian.transpose();
+		evaluation.gradient += jacobian * distance;
+		evaluation.squaredDistanceSum += distance * distance;
+		evaluation.fieldPointCount++;
+		if(distance < maxDistance / 2)
+		{
+			evaluation.closePointCount++;
+		}
+	}
+	return evaluation;
+}
+
+LikelihoodFieldMatcher::Result LikelihoodFieldMatcher::align(const PM::DataPoints& reading) const
+{
+	Eigen::Vector2f center = Eigen::Vector2f::Zero();
+	if(reading.getNbPoints() > 0)
+	{
+		center = reading.features.topRows(2).rowwise().mean();
+	}
+	
+	// Gauss-Newton on the distances, the rotation being applied around the center of the reading to decouple it from the translation
+	Eigen::Vector3f pose = Eigen::Vector3f::Zero();
+	Evaluation evaluation = evaluate(reading, center, pose);
+	
+	Result result;
+	result.iterationCount = 0;
+	while(result.iterationCount < MAX_ITERATION_COUNT)
+	{
+		if(evaluation.fieldPointCount < 3 || std::abs(evaluation.hessian.determinant()) < 1e-12)
+		{
+			break;
+		}
+		
+		// the distance is not differentiable on the reference points, so steps overshooting the minimum are halved
+		Eigen::Vector3f step = -evaluation.hessian.ldlt().solve(evaluation.gradient);
+		Evaluation nextEvaluation = evaluate(reading, center, pose + step);
+		for(unsigned i = 0; i < MAX_STEP_HALVING_COUNT && nextEvaluation.cost >= evaluation.cost; i++)
+		{
+			step /= 2;
+			nextEvaluation = evaluate(reading, center, pose + step);
+		}
+		// no step decreasing the cost was found, so the current pose is a minimum at the resolution of the field
+		if(nextEvaluation.cost >= evaluation.cost)
+		{
+			break;
+		}
+		pose += step;
+		evaluation = nextEvaluation;
+		result.iterationCount++;
+		
+		if(step.head(2).norm() < MIN_TRANSLATION_STEP && std::abs(step(2)) < MIN_ROTATION_STEP)
+		{
+			break;
+		}
+	}
+	
+	Eigen::Matrix2f rotation;
+	rotation << std::cos(pose(2)), -std::sin(pose(2)), std::sin(pose(2)), std::cos(pose(2));
+	result.correction = PM::TransformationParameters::Identity(3, 3);
+	result.correction.topLeftCorner(2, 2) = rotation;
+	result.correction.topRightCorner(2, 1) = center - rotation * center + pose.head(2);
+	result.residual = evaluation.fieldPointCount > 0 ? std::sqrt(evaluation.squaredDistanceSum / evaluation.fieldPointCount) : 0;
+	result.overlap = reading.getNbPoints() > 0 ? float(evaluation.closePointCount) / reading.getNbPoints() : 0;
+	result.referencePointCount = referencePointCount;
+	return result;
+}
+
+size_t LikelihoodFieldMatcher::getGridBytes() const
+{
+	return distances.size() * sizeof(float);
+}
@@ -0,0 +1,67 @@
+#ifndef LIKELIHOOD_FIELD_MATCHER_H
+#define LIKELIHOOD_FIELD_MATCHER_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// 2D registration against a grid of distances to the closest reference point, replacing nearest neighbor searches by grid lookups
+class LikelihoodFieldMatcher
+{
+public:
+	struct Result
+	{
+		PM::TransformationParameters correction;
+		unsigned iterationCount;
+		float residual;
+		float overlap;
+		// points of the reference the input was aligned to, read with the field
+		unsigned referencePointCount;
+	};
+	
+private:
+	struct Evaluation
+	{
+		Eigen::Matrix3f hessian;
+		Eigen::Vector3f gradient;
+		// points outside of the field count as being at the max distance
+		float cost;
+		float squaredDistanceSum;
+		unsigned fieldPointCount;
+		unsigned closePointCount;
+	};
+	
+	float resolution;
+	float maxDistance;
+	float windowMargin;
+	float originX;
+	float originY;
+	int width;
+	int height;
+	std::vector<float> distances;
+	unsigned referencePointCount;
+	
+	void addPointsToGrid(const PM::DataPoints& points);
+	
+	float interpolateDistance(float x, float y, float& gradientX, float& gradientY) const;
+	
+	Evaluation evaluate(const PM::DataPoints& reading, const Eigen::Vector2f& center, const Eigen::Vector3f& pose) const;
+	
+public:
+	// the grid covers the reference with windowMargin to spare, so that points inserted near it are added without rebuilding the grid
+	LikelihoodFieldMatcher(float resolution, float maxDistance, float windowMargin);
+	
+	void setReference(const PM::DataPoints& reference);
+	
+	// returns false without changing the grid when a point falls outside of it, in which case the whole reference must be set again
+	bool addReferencePoints(const PM::DataPoints& points);
+	
+	// the reading is expected in the reference frame, close to its final pose
+	Result align(const PM::DataPoints& reading) const;
+	
+	size_t getGridBytes() const;
+};
+
+#endif
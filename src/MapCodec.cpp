@@ -0,0 +1,246 @@
+#include "MapCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+// number of values of a quantized descriptor
+const float DESCRIPTOR_QUANTIZATION_LEVELS = 65535;
+
+void MapCodec::appendVarint(std::string& buffer, std::uint64_t value)
+{
+	while(value >= 0x80)
+	{
+		buffer += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	buffer += static_cast<char>(value);
+}
+
+std::uint64_t MapCodec::readVarint(const char*& cursor, const char* end)
+{
+	std::uint64_t value = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		if(cursor == end)
+		{
+			throw std::runtime_error("Unexpected end of compressed map block.");
+		}
+		std::uint8_t byte = *cursor++;
+		value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if(byte < 0x80)
+		{
+			return value;
+		}
+	}
+	throw std::runtime_error("Invalid variable-length integer in compressed map block.");
+}
+
+std::uint64_t MapCodec::encodeZigZag(std::int64_t value)
+{
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t MapCodec::decodeZigZag(std::uint64_t value)
+{
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+std::uint64_t MapCodec::computeMortonCode(const std::int64_t* offsets, int dimension, int shift)
+{
+	const int bitsPerCoordinate = 64 / dimension;
+	std::uint64_t code = 0;
+	for(int bit = 0; bit < bitsPerCoordinate; bit++)
+	{
+		for(int i = 0; i < dimension; i++)
+		{
+			code |= ((static_cast<std::uint64_t>(offsets[i]) >> shift >> bit) & 1) << (bit * dimension + i);
+		}
+	}
+	return code;
+}
+
+std::vector<int> MapCodec::sortInMortonOrder(const std::vector<std::int64_t>& quantizedCoordinates, int dimension, int pointCount)
+{
+	std::vector<std::int64_t> minCoordinates(dimension, std::numeric_limits<std::int64_t>::max());
+	std::vector<std::int64_t> maxCoordinates(dimension, std::numeric_limits<std::int64_t>::min());
+	for(int i = 0; i < pointCount; i++)
+	{
+		for(int j = 0; j < dimension; j++)
+		{
+			minCoordinates[j] = std::min(minCoordinates[j], quantizedCoordinates[i * dimension + j]);
+			maxCoordinates[j] = std::max(maxCoordinates[j], quantizedCoordinates[i * dimension + j]);
+		}
+	}
+	
+	// offsets are shifted so that they fit in the bits of a coordinate in the code, which only coarsens the order of very large blocks
+	int shift = 0;
+	for(int j = 0; j < dimension; j++)
+	{
+		while(((maxCoordinates[j] - minCoordinates[j]) >> shift) >= (static_cast<std::int64_t>(1) << (64 / dimension)))
+		{
+			shift++;
+		}
+	}
+	
+	std::vector<std::uint64_t> codes(pointCount);
+	std::vector<std::int64_t> offsets(dimension);
+	for(int i = 0; i < pointCount; i++)
+	{
+		for(int j = 0; j < dimension; j++)
+		{
+			offsets[j] = quantizedCoordinates[i * dimension + j] - minCoordinates[j];
+		}
+		codes[i] = computeMortonCode(offsets.data(), dimension, shift);
+	}
+	
+	std::vector<int> order(pointCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&codes](int a, int b)
+	{
+		return codes[a] < codes[b];
+	});
+	return order;
+}
+
+void MapCodec::encode(const PM::DataPoints& points, const PM::DataPoints::Labels& descriptorLabels, float resolution, std::string& buffer)
+{
+	const int pointCount = points.getNbPoints();
+	const int euclideanDim = points.getEuclideanDim();
+	
+	std::vector<std::int64_t> quantizedCoordinates(pointCount * euclideanDim);
+	for(int i = 0; i < pointCount; i++)
+	{
+		for(int j = 0; j < euclideanDim; j++)
+		{
+			quantizedCoordinates[i * euclideanDim + j] = std::llround(points.features(j, i) / resolution);
+		}
+	}
+	const std::vector<int> order = sortInMortonOrder(quantizedCoordinates, euclideanDim, pointCount);
+	
+	// consecutive points in Morton order are close, so that their coordinate deltas take one or two bytes
+	std::vector<std::int64_t> previousCoordinates(euclideanDim, 0);
+	for(int i: order)
+	{
+		for(int j = 0; j < euclideanDim; j++)
+		{
+			appendVarint(buffer, encodeZigZag(quantizedCoordinates[i * euclideanDim + j] - previousCoordinates[j]));
+			previousCoordinates[j] = quantizedCoordinates[i * euclideanDim + j];
+		}
+	}
+	
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		const unsigned startingRow = points.getDescriptorStartingRow(label.text);
+		for(size_t row = startingRow; row < startingRow + label.span; row++)
+		{
+			float minValue = std::numeric_limits<float>::infinity();
+			float maxValue = -std::numeric_limits<float>::infinity();
+			for(int i = 0; i < pointCount; i++)
+			{
+				if(std::isfinite(points.descriptors(row, i)))
+				{
+					minValue = std::min(minValue, points.descriptors(row, i));
+					maxValue = std::max(maxValue, points.descriptors(row, i));
+				}
+			}
+			if(minValue > maxValue)
+			{
+				minValue = maxValue = 0;
+			}
+			buffer.append(reinterpret_cast<const char*>(&minValue), sizeof(float));
+			buffer.append(reinterpret_cast<const char*>(&maxValue), sizeof(float));
+			if(minValue == maxValue)
+			{
+				continue;
+			}
+			
+			const float scale = DESCRIPTOR_QUANTIZATION_LEVELS / (maxValue - minValue);
+			std::int64_t previousValue = 0;
+			for(int i: order)
+			{
+				// values that are not finite are stored as the minimum of the block
+				const float value = std::isfinite(points.descriptors(row, i)) ? points.descriptors(row, i) : minValue;
+				const std::int64_t quantizedValue = std::lround((value - minValue) * scale);
+				appendVarint(buffer, encodeZigZag(quantizedValue - previousValue));
+				previousValue = quantizedValue;
+			}
+		}
+	}
+	
+	for(int row = 0; row < points.times.rows(); row++)
+	{
+		std::int64_t previousTime = 0;
+		for(int i: order)
+		{
+			appendVarint(buffer, encodeZigZag(points.times(row, i) - previousTime));
+			previousTime = points.times(row, i);
+		}
+	}
+}
+
+void MapCodec::decode(const std::string& buffer, unsigned pointCount, float resolution, unsigned firstPointIndex, PM::Matrix& features,
+					  std::vector<PM::Matrix>& descriptors, std::vector<PM::Int64Matrix>& times)
+{
+	const char* cursor = buffer.data();
+	const char* end = buffer.data() + buffer.size();
+	const int euclideanDim = features.rows() - 1;
+	
+	std::vector<std::int64_t> coordinates(euclideanDim, 0);
+	for(unsigned i = firstPointIndex; i < firstPointIndex + pointCount; i++)
+	{
+		for(int j = 0; j < euclideanDim; j++)
+		{
+			coordinates[j] += decodeZigZag(readVarint(cursor, end));
+			features(j, i) = static_cast<double>(coordinates[j]) * resolution;
+		}
+		features(euclideanDim, i) = 1;
+	}
+	
+	for(PM::Matrix& descriptor: descriptors)
+	{
+		for(int row = 0; row < descriptor.rows(); row++)
+		{
+			float minValue;
+			float maxValue;
+			if(end - cursor < static_cast<std::ptrdiff_t>(2 * sizeof(float)))
+			{
+				throw std::runtime_error("Unexpected end of compressed map block.");
+			}
+			std::memcpy(&minValue, cursor, sizeof(float));
+			std::memcpy(&maxValue, cursor + sizeof(float), sizeof(float));
+			cursor += 2 * sizeof(float);
+			
+			const float step = (maxValue - minValue) / DESCRIPTOR_QUANTIZATION_LEVELS;
+			std::int64_t quantizedValue = 0;
+			for(unsigned i = firstPointIndex; i < firstPointIndex + pointCount; i++)
+			{
+				if(minValue != maxValue)
+				{
+					quantizedValue += decodeZigZag(readVarint(cursor, end));
+				}
+				descriptor(row, i) = minValue + quantizedValue * step;
+			}
+		}
+	}
+	
+	for(PM::Int64Matrix& time: times)
+	{
+		for(int row = 0; row < time.rows(); row++)
+		{
+			std::int64_t value = 0;
+			for(unsigned i = firstPointIndex; i < firstPointIndex + pointCount; i++)
+			{
+				value += decodeZigZag(readVarint(cursor, end));
+				time(row, i) = value;
+			}
+		}
+	}
+	
+	if(cursor != end)
+	{
+		throw std::runtime_error("Unexpected data at the end of compressed map block.");
+	}
+}
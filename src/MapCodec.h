@@ -0,0 +1,37 @@
+#ifndef MAP_CODEC_H
+#define MAP_CODEC_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Compresses a block of map points: coordinates are quantized and delta encoded in Morton order, descriptors are quantized on 16 bits over their range in
+// the block and times are delta encoded without loss, all deltas being written as variable-length integers
+class MapCodec
+{
+private:
+	static void appendVarint(std::string& buffer, std::uint64_t value);
+	
+	static std::uint64_t readVarint(const char*& cursor, const char* end);
+	
+	static std::uint64_t encodeZigZag(std::int64_t value);
+	
+	static std::int64_t decodeZigZag(std::uint64_t value);
+	
+	static std::uint64_t computeMortonCode(const std::int64_t* offsets, int dimension, int shift);
+	
+	static std::vector<int> sortInMortonOrder(const std::vector<std::int64_t>& quantizedCoordinates, int dimension, int pointCount);
+	
+public:
+	static void encode(const PM::DataPoints& points, const PM::DataPoints::Labels& descriptorLabels, float resolution, std::string& buffer);
+	
+	// writes the points in the columns starting at firstPointIndex, so that blocks are decoded in parallel into the same matrices
+	static void decode(const std::string& buffer, unsigned pointCount, float resolution, unsigned firstPointIndex, PM::Matrix& features,
+					   std::vector<PM::Matrix>& descriptors, std::vector<PM::Int64Matrix>& times);
+};
+
+#endif
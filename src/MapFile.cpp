@@ -0,0 +1,1011 @@
+#include "MapFile.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+const char BINARY_MAP_MAGIC[8] = {'P', 'M', 'B', 'M', 'A', 'P', '0', '1'};
+const char COMPRESSED_MAP_MAGIC[8] = {'P', 'M', 'C', 'M', 'A', 'P', '0', '1'};
+
+// coordinates of compressed maps are rounded to the millimeter
+const float COMPRESSED_MAP_RESOLUTION = 0.001;
+
+// points of a map saved as .cmap are gathered in square tiles of this size, split in blocks of at most this many points
+const float COMPRESSED_MAP_TILE_SIZE = 20.0;
+const unsigned COMPRESSED_MAP_BLOCK_CAPACITY = 65536;
+
+// a cloud saved as a whole is copied in chunks of this many points, one at a time
+const unsigned CLOUD_CHUNK_CAPACITY = 65536;
+
+// the output stream buffers this many bytes before writing them to disk
+const size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+void MapFile::appendValue(std::string& buffer, T value)
+{
+	char text[32];
+	int length = std::snprintf(text, sizeof(text), "%.8g", value);
+	buffer.append(text, length);
+}
+
+template<typename ValueType>
+void MapFile::appendBinary(std::string& buffer, const ValueType& value)
+{
+	buffer.append(reinterpret_cast<const char*>(&value), sizeof(ValueType));
+}
+
+template<typename ValueType>
+void MapFile::readBinary(std::ifstream& stream, ValueType& value)
+{
+	if(!stream.read(reinterpret_cast<char*>(&value), sizeof(ValueType)))
+	{
+		throw std::runtime_error("Unexpected end of binary map file.");
+	}
+}
+
+void MapFile::appendLabels(std::string& buffer, const PM::DataPoints::Labels& labels)
+{
+	appendBinary(buffer, static_cast<std::uint32_t>(labels.size()));
+	for(const PM::DataPoints::Label& label: labels)
+	{
+		appendBinary(buffer, static_cast<std::uint32_t>(label.text.size()));
+		buffer.append(label.text);
+		appendBinary(buffer, static_cast<std::uint32_t>(label.span));
+	}
+}
+
+PM::DataPoints::Labels MapFile::readLabels(std::ifstream& stream)
+{
+	std::uint32_t labelCount;
+	readBinary(stream, labelCount);
+	PM::DataPoints::Labels labels;
+	for(std::uint32_t i = 0; i < labelCount; i++)
+	{
+		std::uint32_t textLength;
+		readBinary(stream, textLength);
+		std::string text(textLength, '\0');
+		if(!stream.read(&text[0], textLength))
+		{
+			throw std::runtime_error("Unexpected end of binary map file.");
+		}
+		std::uint32_t span;
+		readBinary(stream, span);
+		labels.push_back(PM::DataPoints::Label(text, span));
+	}
+	return labels;
+}
+
+PM::DataPoints MapFile::createPoints(const PM::Matrix& features, const PM::DataPoints::Labels& featureLabels, const std::vector<PM::Matrix>& descriptors,
+									const PM::DataPoints::Labels& descriptorLabels, const std::vector<PM::Int64Matrix>& times, const PM::DataPoints::Labels& timeLabels)
+{
+	PM::DataPoints points(features, featureLabels);
+	for(size_t i = 0; i < descriptorLabels.size(); i++)
+	{
+		points.addDescriptor(descriptorLabels[i].text, descriptors[i]);
+	}
+	for(size_t i = 0; i < timeLabels.size(); i++)
+	{
+		points.addTime(timeLabels[i].text, times[i]);
+	}
+	return points;
+}
+
+void MapFile::writeHeader(std::ofstream& stream, const ChunkSource& map, const char* magic, const PM::DataPoints::Labels& descriptorLabels)
+{
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels timeLabels;
+	if(map.chunkCount > 0)
+	{
+		const std::shared_ptr<const PM::DataPoints> firstChunk = map.getChunk(0);
+		featureLabels = firstChunk->featureLabels;
+		timeLabels = firstChunk->timeLabels;
+	}
+	
+	std::string header(magic, sizeof(BINARY_MAP_MAGIC));
+	appendBinary(header, static_cast<std::uint64_t>(map.pointCount));
+	appendBinary(header, static_cast<std::uint32_t>(map.chunkCount));
+	appendLabels(header, featureLabels);
+	appendLabels(header, descriptorLabels);
+	appendLabels(header, timeLabels);
+	stream.write(header.data(), header.size());
+}
+
+void MapFile::readHeader(std::ifstream& stream, const std::string& fileName, const char* magic, std::uint64_t& pointCount, std::uint32_t& chunkCount,
+						 PM::DataPoints::Labels& featureLabels, PM::DataPoints::Labels& descriptorLabels, PM::DataPoints::Labels& timeLabels)
+{
+	char fileMagic[sizeof(BINARY_MAP_MAGIC)];
+	if(!stream.read(fileMagic, sizeof(fileMagic)) || std::memcmp(fileMagic, magic, sizeof(fileMagic)) != 0)
+	{
+		throw std::runtime_error(fileName + " is not a " + (magic == COMPRESSED_MAP_MAGIC ? "compressed" : "binary") + " map file.");
+	}
+	readBinary(stream, pointCount);
+	readBinary(stream, chunkCount);
+	featureLabels = readLabels(stream);
+	descriptorLabels = readLabels(stream);
+	timeLabels = readLabels(stream);
+}
+
+size_t MapFile::retrieveFileSize(const std::string& fileName)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary | std::ios::ate);
+	if(!stream)
+	{
+		return 0;
+	}
+	return stream.tellg();
+}
+
+template<typename MatrixType>
+void MapFile::appendMatrix(std::string& buffer, const MatrixType& matrix)
+{
+	// matrices are column-major, so that the values of a block are contiguous once copied
+	const typename MatrixType::PlainObject plainMatrix = matrix;
+	buffer.append(reinterpret_cast<const char*>(plainMatrix.data()), plainMatrix.size() * sizeof(typename MatrixType::Scalar));
+}
+
+std::string MapFile::retrieveExtension(const std::string& fileName)
+{
+	size_t dotPosition = fileName.find_last_of('.');
+	if(dotPosition == std::string::npos)
+	{
+		return "";
+	}
+	return fileName.substr(dotPosition);
+}
+
+PM::DataPoints::Labels MapFile::selectDescriptorLabels(const ChunkSource& map, const DescriptorSelector& isDescriptorSaved)
+{
+	PM::DataPoints::Labels descriptorLabels;
+	if(map.chunkCount > 0)
+	{
+		const std::shared_ptr<const PM::DataPoints> firstChunk = map.getChunk(0);
+		for(const PM::DataPoints::Label& label: firstChunk->descriptorLabels)
+		{
+			if(isDescriptorSaved(label.text))
+			{
+				descriptorLabels.push_back(label);
+			}
+		}
+	}
+	return descriptorLabels;
+}
+
+void MapFile::writeChunks(std::ofstream& stream, const ChunkSource& map, ThreadPool& threadPool, const ChunkEncoder& encodeChunk)
+{
+	// at most one encoded chunk per thread waits to be written, which bounds the memory used by a save regardless of the map size
+	std::deque<std::pair<std::future<void>, std::shared_ptr<std::string>>> pendingChunks;
+	unsigned firstPointIndex = 0;
+	try
+	{
+		for(unsigned i = 0; i < map.chunkCount; i++)
+		{
+			// chunks are retrieved on this thread, so that chunks read from disk are read sequentially
+			const std::shared_ptr<const PM::DataPoints> chunk = map.getChunk(i);
+			std::shared_ptr<std::string> buffer = std::make_shared<std::string>();
+			pendingChunks.push_back(std::make_pair(threadPool.enqueue([&encodeChunk, chunk, firstPointIndex, buffer]
+			{
+				encodeChunk(*chunk, firstPointIndex, *buffer);
+			}), buffer));
+			firstPointIndex += chunk->getNbPoints();
+			
+			if(pendingChunks.size() > threadPool.getThreadCount())
+			{
+				pendingChunks.front().first.get();
+				stream.write(pendingChunks.front().second->data(), pendingChunks.front().second->size());
+				pendingChunks.pop_front();
+			}
+		}
+		
+		while(!pendingChunks.empty())
+		{
+			pendingChunks.front().first.get();
+			stream.write(pendingChunks.front().second->data(), pendingChunks.front().second->size());
+			pendingChunks.pop_front();
+		}
+	}
+	catch(...)
+	{
+		// the encoding tasks refer to the encoder, which must outlive them
+		for(std::pair<std::future<void>, std::shared_ptr<std::string>>& pendingChunk: pendingChunks)
+		{
+			pendingChunk.first.wait();
+		}
+		throw;
+	}
+}
+
+void MapFile::saveVtk(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels)
+{
+	const unsigned pointCount = map.pointCount;
+	stream << "# vtk DataFile Version 3.0\n";
+	stream << "File created by norlab_icp_mapper\n";
+	stream << "ASCII\n";
+	stream << "DATASET POLYDATA\n";
+	stream << "POINTS " << pointCount << " float\n";
+	writeChunks(stream, map, threadPool, [](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+	{
+		const int euclideanDim = chunk.getEuclideanDim();
+		for(int i = 0; i < chunk.getNbPoints(); i++)
+		{
+			appendValue(buffer, chunk.features(0, i));
+			buffer += ' ';
+			appendValue(buffer, chunk.features(1, i));
+			buffer += ' ';
+			appendValue(buffer, euclideanDim == 3 ? chunk.features(2, i) : 0);
+			buffer += '\n';
+		}
+	});
+	
+	stream << "VERTICES " << pointCount << " " << 2 * pointCount << "\n";
+	writeChunks(stream, map, threadPool, [](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+	{
+		for(int i = 0; i < chunk.getNbPoints(); i++)
+		{
+			buffer += "1 " + std::to_string(firstPointIndex + i) + "\n";
+		}
+	});
+	
+	if(!descriptorLabels.empty())
+	{
+		stream << "POINT_DATA " << pointCount << "\n";
+	}
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		// vectors are padded to 3 components, as in libpointmatcher
+		int componentCount = label.span;
+		if(label.text == "normals" && label.span <= 3)
+		{
+			stream << "NORMALS " << label.text << " float\n";
+			componentCount = 3;
+		}
+		else if(label.span == 9)
+		{
+			stream << "TENSORS " << label.text << " float\n";
+		}
+		else if(label.span == 2 || label.span == 3)
+		{
+			stream << "VECTORS " << label.text << " float\n";
+			componentCount = 3;
+		}
+		else
+		{
+			stream << "SCALARS " << label.text << " float " << label.span << "\n";
+			stream << "LOOKUP_TABLE default\n";
+		}
+		
+		const std::string descriptorName = label.text;
+		writeChunks(stream, map, threadPool, [&descriptorName, componentCount](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+		{
+			const PM::DataPoints::ConstView descriptor = chunk.getDescriptorViewByName(descriptorName);
+			for(int i = 0; i < chunk.getNbPoints(); i++)
+			{
+				for(int j = 0; j < componentCount; j++)
+				{
+					if(j > 0)
+					{
+						buffer += ' ';
+					}
+					appendValue(buffer, j < descriptor.rows() ? descriptor(j, i) : 0);
+				}
+				buffer += '\n';
+			}
+		});
+	}
+}
+
+void MapFile::savePly(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels)
+{
+	const int euclideanDim = map.chunkCount > 0 ? map.getChunk(0)->getEuclideanDim() : 3;
+	stream << "ply\n";
+	stream << "format ascii 1.0\n";
+	stream << "element vertex " << map.pointCount << "\n";
+	stream << "property float x\n";
+	stream << "property float y\n";
+	if(euclideanDim == 3)
+	{
+		stream << "property float z\n";
+	}
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		// property names recognized by the libpointmatcher loader are used for normals and colors
+		for(size_t i = 0; i < label.span; i++)
+		{
+			if(label.text == "normals" && label.span <= 3)
+			{
+				stream << "property float n" << "xyz"[i] << "\n";
+			}
+			else if(label.text == "color" && label.span <= 4)
+			{
+				const char* colorNames[] = {"red", "green", "blue", "alpha"};
+				stream << "property float " << colorNames[i] << "\n";
+			}
+			else if(label.span == 1)
+			{
+				stream << "property float " << label.text << "\n";
+			}
+			else
+			{
+				stream << "property float " << label.text << i << "\n";
+			}
+		}
+	}
+	stream << "end_header\n";
+	
+	writeChunks(stream, map, threadPool, [&descriptorLabels](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+	{
+		std::vector<unsigned> descriptorStartingRows;
+		for(const PM::DataPoints::Label& label: descriptorLabels)
+		{
+			descriptorStartingRows.push_back(chunk.getDescriptorStartingRow(label.text));
+		}
+		
+		const int euclideanDim = chunk.getEuclideanDim();
+		for(int i = 0; i < chunk.getNbPoints(); i++)
+		{
+			for(int j = 0; j < euclideanDim; j++)
+			{
+				if(j > 0)
+				{
+					buffer += ' ';
+				}
+				appendValue(buffer, chunk.features(j, i));
+			}
+			for(size_t j = 0; j < descriptorLabels.size(); j++)
+			{
+				for(size_t k = 0; k < descriptorLabels[j].span; k++)
+				{
+					buffer += ' ';
+					appendValue(buffer, chunk.descriptors(descriptorStartingRows[j] + k, i));
+				}
+			}
+			buffer += '\n';
+		}
+	});
+}
+
+void MapFile::saveBinary(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels)
+{
+	writeHeader(stream, map, BINARY_MAP_MAGIC, descriptorLabels);
+	const PM::DataPoints::Labels timeLabels = map.chunkCount > 0 ? map.getChunk(0)->timeLabels : PM::DataPoints::Labels();
+	
+	// each chunk is written as its point count followed by its features, then each descriptor and time as a separate block
+	writeChunks(stream, map, threadPool, [&descriptorLabels, &timeLabels](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+	{
+		appendBinary(buffer, static_cast<std::uint32_t>(chunk.getNbPoints()));
+		appendMatrix(buffer, chunk.features);
+		for(const PM::DataPoints::Label& label: descriptorLabels)
+		{
+			appendMatrix(buffer, chunk.getDescriptorViewByName(label.text));
+		}
+		for(const PM::DataPoints::Label& label: timeLabels)
+		{
+			appendMatrix(buffer, chunk.getTimeCopyByName(label.text));
+		}
+	});
+}
+
+void MapFile::saveCompressed(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels)
+{
+	writeHeader(stream, map, COMPRESSED_MAP_MAGIC, descriptorLabels);
+	std::string resolution;
+	appendBinary(resolution, COMPRESSED_MAP_RESOLUTION);
+	stream.write(resolution.data(), resolution.size());
+	
+	// each chunk is compressed as an independent block, so that blocks are decompressed in parallel
+	writeChunks(stream, map, threadPool, [&descriptorLabels](const PM::DataPoints& chunk, unsigned firstPointIndex, std::string& buffer)
+	{
+		std::string payload;
+		MapCodec::encode(chunk, descriptorLabels, COMPRESSED_MAP_RESOLUTION, payload);
+		appendBinary(buffer, static_cast<std::uint32_t>(chunk.getNbPoints()));
+		appendBinary(buffer, static_cast<std::uint64_t>(payload.size()));
+		buffer += payload;
+	});
+}
+
+PM::DataPoints MapFile::loadBinary(const std::string& fileName)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open binary map file " + fileName + ".");
+	}
+	
+	std::uint64_t pointCount;
+	std::uint32_t chunkCount;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	readHeader(stream, fileName, BINARY_MAP_MAGIC, pointCount, chunkCount, featureLabels, descriptorLabels, timeLabels);
+	
+	PM::Matrix features(featureLabels.totalDim(), pointCount);
+	std::vector<PM::Matrix> descriptors;
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		descriptors.push_back(PM::Matrix(label.span, pointCount));
+	}
+	std::vector<PM::Int64Matrix> times;
+	for(const PM::DataPoints::Label& label: timeLabels)
+	{
+		times.push_back(PM::Int64Matrix(label.span, pointCount));
+	}
+	
+	std::uint64_t firstPointIndex = 0;
+	for(std::uint32_t i = 0; i < chunkCount; i++)
+	{
+		std::uint32_t chunkPointCount;
+		readBinary(stream, chunkPointCount);
+		if(firstPointIndex + chunkPointCount > pointCount)
+		{
+			throw std::runtime_error("Invalid chunk size in binary map file " + fileName + ".");
+		}
+		if(chunkPointCount == 0)
+		{
+			continue;
+		}
+		
+		// columns of a block are contiguous in a column-major matrix, so that a chunk is read directly in place
+		stream.read(reinterpret_cast<char*>(features.col(firstPointIndex).data()), features.rows() * chunkPointCount * sizeof(T));
+		for(PM::Matrix& descriptor: descriptors)
+		{
+			stream.read(reinterpret_cast<char*>(descriptor.col(firstPointIndex).data()), descriptor.rows() * chunkPointCount * sizeof(T));
+		}
+		for(PM::Int64Matrix& time: times)
+		{
+			stream.read(reinterpret_cast<char*>(time.col(firstPointIndex).data()), time.rows() * chunkPointCount * sizeof(std::int64_t));
+		}
+		if(!stream)
+		{
+			throw std::runtime_error("Unexpected end of binary map file.");
+		}
+		firstPointIndex += chunkPointCount;
+	}
+	if(firstPointIndex != pointCount)
+	{
+		throw std::runtime_error("Missing points in binary map file " + fileName + ".");
+	}
+	
+	return createPoints(features, featureLabels, descriptors, descriptorLabels, times, timeLabels);
+}
+
+PM::DataPoints MapFile::loadCompressed(const std::string& fileName, ThreadPool& threadPool)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open compressed map file " + fileName + ".");
+	}
+	
+	std::uint64_t pointCount;
+	std::uint32_t chunkCount;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	readHeader(stream, fileName, COMPRESSED_MAP_MAGIC, pointCount, chunkCount, featureLabels, descriptorLabels, timeLabels);
+	float resolution;
+	readBinary(stream, resolution);
+	
+	PM::Matrix features(featureLabels.totalDim(), pointCount);
+	std::vector<PM::Matrix> descriptors;
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		descriptors.push_back(PM::Matrix(label.span, pointCount));
+	}
+	std::vector<PM::Int64Matrix> times;
+	for(const PM::DataPoints::Label& label: timeLabels)
+	{
+		times.push_back(PM::Int64Matrix(label.span, pointCount));
+	}
+	
+	// blocks are read in order and decompressed in parallel into disjoint columns, at most one block per thread waiting in memory
+	std::deque<std::future<void>> pendingBlocks;
+	std::uint64_t firstPointIndex = 0;
+	try
+	{
+		for(std::uint32_t i = 0; i < chunkCount; i++)
+		{
+			std::uint32_t blockPointCount;
+			readBinary(stream, blockPointCount);
+			std::uint64_t blockSize;
+			readBinary(stream, blockSize);
+			if(firstPointIndex + blockPointCount > pointCount)
+			{
+				throw std::runtime_error("Invalid block size in compressed map file " + fileName + ".");
+			}
+			std::shared_ptr<std::string> block = std::make_shared<std::string>(blockSize, '\0');
+			if(!stream.read(&(*block)[0], blockSize))
+			{
+				throw std::runtime_error("Unexpected end of compressed map file.");
+			}
+			
+			pendingBlocks.push_back(threadPool.enqueue([block, blockPointCount, resolution, firstPointIndex, &features, &descriptors, &times]
+			{
+				MapCodec::decode(*block, blockPointCount, resolution, firstPointIndex, features, descriptors, times);
+			}));
+			firstPointIndex += blockPointCount;
+			
+			if(pendingBlocks.size() > threadPool.getThreadCount())
+			{
+				pendingBlocks.front().get();
+				pendingBlocks.pop_front();
+			}
+		}
+		
+		while(!pendingBlocks.empty())
+		{
+			pendingBlocks.front().get();
+			pendingBlocks.pop_front();
+		}
+	}
+	catch(...)
+	{
+		// the decompression tasks write in the matrices, which must outlive them
+		for(std::future<void>& pendingBlock: pendingBlocks)
+		{
+			pendingBlock.wait();
+		}
+		throw;
+	}
+	if(firstPointIndex != pointCount)
+	{
+		throw std::runtime_error("Missing points in compressed map file " + fileName + ".");
+	}
+	
+	return createPoints(features, featureLabels, descriptors, descriptorLabels, times, timeLabels);
+}
+
+void MapFile::readBinaryChunks(const std::string& fileName, const ChunkReceiver& receiveChunk)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open binary map file " + fileName + ".");
+	}
+	
+	std::uint64_t pointCount;
+	std::uint32_t chunkCount;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	readHeader(stream, fileName, BINARY_MAP_MAGIC, pointCount, chunkCount, featureLabels, descriptorLabels, timeLabels);
+	
+	for(std::uint32_t i = 0; i < chunkCount; i++)
+	{
+		std::uint32_t chunkPointCount;
+		readBinary(stream, chunkPointCount);
+		PM::Matrix features(featureLabels.totalDim(), chunkPointCount);
+		std::vector<PM::Matrix> descriptors;
+		std::vector<PM::Int64Matrix> times;
+		stream.read(reinterpret_cast<char*>(features.data()), features.size() * sizeof(T));
+		for(const PM::DataPoints::Label& label: descriptorLabels)
+		{
+			descriptors.push_back(PM::Matrix(label.span, chunkPointCount));
+			stream.read(reinterpret_cast<char*>(descriptors.back().data()), descriptors.back().size() * sizeof(T));
+		}
+		for(const PM::DataPoints::Label& label: timeLabels)
+		{
+			times.push_back(PM::Int64Matrix(label.span, chunkPointCount));
+			stream.read(reinterpret_cast<char*>(times.back().data()), times.back().size() * sizeof(std::int64_t));
+		}
+		if(!stream)
+		{
+			throw std::runtime_error("Unexpected end of binary map file.");
+		}
+		receiveChunk(createPoints(features, featureLabels, descriptors, descriptorLabels, times, timeLabels));
+	}
+}
+
+void MapFile::readCompressedChunks(const std::string& fileName, ThreadPool& threadPool, const ChunkReceiver& receiveChunk)
+{
+	std::ifstream stream(fileName.c_str(), std::ios::binary);
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open compressed map file " + fileName + ".");
+	}
+	
+	std::uint64_t pointCount;
+	std::uint32_t chunkCount;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	readHeader(stream, fileName, COMPRESSED_MAP_MAGIC, pointCount, chunkCount, featureLabels, descriptorLabels, timeLabels);
+	float resolution;
+	readBinary(stream, resolution);
+	
+	struct DecodedBlock
+	{
+		PM::Matrix features;
+		std::vector<PM::Matrix> descriptors;
+		std::vector<PM::Int64Matrix> times;
+	};
+	
+	// blocks are decompressed in parallel and received in order, at most one block per thread waiting in memory
+	std::deque<std::pair<std::future<void>, std::shared_ptr<DecodedBlock>>> pendingBlocks;
+	try
+	{
+		for(std::uint32_t i = 0; i < chunkCount; i++)
+		{
+			std::uint32_t blockPointCount;
+			readBinary(stream, blockPointCount);
+			std::uint64_t blockSize;
+			readBinary(stream, blockSize);
+			std::shared_ptr<std::string> block = std::make_shared<std::string>(blockSize, '\0');
+			if(!stream.read(&(*block)[0], blockSize))
+			{
+				throw std::runtime_error("Unexpected end of compressed map file.");
+			}
+			
+			std::shared_ptr<DecodedBlock> decodedBlock = std::make_shared<DecodedBlock>();
+			decodedBlock->features = PM::Matrix(featureLabels.totalDim(), blockPointCount);
+			for(const PM::DataPoints::Label& label: descriptorLabels)
+			{
+				decodedBlock->descriptors.push_back(PM::Matrix(label.span, blockPointCount));
+			}
+			for(const PM::DataPoints::Label& label: timeLabels)
+			{
+				decodedBlock->times.push_back(PM::Int64Matrix(label.span, blockPointCount));
+			}
+			pendingBlocks.push_back(std::make_pair(threadPool.enqueue([block, blockPointCount, resolution, decodedBlock]
+			{
+				MapCodec::decode(*block, blockPointCount, resolution, 0, decodedBlock->features, decodedBlock->descriptors, decodedBlock->times);
+			}), decodedBlock));
+			
+			if(pendingBlocks.size() > threadPool.getThreadCount())
+			{
+				pendingBlocks.front().first.get();
+				const DecodedBlock& frontBlock = *pendingBlocks.front().second;
+				receiveChunk(createPoints(frontBlock.features, featureLabels, frontBlock.descriptors, descriptorLabels, frontBlock.times, timeLabels));
+				pendingBlocks.pop_front();
+			}
+		}
+		
+		while(!pendingBlocks.empty())
+		{
+			pendingBlocks.front().first.get();
+			const DecodedBlock& frontBlock = *pendingBlocks.front().second;
+			receiveChunk(createPoints(frontBlock.features, featureLabels, frontBlock.descriptors, descriptorLabels, frontBlock.times, timeLabels));
+			pendingBlocks.pop_front();
+		}
+	}
+	catch(...)
+	{
+		for(std::pair<std::future<void>, std::shared_ptr<DecodedBlock>>& pendingBlock: pendingBlocks)
+		{
+			pendingBlock.first.wait();
+		}
+		throw;
+	}
+}
+
+MapFile::Statistics MapFile::save(const ChunkSource& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved)
+{
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const std::string extension = retrieveExtension(fileName);
+	const PM::DataPoints::Labels descriptorLabels = selectDescriptorLabels(map, isDescriptorSaved);
+	
+	Statistics statistics;
+	statistics.pointCount = map.pointCount;
+	statistics.memoryBytes = 0;
+	if(map.chunkCount > 0)
+	{
+		const std::shared_ptr<const PM::DataPoints> firstChunk = map.getChunk(0);
+		statistics.memoryBytes = statistics.pointCount * ((firstChunk->featureLabels.totalDim() + descriptorLabels.totalDim()) * sizeof(T) +
+														  firstChunk->timeLabels.totalDim() * sizeof(std::int64_t));
+	}
+	
+	if(extension != ".vtk" && extension != ".ply" && extension != ".pmb" && extension != ".cmap")
+	{
+		PM::DataPoints points;
+		for(unsigned i = 0; i < map.chunkCount; i++)
+		{
+			if(i == 0)
+			{
+				points = *map.getChunk(i);
+			}
+			else
+			{
+				points.concatenate(*map.getChunk(i));
+			}
+		}
+		PM::DataPoints savedPoints(points.features, points.featureLabels);
+		for(const PM::DataPoints::Label& label: descriptorLabels)
+		{
+			savedPoints.addDescriptor(label.text, points.getDescriptorCopyByName(label.text));
+		}
+		for(const PM::DataPoints::Label& label: points.timeLabels)
+		{
+			savedPoints.addTime(label.text, points.getTimeCopyByName(label.text));
+		}
+		savedPoints.save(fileName);
+	}
+	else
+	{
+		std::vector<char> writeBuffer(WRITE_BUFFER_SIZE);
+		std::ofstream stream;
+		stream.rdbuf()->pubsetbuf(writeBuffer.data(), writeBuffer.size());
+		stream.open(fileName.c_str(), std::ios::binary);
+		if(!stream)
+		{
+			throw std::runtime_error("Unable to open " + fileName + " for writing.");
+		}
+		
+		if(extension == ".vtk")
+		{
+			saveVtk(map, stream, threadPool, descriptorLabels);
+		}
+		else if(extension == ".ply")
+		{
+			savePly(map, stream, threadPool, descriptorLabels);
+		}
+		else if(extension == ".cmap")
+		{
+			saveCompressed(map, stream, threadPool, descriptorLabels);
+		}
+		else
+		{
+			saveBinary(map, stream, threadPool, descriptorLabels);
+		}
+		
+		stream.close();
+		if(!stream)
+		{
+			throw std::runtime_error("Unable to write " + fileName + ".");
+		}
+	}
+	
+	statistics.fileBytes = retrieveFileSize(fileName);
+	statistics.duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	return statistics;
+}
+
+std::array<int, 3> MapFile::computeTileCoordinates(const PM::DataPoints& points, int pointIndex)
+{
+	std::array<int, 3> tileCoordinates = {{0, 0, 0}};
+	for(int i = 0; i < points.getEuclideanDim(); i++)
+	{
+		tileCoordinates[i] = std::floor(points.features(i, pointIndex) / COMPRESSED_MAP_TILE_SIZE);
+	}
+	return tileCoordinates;
+}
+
+MapFile::ChunkSource MapFile::createTiledSource(const ChunkedPointCloud& map)
+{
+	// chunks of the map hold points in the order they were added, so that the points of a tile are gathered from the chunks holding some of them, only
+	// the point count and the chunks of each tile being kept
+	std::shared_ptr<std::map<std::array<int, 3>, CompressedTile>> tiles = std::make_shared<std::map<std::array<int, 3>, CompressedTile>>();
+	for(unsigned i = 0; i < map.getChunkCount(); i++)
+	{
+		const PM::DataPoints& chunk = map.getChunk(i);
+		for(int j = 0; j < chunk.getNbPoints(); j++)
+		{
+			CompressedTile& tile = (*tiles)[computeTileCoordinates(chunk, j)];
+			if(tile.chunkIndexes.empty() || tile.chunkIndexes.back() != i)
+			{
+				tile.chunkIndexes.push_back(i);
+			}
+			tile.pointCount++;
+		}
+	}
+	
+	std::shared_ptr<std::vector<CompressedBlock>> blocks = std::make_shared<std::vector<CompressedBlock>>();
+	for(const std::pair<const std::array<int, 3>, CompressedTile>& tile: *tiles)
+	{
+		for(unsigned firstPointIndex = 0; firstPointIndex < tile.second.pointCount; firstPointIndex += COMPRESSED_MAP_BLOCK_CAPACITY)
+		{
+			blocks->push_back(CompressedBlock{tile.first, &tile.second, firstPointIndex,
+											  std::min(COMPRESSED_MAP_BLOCK_CAPACITY, tile.second.pointCount - firstPointIndex)});
+		}
+	}
+	
+	ChunkSource source;
+	source.chunkCount = blocks->size();
+	source.pointCount = map.getPointCount();
+	source.getChunk = [&map, tiles, blocks](unsigned blockIndex)
+	{
+		const CompressedBlock& block = (*blocks)[blockIndex];
+		std::shared_ptr<PM::DataPoints> points = std::make_shared<PM::DataPoints>(map.getChunk(block.tile->chunkIndexes[0]).createSimilarEmpty(block.pointCount));
+		unsigned tilePointIndex = 0;
+		unsigned blockPointCount = 0;
+		for(unsigned i = 0; i < block.tile->chunkIndexes.size() && blockPointCount < block.pointCount; i++)
+		{
+			const PM::DataPoints& chunk = map.getChunk(block.tile->chunkIndexes[i]);
+			for(int j = 0; j < chunk.getNbPoints() && blockPointCount < block.pointCount; j++)
+			{
+				if(computeTileCoordinates(chunk, j) == block.tileCoordinates && tilePointIndex++ >= block.firstPointIndex)
+				{
+					points->setColFrom(blockPointCount++, chunk, j);
+				}
+			}
+		}
+		return std::shared_ptr<const PM::DataPoints>(points);
+	};
+	return source;
+}
+
+MapFile::Statistics MapFile::save(const ChunkedPointCloud& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved)
+{
+	if(retrieveExtension(fileName) == ".cmap")
+	{
+		return save(createTiledSource(map), fileName, threadPool, isDescriptorSaved);
+	}
+	
+	ChunkSource source;
+	source.chunkCount = map.getChunkCount();
+	source.pointCount = map.getPointCount();
+	source.getChunk = [&map](unsigned chunkIndex)
+	{
+		// the chunks of the map outlive the save, so that they are not owned by the source
+		return std::shared_ptr<const PM::DataPoints>(&map.getChunk(chunkIndex), [](const PM::DataPoints*)
+		{
+		});
+	};
+	return save(source, fileName, threadPool, isDescriptorSaved);
+}
+
+MapFile::Statistics MapFile::save(const std::vector<std::shared_ptr<const PM::DataPoints>>& chunks, const std::string& fileName, ThreadPool& threadPool,
+								  const DescriptorSelector& isDescriptorSaved)
+{
+	ChunkSource source;
+	source.chunkCount = chunks.size();
+	source.pointCount = 0;
+	for(const std::shared_ptr<const PM::DataPoints>& chunk: chunks)
+	{
+		source.pointCount += chunk->getNbPoints();
+	}
+	source.getChunk = [&chunks](unsigned chunkIndex)
+	{
+		return chunks[chunkIndex];
+	};
+	return save(source, fileName, threadPool, isDescriptorSaved);
+}
+
+MapFile::Statistics MapFile::save(const PM::DataPoints& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved)
+{
+	ChunkSource source;
+	source.chunkCount = (map.getNbPoints() + CLOUD_CHUNK_CAPACITY - 1) / CLOUD_CHUNK_CAPACITY;
+	source.pointCount = map.getNbPoints();
+	source.getChunk = [&map](unsigned chunkIndex)
+	{
+		const int firstPointIndex = chunkIndex * CLOUD_CHUNK_CAPACITY;
+		const int chunkPointCount = std::min<int>(CLOUD_CHUNK_CAPACITY, map.getNbPoints() - firstPointIndex);
+		std::shared_ptr<PM::DataPoints> chunk = std::make_shared<PM::DataPoints>(map.createSimilarEmpty(chunkPointCount));
+		chunk->features = map.features.middleCols(firstPointIndex, chunkPointCount);
+		if(map.descriptors.rows() > 0)
+		{
+			chunk->descriptors = map.descriptors.middleCols(firstPointIndex, chunkPointCount);
+		}
+		if(map.times.rows() > 0)
+		{
+			chunk->times = map.times.middleCols(firstPointIndex, chunkPointCount);
+		}
+		return std::shared_ptr<const PM::DataPoints>(chunk);
+	};
+	return save(source, fileName, threadPool, isDescriptorSaved);
+}
+
+PM::DataPoints MapFile::loadPoints(const std::string& fileName, ThreadPool& threadPool)
+{
+	const std::string extension = retrieveExtension(fileName);
+	if(extension == ".pmb")
+	{
+		return loadBinary(fileName);
+	}
+	else if(extension == ".cmap")
+	{
+		return loadCompressed(fileName, threadPool);
+	}
+	return PM::DataPoints::load(fileName);
+}
+
+PM::DataPoints MapFile::loadTiles(const std::string& fileName, const PM::Vector& center, float radius, ThreadPool& threadPool, size_t& fileBytes)
+{
+	const std::vector<TileIndex::Tile> tiles = TileIndex::load(fileName).findTilesInRange(center, radius);
+	if(tiles.empty())
+	{
+		throw std::runtime_error("No tile of " + fileName + " to load.");
+	}
+	
+	std::vector<PM::DataPoints> tilePoints;
+	int pointCount = 0;
+	fileBytes = 0;
+	for(const TileIndex::Tile& tile: tiles)
+	{
+		tilePoints.push_back(loadPoints(tile.fileName, threadPool));
+		fileBytes += retrieveFileSize(tile.fileName);
+		
+		// tiles crossing the radius are cropped to it, so that the loaded points do not depend on the tile size
+		if(radius > 0)
+		{
+			const PM::DataPoints& loadedTile = tilePoints.back();
+			std::vector<int> keptPointIndexes;
+			for(int i = 0; i < loadedTile.getNbPoints(); i++)
+			{
+				if((loadedTile.features.col(i).head(center.size()) - center).norm() < radius)
+				{
+					keptPointIndexes.push_back(i);
+				}
+			}
+			if(keptPointIndexes.size() < static_cast<size_t>(loadedTile.getNbPoints()))
+			{
+				PM::DataPoints croppedTile = loadedTile.createSimilarEmpty(keptPointIndexes.size());
+				for(size_t i = 0; i < keptPointIndexes.size(); i++)
+				{
+					croppedTile.setColFrom(i, loadedTile, keptPointIndexes[i]);
+				}
+				tilePoints.back() = croppedTile;
+			}
+		}
+		pointCount += tilePoints.back().getNbPoints();
+	}
+	
+	// tiles are copied once in a cloud of the total size, rather than concatenated one after the other
+	PM::DataPoints points = tilePoints[0].createSimilarEmpty(pointCount);
+	int firstPointIndex = 0;
+	for(const PM::DataPoints& tile: tilePoints)
+	{
+		points.features.middleCols(firstPointIndex, tile.getNbPoints()) = tile.features;
+		if(tile.descriptors.rows() > 0)
+		{
+			points.descriptors.middleCols(firstPointIndex, tile.getNbPoints()) = tile.descriptors;
+		}
+		if(tile.times.rows() > 0)
+		{
+			points.times.middleCols(firstPointIndex, tile.getNbPoints()) = tile.times;
+		}
+		firstPointIndex += tile.getNbPoints();
+	}
+	return points;
+}
+
+PM::DataPoints MapFile::load(const std::string& fileName, ThreadPool& threadPool, Statistics& statistics)
+{
+	return load(fileName, PM::Vector(), 0, threadPool, statistics);
+}
+
+PM::DataPoints MapFile::load(const std::string& fileName, const PM::Vector& center, float radius, ThreadPool& threadPool, Statistics& statistics)
+{
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	PM::DataPoints points;
+	if(retrieveExtension(fileName) == ".tiles")
+	{
+		points = loadTiles(fileName, center, radius, threadPool, statistics.fileBytes);
+	}
+	else
+	{
+		points = loadPoints(fileName, threadPool);
+		statistics.fileBytes = retrieveFileSize(fileName);
+	}
+	
+	statistics.pointCount = points.getNbPoints();
+	statistics.memoryBytes = (points.features.size() + points.descriptors.size()) * sizeof(T) + points.times.size() * sizeof(std::int64_t);
+	statistics.duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	return points;
+}
+
+void MapFile::readChunks(const std::string& fileName, ThreadPool& threadPool, const ChunkReceiver& receiveChunk)
+{
+	const std::string extension = retrieveExtension(fileName);
+	if(extension == ".pmb")
+	{
+		readBinaryChunks(fileName, receiveChunk);
+	}
+	else if(extension == ".cmap")
+	{
+		readCompressedChunks(fileName, threadPool, receiveChunk);
+	}
+	else if(extension == ".tiles")
+	{
+		for(const TileIndex::Tile& tile: TileIndex::load(fileName).getTiles())
+		{
+			readChunks(tile.fileName, threadPool, receiveChunk);
+		}
+	}
+	else
+	{
+		receiveChunk(loadPoints(fileName, threadPool));
+	}
+}
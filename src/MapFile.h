@@ -0,0 +1,144 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include "ChunkedPointCloud.h"
+#include "ThreadPool.h"
+#include "MapCodec.h"
+#include "TileIndex.h"
+#include <pointmatcher/PointMatcher.h>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Saves a chunked map without gathering it in a single cloud, chunks being encoded in parallel and written in order, and loads the maps it saved
+class MapFile
+{
+public:
+	typedef std::function<bool(const std::string&)> DescriptorSelector;
+	
+	// chunks of a map to save, retrieved one at a time and in order, so that they can be read from disk instead of memory
+	struct ChunkSource
+	{
+		unsigned chunkCount;
+		unsigned pointCount;
+		std::function<std::shared_ptr<const PM::DataPoints>(unsigned)> getChunk;
+	};
+	
+	typedef std::function<void(const PM::DataPoints&)> ChunkReceiver;
+	
+	struct Statistics
+	{
+		unsigned pointCount;
+		// size of the points in memory, without the descriptors that are not saved
+		size_t memoryBytes;
+		size_t fileBytes;
+		float duration;
+	};
+	
+private:
+	typedef std::function<void(const PM::DataPoints&, unsigned, std::string&)> ChunkEncoder;
+	
+	// tile of a map saved as .cmap, whose points are gathered from the chunks holding some of them
+	struct CompressedTile
+	{
+		unsigned pointCount;
+		std::vector<unsigned> chunkIndexes;
+	};
+	
+	// points of a tile from firstPointIndex, in the order of the chunks
+	struct CompressedBlock
+	{
+		std::array<int, 3> tileCoordinates;
+		const CompressedTile* tile;
+		unsigned firstPointIndex;
+		unsigned pointCount;
+	};
+	
+	static PM::DataPoints createPoints(const PM::Matrix& features, const PM::DataPoints::Labels& featureLabels, const std::vector<PM::Matrix>& descriptors,
+									   const PM::DataPoints::Labels& descriptorLabels, const std::vector<PM::Int64Matrix>& times,
+									   const PM::DataPoints::Labels& timeLabels);
+	
+	static void appendValue(std::string& buffer, T value);
+	
+	template<typename ValueType>
+	static void appendBinary(std::string& buffer, const ValueType& value);
+	
+	template<typename ValueType>
+	static void readBinary(std::ifstream& stream, ValueType& value);
+	
+	template<typename MatrixType>
+	static void appendMatrix(std::string& buffer, const MatrixType& matrix);
+	
+	static void appendLabels(std::string& buffer, const PM::DataPoints::Labels& labels);
+	
+	static PM::DataPoints::Labels readLabels(std::ifstream& stream);
+	
+	static void readHeader(std::ifstream& stream, const std::string& fileName, const char* magic, std::uint64_t& pointCount, std::uint32_t& chunkCount,
+						   PM::DataPoints::Labels& featureLabels, PM::DataPoints::Labels& descriptorLabels, PM::DataPoints::Labels& timeLabels);
+	
+	static void writeHeader(std::ofstream& stream, const ChunkSource& map, const char* magic, const PM::DataPoints::Labels& descriptorLabels);
+	
+	static size_t retrieveFileSize(const std::string& fileName);
+	
+	static std::string retrieveExtension(const std::string& fileName);
+	
+	static PM::DataPoints::Labels selectDescriptorLabels(const ChunkSource& map, const DescriptorSelector& isDescriptorSaved);
+	
+	static std::array<int, 3> computeTileCoordinates(const PM::DataPoints& points, int pointIndex);
+	
+	static ChunkSource createTiledSource(const ChunkedPointCloud& map);
+	
+	static void writeChunks(std::ofstream& stream, const ChunkSource& map, ThreadPool& threadPool, const ChunkEncoder& encodeChunk);
+	
+	static void saveVtk(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels);
+	
+	static void savePly(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels);
+	
+	static void saveBinary(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels);
+	
+	static void saveCompressed(const ChunkSource& map, std::ofstream& stream, ThreadPool& threadPool, const PM::DataPoints::Labels& descriptorLabels);
+	
+	static PM::DataPoints loadBinary(const std::string& fileName);
+	
+	static PM::DataPoints loadCompressed(const std::string& fileName, ThreadPool& threadPool);
+	
+	static void readBinaryChunks(const std::string& fileName, const ChunkReceiver& receiveChunk);
+	
+	static void readCompressedChunks(const std::string& fileName, ThreadPool& threadPool, const ChunkReceiver& receiveChunk);
+	
+	static PM::DataPoints loadPoints(const std::string& fileName, ThreadPool& threadPool);
+	
+	static PM::DataPoints loadTiles(const std::string& fileName, const PM::Vector& center, float radius, ThreadPool& threadPool, size_t& fileBytes);
+	
+public:
+	// .vtk and .ply files are written as ASCII, .pmb files in the binary format of loadBinary, .cmap files compressed with MapCodec, other extensions
+	// through libpointmatcher from a full copy
+	static Statistics save(const ChunkSource& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved);
+	
+	// points are saved by spatial tile instead of by chunk in .cmap files
+	static Statistics save(const ChunkedPointCloud& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved);
+	
+	// chunks held in memory, saved in order
+	static Statistics save(const std::vector<std::shared_ptr<const PM::DataPoints>>& chunks, const std::string& fileName, ThreadPool& threadPool,
+						   const DescriptorSelector& isDescriptorSaved);
+	
+	// points are saved in their order, a fixed number of them being copied at a time
+	static Statistics save(const PM::DataPoints& map, const std::string& fileName, ThreadPool& threadPool, const DescriptorSelector& isDescriptorSaved);
+	
+	static PM::DataPoints load(const std::string& fileName, ThreadPool& threadPool, Statistics& statistics);
+	
+	// only the tiles of a .tiles index closer than radius to center are loaded, all of them when radius is 0, and other maps are loaded whole
+	static PM::DataPoints load(const std::string& fileName, const PM::Vector& center, float radius, ThreadPool& threadPool, Statistics& statistics);
+	
+	// .pmb and .cmap maps are read one chunk at a time and .tiles indexes one tile after the other, chunks being received in order on the calling thread,
+	// and other maps as a single chunk
+	static void readChunks(const std::string& fileName, ThreadPool& threadPool, const ChunkReceiver& receiveChunk);
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include "MapMerger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <Eigen/Eigenvalues>
+#include <stdexcept>
+#include <unistd.h>
+
+MapMerger::MapMerger(float tileSize, float minDistNewPoint, float seamRadius, const std::string& workDirectory):
+		tileSize(tileSize),
+		minDistNewPoint(minDistNewPoint),
+		seamRadius(seamRadius),
+		mapCount(0),
+		inputPointCount(0)
+{
+	if(minDistNewPoint <= 0 || seamRadius < 0)
+	{
+		throw std::runtime_error("Invalid merge distances.");
+	}
+	if(std::max(minDistNewPoint, seamRadius) >= tileSize)
+	{
+		throw std::runtime_error("Tile size must be larger than the merge distances.");
+	}
+	
+	std::string directoryTemplate = workDirectory + "/map_merge_XXXXXX";
+	if(mkdtemp(&directoryTemplate[0]) == nullptr)
+	{
+		throw std::runtime_error("Unable to create a work directory in " + workDirectory + ".");
+	}
+	this->workDirectory = directoryTemplate;
+}
+
+MapMerger::~MapMerger()
+{
+	for(const std::pair<const std::int64_t, Tile>& tile: tiles)
+	{
+		std::remove(tile.second.fileName.c_str());
+	}
+	for(const Tile& mergedTile: mergedTiles)
+	{
+		std::remove(mergedTile.fileName.c_str());
+	}
+	rmdir(workDirectory.c_str());
+}
+
+std::int64_t MapMerger::computeTileKey(int tileX, int tileY) const
+{
+	return (static_cast<std::int64_t>(tileX) << 32) | static_cast<std::uint32_t>(tileY);
+}
+
+int MapMerger::computeTileCoordinate(T coordinate) const
+{
+	return std::floor(coordinate / tileSize);
+}
+
+std::string MapMerger::createTileFileName(const std::string& prefix, int tileX, int tileY) const
+{
+	return workDirectory + "/" + prefix + "_" + std::to_string(tileX) + "_" + std::to_string(tileY) + ".bin";
+}
+
+MapMerger::Tile& MapMerger::retrieveTile(int tileX, int tileY)
+{
+	std::map<std::int64_t, Tile>::iterator tile = tiles.find(computeTileKey(tileX, tileY));
+	if(tile == tiles.end())
+	{
+		Tile newTile = {tileX, tileY, createTileFileName("tile", tileX, tileY), 0};
+		tile = tiles.insert(std::make_pair(computeTileKey(tileX, tileY), newTile)).first;
+	}
+	return tile->second;
+}
+
+PM::DataPoints MapMerger::normalizeMap(const PM::DataPoints& map) const
+{
+	if(map.featureLabels.totalDim() != featureLabels.totalDim())
+	{
+		throw std::runtime_error("Maps to merge have different dimensions.");
+	}
+	
+	// descriptors and times are stored in the order of the first map, so that blocks of every map have the same layout
+	PM::DataPoints normalizedMap(map.features, featureLabels);
+	for(const PM::DataPoints::Label& label: descriptorLabels)
+	{
+		if(!map.descriptorExists(label.text))
+		{
+			throw std::runtime_error("Map to merge has no " + label.text + " descriptor.");
+		}
+		normalizedMap.addDescriptor(label.text, map.getDescriptorCopyByName(label.text));
+	}
+	for(const PM::DataPoints::Label& label: timeLabels)
+	{
+		if(!map.timeExists(label.text))
+		{
+			throw std::runtime_error("Map to merge has no " + label.text + " time.");
+		}
+		normalizedMap.addTime(label.text, map.getTimeCopyByName(label.text));
+	}
+	return normalizedMap;
+}
+
+std::int64_t MapMerger::computeVoxelKey(int voxelX, int voxelY, int voxelZ)
+{
+	// coordinates wrap around every 2^21 voxels, which only adds candidates that are rejected by their distance
+	return (static_cast<std::int64_t>(voxelX & 0x1FFFFF) << 42) | (static_cast<std::int64_t>(voxelY & 0x1FFFFF) << 21) | (voxelZ & 0x1FFFFF);
+}
+
+MapMerger::VoxelHash MapMerger::buildVoxelHash(const PM::DataPoints& points, float voxelSize)
+{
+	const bool is3D = points.getEuclideanDim() == 3;
+	VoxelHash voxelHash;
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		const int voxelX = std::floor(points.features(0, i) / voxelSize);
+		const int voxelY = std::floor(points.features(1, i) / voxelSize);
+		const int voxelZ = is3D ? std::floor(points.features(2, i) / voxelSize) : 0;
+		voxelHash[computeVoxelKey(voxelX, voxelY, voxelZ)].push_back(i);
+	}
+	return voxelHash;
+}
+
+std::vector<int> MapMerger::findNeighbors(const VoxelHash& voxelHash, const PM::DataPoints& points, int pointIndex, float voxelSize, float radius)
+{
+	const int euclideanDim = points.getEuclideanDim();
+	const int voxelX = std::floor(points.features(0, pointIndex) / voxelSize);
+	const int voxelY = std::floor(points.features(1, pointIndex) / voxelSize);
+	const int voxelZ = euclideanDim == 3 ? std::floor(points.features(2, pointIndex) / voxelSize) : 0;
+	const int voxelRadiusZ = euclideanDim == 3 ? 1 : 0;
+	
+	std::vector<int> neighbors;
+	for(int x = voxelX - 1; x <= voxelX + 1; x++)
+	{
+		for(int y = voxelY - 1; y <= voxelY + 1; y++)
+		{
+			for(int z = voxelZ - voxelRadiusZ; z <= voxelZ + voxelRadiusZ; z++)
+			{
+				VoxelHash::const_iterator voxel = voxelHash.find(computeVoxelKey(x, y, z));
+				if(voxel == voxelHash.end())
+				{
+					continue;
+				}
+				for(int neighbor: voxel->second)
+				{
+					if(neighbor != pointIndex &&
+					   (points.features.col(neighbor).head(euclideanDim) - points.features.col(pointIndex).head(euclideanDim)).squaredNorm() < radius * radius)
+					{
+						neighbors.push_back(neighbor);
+					}
+				}
+			}
+		}
+	}
+	return neighbors;
+}
+
+bool MapMerger::estimateNormal(const PM::DataPoints& points, const std::vector<int>& neighbors, PM::Vector& normal)
+{
+	const int euclideanDim = points.getEuclideanDim();
+	if(neighbors.size() < static_cast<size_t>(euclideanDim))
+	{
+		return false;
+	}
+	
+	PM::Vector mean = PM::Vector::Zero(euclideanDim);
+	for(int neighbor: neighbors)
+	{
+		mean += points.features.col(neighbor).head(euclideanDim);
+	}
+	mean /= neighbors.size();
+	PM::Matrix covariance = PM::Matrix::Zero(euclideanDim, euclideanDim);
+	for(int neighbor: neighbors)
+	{
+		const PM::Vector deviation = points.features.col(neighbor).head(euclideanDim) - mean;
+		covariance += deviation * deviation.transpose();
+	}
+	
+	// eigenvalues are sorted in increasing order, the normal being the direction of least variance
+	Eigen::SelfAdjointEigenSolver<PM::Matrix> solver(covariance);
+	normal = solver.eigenvectors().col(0);
+	return true;
+}
+
+MapMerger::TileResult MapMerger::mergeTile(const std::string& tileFileName, const std::string& mergedTileFileName) const
+{
+	// tags of the tile blocks hold the index of their map and whether they are margin
+	std::vector<std::uint32_t> pointTags;
+	const PM::DataPoints points = BlockFile::read(tileFileName, featureLabels, descriptorLabels, timeLabels, pointTags);
+	std::vector<std::uint32_t> mapIndexes(pointTags.size());
+	std::vector<bool> isMarginPoint(pointTags.size());
+	for(size_t i = 0; i < pointTags.size(); i++)
+	{
+		mapIndexes[i] = pointTags[i] >> 1;
+		isMarginPoint[i] = (pointTags[i] & 1) != 0;
+	}
+	
+	TileResult result = {0, 0, 0};
+	const VoxelHash duplicateVoxelHash = buildVoxelHash(points, minDistNewPoint);
+	std::vector<int> keptPointIndexes;
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		if(isMarginPoint[i])
+		{
+			continue;
+		}
+		
+		// points of the margin are taken into account, so that duplicates on both sides of a tile border are found
+		bool isDuplicate = false;
+		for(int neighbor: findNeighbors(duplicateVoxelHash, points, i, minDistNewPoint, minDistNewPoint))
+		{
+			if(mapIndexes[neighbor] < mapIndexes[i])
+			{
+				isDuplicate = true;
+				break;
+			}
+		}
+		if(isDuplicate)
+		{
+			result.duplicatePointCount++;
+		}
+		else
+		{
+			keptPointIndexes.push_back(i);
+		}
+	}
+	
+	PM::DataPoints mergedPoints = points.createSimilarEmpty(keptPointIndexes.size());
+	for(size_t i = 0; i < keptPointIndexes.size(); i++)
+	{
+		mergedPoints.setColFrom(i, points, keptPointIndexes[i]);
+	}
+	
+	// only normals at the seams between maps are estimated again, those of other points being kept from their map
+	if(seamRadius > 0 && mergedPoints.descriptorExists("normals"))
+	{
+		const VoxelHash seamVoxelHash = buildVoxelHash(points, seamRadius);
+		PM::DataPoints::View normals = mergedPoints.getDescriptorViewByName("normals");
+		const int normalDim = std::min<int>(normals.rows(), points.getEuclideanDim());
+		for(size_t i = 0; i < keptPointIndexes.size(); i++)
+		{
+			const int pointIndex = keptPointIndexes[i];
+			const std::vector<int> neighbors = findNeighbors(seamVoxelHash, points, pointIndex, seamRadius, seamRadius);
+			bool isSeamPoint = false;
+			for(int neighbor: neighbors)
+			{
+				if(mapIndexes[neighbor] != mapIndexes[pointIndex])
+				{
+					isSeamPoint = true;
+					break;
+				}
+			}
+			
+			PM::Vector normal;
+			if(isSeamPoint && estimateNormal(points, neighbors, normal))
+			{
+				if(normal.head(normalDim).dot(normals.col(i).head(normalDim)) < 0)
+				{
+					normal = -normal;
+				}
+				normals.col(i).head(normalDim) = normal.head(normalDim);
+				result.seamPointCount++;
+			}
+		}
+	}
+	
+	std::vector<int> mergedPointIndexes(mergedPoints.getNbPoints());
+	for(size_t i = 0; i < mergedPointIndexes.size(); i++)
+	{
+		mergedPointIndexes[i] = i;
+	}
+	if(!mergedPointIndexes.empty())
+	{
+		BlockFile::append(mergedTileFileName, mergedPoints, mergedPointIndexes, 0);
+	}
+	result.pointCount = mergedPoints.getNbPoints();
+	return result;
+}
+
+void MapMerger::addMapChunk(const PM::DataPoints& chunk)
+{
+	if(mapCount == 0 && inputPointCount == 0)
+	{
+		featureLabels = chunk.featureLabels;
+		descriptorLabels = chunk.descriptorLabels;
+		timeLabels = chunk.timeLabels;
+	}
+	const PM::DataPoints normalizedMap = normalizeMap(chunk);
+	
+	// points within the merge distances of a tile border are also written to the neighboring tile, as margin
+	const float marginSize = std::max(minDistNewPoint, seamRadius);
+	std::map<std::pair<int, int>, std::vector<int>> tilePointIndexes;
+	std::map<std::pair<int, int>, std::vector<int>> marginPointIndexes;
+	for(int i = 0; i < normalizedMap.getNbPoints(); i++)
+	{
+		const T x = normalizedMap.features(0, i);
+		const T y = normalizedMap.features(1, i);
+		const int tileX = computeTileCoordinate(x);
+		const int tileY = computeTileCoordinate(y);
+		tilePointIndexes[std::make_pair(tileX, tileY)].push_back(i);
+		
+		for(int neighborX = computeTileCoordinate(x - marginSize); neighborX <= computeTileCoordinate(x + marginSize); neighborX++)
+		{
+			for(int neighborY = computeTileCoordinate(y - marginSize); neighborY <= computeTileCoordinate(y + marginSize); neighborY++)
+			{
+				if(neighborX != tileX || neighborY != tileY)
+				{
+					marginPointIndexes[std::make_pair(neighborX, neighborY)].push_back(i);
+				}
+			}
+		}
+	}
+	
+	for(const std::pair<const std::pair<int, int>, std::vector<int>>& tilePoints: tilePointIndexes)
+	{
+		Tile& tile = retrieveTile(tilePoints.first.first, tilePoints.first.second);
+		BlockFile::append(tile.fileName, normalizedMap, tilePoints.second, mapCount << 1);
+		tile.pointCount += tilePoints.second.size();
+	}
+	for(const std::pair<const std::pair<int, int>, std::vector<int>>& marginPoints: marginPointIndexes)
+	{
+		BlockFile::append(retrieveTile(marginPoints.first.first, marginPoints.first.second).fileName, normalizedMap, marginPoints.second, (mapCount << 1) | 1);
+	}
+	
+	inputPointCount += normalizedMap.getNbPoints();
+}
+
+void MapMerger::finishMap()
+{
+	mapCount++;
+}
+
+MapMerger::Statistics MapMerger::merge(ThreadPool& threadPool)
+{
+	Statistics statistics = {inputPointCount, 0, 0, 0, 0};
+	
+	// tiles holding only margin points have nothing to merge
+	std::vector<Tile> tilesToMerge;
+	for(const std::pair<const std::int64_t, Tile>& tile: tiles)
+	{
+		if(tile.second.pointCount > 0)
+		{
+			tilesToMerge.push_back(tile.second);
+		}
+		else
+		{
+			std::remove(tile.second.fileName.c_str());
+		}
+	}
+	statistics.tileCount = tilesToMerge.size();
+	
+	// at most one tile per thread is in memory, which bounds the memory used by a merge regardless of the map size
+	std::vector<TileResult> tileResults(tilesToMerge.size());
+	std::vector<std::string> mergedTileFileNames(tilesToMerge.size());
+	std::deque<std::future<void>> pendingTiles;
+	try
+	{
+		for(size_t i = 0; i < tilesToMerge.size(); i++)
+		{
+			const Tile& tile = tilesToMerge[i];
+			TileResult& tileResult = tileResults[i];
+			std::string& mergedTileFileName = mergedTileFileNames[i];
+			mergedTileFileName = createTileFileName("merged", tile.tileX, tile.tileY);
+			pendingTiles.push_back(threadPool.enqueue([this, &tile, &tileResult, &mergedTileFileName]
+			{
+				tileResult = mergeTile(tile.fileName, mergedTileFileName);
+				std::remove(tile.fileName.c_str());
+			}));
+			
+			if(pendingTiles.size() > threadPool.getThreadCount())
+			{
+				pendingTiles.front().get();
+				pendingTiles.pop_front();
+			}
+		}
+		
+		while(!pendingTiles.empty())
+		{
+			pendingTiles.front().get();
+			pendingTiles.pop_front();
+		}
+	}
+	catch(...)
+	{
+		// the merging tasks refer to the tile results, which must outlive them
+		for(std::future<void>& pendingTile: pendingTiles)
+		{
+			pendingTile.wait();
+		}
+		throw;
+	}
+	tiles.clear();
+	
+	for(size_t i = 0; i < tilesToMerge.size(); i++)
+	{
+		if(tileResults[i].pointCount > 0)
+		{
+			Tile mergedTile = {tilesToMerge[i].tileX, tilesToMerge[i].tileY, mergedTileFileNames[i], tileResults[i].pointCount};
+			mergedTiles.push_back(mergedTile);
+		}
+		statistics.outputPointCount += tileResults[i].pointCount;
+		statistics.duplicatePointCount += tileResults[i].duplicatePointCount;
+		statistics.seamPointCount += tileResults[i].seamPointCount;
+	}
+	return statistics;
+}
+
+MapFile::ChunkSource MapMerger::getMergedMap() const
+{
+	MapFile::ChunkSource mergedMap;
+	mergedMap.chunkCount = mergedTiles.size();
+	mergedMap.pointCount = 0;
+	for(const Tile& mergedTile: mergedTiles)
+	{
+		mergedMap.pointCount += mergedTile.pointCount;
+	}
+	mergedMap.getChunk = [this](unsigned chunkIndex)
+	{
+		std::vector<std::uint32_t> pointTags;
+		return std::make_shared<const PM::DataPoints>(BlockFile::read(mergedTiles[chunkIndex].fileName, featureLabels, descriptorLabels, timeLabels, pointTags));
+	};
+	return mergedMap;
+}
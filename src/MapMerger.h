@@ -0,0 +1,100 @@
+#ifndef MAP_MERGER_H
+#define MAP_MERGER_H
+
+#include "MapFile.h"
+#include "BlockFile.h"
+#include "ThreadPool.h"
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Merges saved maps expressed in the same frame, their points being spilled to disk by square tile and tiles being deduplicated in parallel, so that the
+// memory used does not depend on the size of the merged map
+class MapMerger
+{
+public:
+	struct Statistics
+	{
+		unsigned inputPointCount;
+		unsigned outputPointCount;
+		unsigned duplicatePointCount;
+		unsigned seamPointCount;
+		unsigned tileCount;
+	};
+	
+private:
+	struct Tile
+	{
+		int tileX;
+		int tileY;
+		std::string fileName;
+		unsigned pointCount;
+	};
+	
+	struct TileResult
+	{
+		unsigned pointCount;
+		unsigned duplicatePointCount;
+		unsigned seamPointCount;
+	};
+	
+	typedef std::unordered_map<std::int64_t, std::vector<int>> VoxelHash;
+	
+	float tileSize;
+	float minDistNewPoint;
+	float seamRadius;
+	std::string workDirectory;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	unsigned mapCount;
+	unsigned inputPointCount;
+	std::map<std::int64_t, Tile> tiles;
+	std::vector<Tile> mergedTiles;
+	
+	std::int64_t computeTileKey(int tileX, int tileY) const;
+	
+	int computeTileCoordinate(T coordinate) const;
+	
+	std::string createTileFileName(const std::string& prefix, int tileX, int tileY) const;
+	
+	Tile& retrieveTile(int tileX, int tileY);
+	
+	PM::DataPoints normalizeMap(const PM::DataPoints& map) const;
+	
+	static std::int64_t computeVoxelKey(int voxelX, int voxelY, int voxelZ);
+	
+	static VoxelHash buildVoxelHash(const PM::DataPoints& points, float voxelSize);
+	
+	static std::vector<int> findNeighbors(const VoxelHash& voxelHash, const PM::DataPoints& points, int pointIndex, float voxelSize, float radius);
+	
+	static bool estimateNormal(const PM::DataPoints& points, const std::vector<int>& neighbors, PM::Vector& normal);
+	
+	TileResult mergeTile(const std::string& tileFileName, const std::string& mergedTileFileName) const;
+	
+public:
+	// points closer than minDistNewPoint to a point of a map added before them are dropped, and normals of points closer than seamRadius to a point of
+	// another map are estimated again, unless seamRadius is 0
+	MapMerger(float tileSize, float minDistNewPoint, float seamRadius, const std::string& workDirectory);
+	
+	~MapMerger();
+	
+	// adds a chunk of the current map, which must be expressed in the frame of the merged map and have the descriptors and times of the first map added
+	void addMapChunk(const PM::DataPoints& chunk);
+	
+	// chunks added after this call belong to the next map, over which the current map has priority
+	void finishMap();
+	
+	Statistics merge(ThreadPool& threadPool);
+	
+	// merged tiles are read from disk one at a time when the map is saved
+	MapFile::ChunkSource getMergedMap() const;
+};
+
+#endif
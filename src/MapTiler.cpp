@@ -0,0 +1,155 @@
+#include "MapTiler.h"
+#include "MapFile.h"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+
+// chunks of a saved tile are encoded in parallel
+const unsigned TILE_CHUNK_CAPACITY = 65536;
+
+MapTiler::MapTiler(float tileSize, const PM::Vector& cropMinCorner, const PM::Vector& cropMaxCorner, const std::string& workDirectory):
+		tileSize(tileSize),
+		cropMinCorner(cropMinCorner),
+		cropMaxCorner(cropMaxCorner),
+		inputPointCount(0)
+{
+	if(tileSize < 0)
+	{
+		throw std::runtime_error("Invalid tile size.");
+	}
+	
+	std::string directoryTemplate = workDirectory + "/map_tiler_XXXXXX";
+	if(mkdtemp(&directoryTemplate[0]) == nullptr)
+	{
+		throw std::runtime_error("Unable to create a work directory in " + workDirectory + ".");
+	}
+	this->workDirectory = directoryTemplate;
+}
+
+MapTiler::~MapTiler()
+{
+	// the bucketing tasks refer to this tiler, which must outlive them
+	for(PendingChunk& pendingChunk: pendingChunks)
+	{
+		pendingChunk.bucketing.wait();
+	}
+	for(const std::pair<const std::pair<int, int>, Tile>& tile: tiles)
+	{
+		std::remove(tile.second.fileName.c_str());
+	}
+	rmdir(workDirectory.c_str());
+}
+
+int MapTiler::computeTileCoordinate(T coordinate) const
+{
+	if(tileSize == 0)
+	{
+		return 0;
+	}
+	return std::floor(coordinate / tileSize);
+}
+
+void MapTiler::bucketPoints(const PM::DataPoints& points, TilePointIndexes& tilePointIndexes) const
+{
+	const int euclideanDim = points.getEuclideanDim();
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		bool isCropped = false;
+		for(int j = 0; j < euclideanDim; j++)
+		{
+			isCropped = isCropped || points.features(j, i) < cropMinCorner(j) || points.features(j, i) > cropMaxCorner(j);
+		}
+		if(!isCropped)
+		{
+			tilePointIndexes[std::make_pair(computeTileCoordinate(points.features(0, i)), computeTileCoordinate(points.features(1, i)))].push_back(i);
+		}
+	}
+}
+
+void MapTiler::spillOldestChunk()
+{
+	PendingChunk& pendingChunk = pendingChunks.front();
+	pendingChunk.bucketing.get();
+	for(const std::pair<const std::pair<int, int>, std::vector<int>>& tilePoints: *pendingChunk.tilePointIndexes)
+	{
+		std::map<std::pair<int, int>, Tile>::iterator tile = tiles.find(tilePoints.first);
+		if(tile == tiles.end())
+		{
+			const std::string fileName = workDirectory + "/tile_" + std::to_string(tilePoints.first.first) + "_" + std::to_string(tilePoints.first.second) + ".bin";
+			Tile newTile = {tilePoints.first.first, tilePoints.first.second, fileName, 0};
+			tile = tiles.insert(std::make_pair(tilePoints.first, newTile)).first;
+		}
+		BlockFile::append(tile->second.fileName, *pendingChunk.points, tilePoints.second, 0);
+		tile->second.pointCount += tilePoints.second.size();
+	}
+	pendingChunks.pop_front();
+}
+
+void MapTiler::addChunk(const PM::DataPoints& chunk, ThreadPool& threadPool)
+{
+	if(featureLabels.empty())
+	{
+		featureLabels = chunk.featureLabels;
+		descriptorLabels = chunk.descriptorLabels;
+		timeLabels = chunk.timeLabels;
+	}
+	inputPointCount += chunk.getNbPoints();
+	
+	// chunks are bucketed in parallel and spilled in order, at most one bucketed chunk per thread waiting in memory
+	PendingChunk pendingChunk;
+	pendingChunk.points = std::make_shared<const PM::DataPoints>(chunk);
+	pendingChunk.tilePointIndexes = std::make_shared<TilePointIndexes>();
+	std::shared_ptr<const PM::DataPoints> points = pendingChunk.points;
+	std::shared_ptr<TilePointIndexes> tilePointIndexes = pendingChunk.tilePointIndexes;
+	pendingChunk.bucketing = threadPool.enqueue([this, points, tilePointIndexes]
+	{
+		bucketPoints(*points, *tilePointIndexes);
+	});
+	pendingChunks.push_back(std::move(pendingChunk));
+	
+	if(pendingChunks.size() > threadPool.getThreadCount())
+	{
+		spillOldestChunk();
+	}
+}
+
+MapTiler::Statistics MapTiler::save(const std::string& indexFileName, const std::string& extension, ThreadPool& threadPool)
+{
+	while(!pendingChunks.empty())
+	{
+		spillOldestChunk();
+	}
+	
+	const size_t dotPosition = indexFileName.find_last_of('.');
+	const std::string tilePrefix = dotPosition == std::string::npos ? indexFileName : indexFileName.substr(0, dotPosition);
+	Statistics statistics = {inputPointCount, 0, 0};
+	TileIndex tileIndex(tileSize);
+	
+	// tiles are saved one at a time, their chunks being encoded in parallel
+	for(const std::pair<const std::pair<int, int>, Tile>& tile: tiles)
+	{
+		std::vector<std::uint32_t> pointTags;
+		const PM::DataPoints points = BlockFile::read(tile.second.fileName, featureLabels, descriptorLabels, timeLabels, pointTags);
+		const int euclideanDim = points.getEuclideanDim();
+		
+		TileIndex::Tile indexTile;
+		indexTile.fileName = tilePrefix + "_" + std::to_string(tile.second.tileX) + "_" + std::to_string(tile.second.tileY) + extension;
+		indexTile.pointCount = points.getNbPoints();
+		indexTile.minCorner = points.features.topRows(euclideanDim).rowwise().minCoeff();
+		indexTile.maxCorner = points.features.topRows(euclideanDim).rowwise().maxCoeff();
+		MapFile::save(ChunkedPointCloud(points, TILE_CHUNK_CAPACITY), indexTile.fileName, threadPool, [](const std::string& descriptorName)
+		{
+			return true;
+		});
+		tileIndex.addTile(indexTile);
+		std::remove(tile.second.fileName.c_str());
+		
+		statistics.outputPointCount += indexTile.pointCount;
+		statistics.tileCount++;
+	}
+	tiles.clear();
+	
+	tileIndex.save(indexFileName);
+	return statistics;
+}
@@ -0,0 +1,78 @@
+#ifndef MAP_TILER_H
+#define MAP_TILER_H
+
+#include "BlockFile.h"
+#include "TileIndex.h"
+#include "ThreadPool.h"
+#include <pointmatcher/PointMatcher.h>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Splits a map received chunk by chunk in square tiles, chunks being bucketed in parallel and their points spilled to disk by tile, so that the memory
+// used does not depend on the size of the map
+class MapTiler
+{
+public:
+	struct Statistics
+	{
+		unsigned inputPointCount;
+		unsigned outputPointCount;
+		unsigned tileCount;
+	};
+	
+private:
+	struct Tile
+	{
+		int tileX;
+		int tileY;
+		std::string fileName;
+		unsigned pointCount;
+	};
+	
+	typedef std::map<std::pair<int, int>, std::vector<int>> TilePointIndexes;
+	
+	struct PendingChunk
+	{
+		std::future<void> bucketing;
+		std::shared_ptr<const PM::DataPoints> points;
+		std::shared_ptr<TilePointIndexes> tilePointIndexes;
+	};
+	
+	float tileSize;
+	PM::Vector cropMinCorner;
+	PM::Vector cropMaxCorner;
+	std::string workDirectory;
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	PM::DataPoints::Labels timeLabels;
+	unsigned inputPointCount;
+	std::map<std::pair<int, int>, Tile> tiles;
+	std::deque<PendingChunk> pendingChunks;
+	
+	int computeTileCoordinate(T coordinate) const;
+	
+	void bucketPoints(const PM::DataPoints& points, TilePointIndexes& tilePointIndexes) const;
+	
+	void spillOldestChunk();
+	
+public:
+	// points outside of the crop box are dropped, and a tile size of 0 puts all points in a single tile
+	MapTiler(float tileSize, const PM::Vector& cropMinCorner, const PM::Vector& cropMaxCorner, const std::string& workDirectory);
+	
+	~MapTiler();
+	
+	// chunks must all have the labels of the first one
+	void addChunk(const PM::DataPoints& chunk, ThreadPool& threadPool);
+	
+	// each tile is saved next to the index, its file name being that of the index followed by its tile coordinates and the extension
+	Statistics save(const std::string& indexFileName, const std::string& extension, ThreadPool& threadPool);
+};
+
+#endif
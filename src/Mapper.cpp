@@ -1,12 +1,30 @@
 #include "Mapper.h"
 #include <nabo/nabo.h>
+#include <algorithm>
 #include <fstream>
 #include <chrono>
+#include <exception>
+
+// libnabo linear heap kd-trees store one bucket entry (point pointer and index) per point plus one node every few points
+const size_t KD_TREE_BYTES_PER_POINT = 18;
+
+// large enough for whole-map iteration to stay sequential, small enough for an append to copy little
+const unsigned MAP_CHUNK_CAPACITY = 65536;
+
+// the likelihood field extends past the reference by this ratio of the sensor range, so that it is rebuilt only every few map updates
+const float LIKELIHOOD_FIELD_MARGIN_RATIO = 0.25;
 
 Mapper::Mapper(std::string icpConfigFilePath, std::string inputFiltersConfigFilePath, std::string inputFiltersWorldFilePath, std::string mapPostFiltersConfigFilePath, std::string mapUpdateCondition,
 			   float mapUpdateOverlap, float mapUpdateDelay, float mapUpdateDistance, float minDistNewPoint, float sensorMaxRange,
 			   float priorDynamic, float thresholdDynamic, float beamHalfAngle, float epsilonA, float epsilonD, float alpha, float beta,
-			   bool is3D, bool isOnline, bool computeProbDynamic, bool isMapping):
+			   int keyframeRegistrationPeriod, float keyframeMinOverlap, std::vector<std::string> mapDescriptors, std::vector<std::string> mapReferenceDescriptors,
+			   std::string registrationMethod, float likelihoodFieldResolution, float likelihoodFieldMaxDistance, bool is3D, bool isOnline, bool computeProbDynamic,
+			   bool isMapping, bool applyInputFilters):
+		map(MAP_CHUNK_CAPACITY),
+		localReferenceThreadPool(nullptr),
+		coarseMapRadius(0),
+		coarseMapVoxelSize(0),
+		isCoarseMapOutdated(true),
 		transformation(PM::get().TransformationRegistrar.create("RigidTransformation")),
 		icpConfigFilePath(icpConfigFilePath),
 		inputFiltersConfigFilePath(inputFiltersConfigFilePath),
@@ -25,12 +43,26 @@ Mapper::Mapper(std::string icpConfigFilePath, std::string inputFiltersConfigFile
 		epsilonD(epsilonD),
 		alpha(alpha),
 		beta(beta),
+		keyframeRegistrationPeriod(keyframeRegistrationPeriod),
+		keyframeMinOverlap(keyframeMinOverlap),
+		mapDescriptors(mapDescriptors),
+		mapReferenceDescriptors(mapReferenceDescriptors),
+		droppedDescriptorBytes(0),
 		is3D(is3D),
 		isOnline(isOnline),
 		computeProbDynamic(computeProbDynamic),
 		isMapping(isMapping),
+		applyInputFilters(applyInputFilters),
 		newMapAvailable(false),
-		isMapEmpty(true)
+		newElevationGridAvailable(false),
+		mapEpoch(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()),
+		mapGeneration(0),
+		mapHistorySize(0),
+		isMapEmpty(true),
+		referencePointCount(0),
+		isKeyframeAvailable(false),
+		scansSinceKeyframe(0),
+		icpStatistics()
 {
 	loadYamlConfig();
 	
@@ -40,22 +72,37 @@ Mapper::Mapper(std::string icpConfigFilePath, std::string inputFiltersConfigFile
 	radiusFilterParams["removeInside"] = "0";
 	radiusFilter = PM::get().DataPointsFilterRegistrar.create("DistanceLimitDataPointsFilter", radiusFilterParams);
 	
+	if(registrationMethod == "likelihood_field")
+	{
+		likelihoodField = std::make_shared<LikelihoodFieldMatcher>(likelihoodFieldResolution, likelihoodFieldMaxDistance, sensorMaxRange * LIKELIHOOD_FIELD_MARGIN_RATIO);
+	}
+	
 	int homogeneousDim = is3D ? 4 : 3;
 	sensorPose = PM::Matrix::Identity(homogeneousDim, homogeneousDim);
 }
 
-void Mapper::loadYamlConfig()
+void Mapper::loadIcpConfig(PM::ICPSequence& registration)
 {
 	if(!icpConfigFilePath.empty())
 	{
 		std::ifstream ifs(icpConfigFilePath.c_str());
-		icp.loadFromYaml(ifs);
+		registration.loadFromYaml(ifs);
 		ifs.close();
 	}
 	else
 	{
-		icp.setDefault();
+		registration.setDefault();
 	}
+}
+
+void Mapper::loadYamlConfig()
+{
+	loadIcpConfig(icp);
+	loadIcpConfig(keyframeIcp);
+	profiledMatcher = std::make_shared<ProfiledMatcher>(icp.matcher);
+	icp.matcher = profiledMatcher;
+	keyframeProfiledMatcher = std::make_shared<ProfiledMatcher>(keyframeIcp.matcher);
+	keyframeIcp.matcher = keyframeProfiledMatcher;
 	
 	if(!inputFiltersConfigFilePath.empty())
 	{
@@ -79,6 +126,15 @@ void Mapper::loadYamlConfig()
 	}
 }
 
+void Mapper::preprocessInput(PM::DataPoints& inputInSensorFrame)
+{
+	if(applyInputFilters)
+	{
+		radiusFilter->inPlaceFilter(inputInSensorFrame);
+		inputFilters.apply(inputInSensorFrame);
+	}
+}
+
 void Mapper::processInput(PM::DataPoints& inputInSensorFrame, const PM::TransformationParameters& estimatedSensorPose,
 						  const std::chrono::time_point<std::chrono::steady_clock>& timeStamp)
 {
@@ -86,26 +142,80 @@ void Mapper::processInput(PM::DataPoints& inputInSensorFrame, const PM::Transfor
     PM::DataPoints inputInMapFrame = transformation->compute(inputInSensorFrame, estimatedSensorPose);
     inputFiltersWorld.apply(inputInMapFrame);
 
-	radiusFilter->inPlaceFilter(inputInSensorFrame);
-	inputFilters.apply(inputInSensorFrame);
+	// unless applyInputFilters is true, the input filters run once the input is expressed in the map frame, so that they do not affect the registered input
+	if(!applyInputFilters)
+	{
+		radiusFilter->inPlaceFilter(inputInSensorFrame);
+		inputFilters.apply(inputInSensorFrame);
+	}
 
 	if(isMapEmpty)
 	{
 		sensorPose = estimatedSensorPose;
+		icpStatistics = IcpStatistics();
 		
 		updateMap(inputInMapFrame, timeStamp);
 	}
 	else
 	{
-		icpMapLock.lock();
-		PM::TransformationParameters correction = icp(inputInMapFrame);
-		icpMapLock.unlock();
+		if(isKeyframeAvailable && scansSinceKeyframe + 1 < keyframeRegistrationPeriod)
+		{
+			keyframeProfiledMatcher->resetStatistics();
+			std::chrono::time_point<std::chrono::steady_clock> registrationStartTime = std::chrono::steady_clock::now();
+			PM::TransformationParameters keyframeCorrection = keyframeIcp(inputInMapFrame);
+			std::chrono::time_point<std::chrono::steady_clock> registrationEndTime = std::chrono::steady_clock::now();
+			
+			// a low overlap with the keyframe indicates drift, in which case the scan is registered against the map instead
+			if(keyframeIcp.errorMinimizer->getOverlap() >= keyframeMinOverlap)
+			{
+				sensorPose = keyframeCorrection * estimatedSensorPose;
+				updateIcpStatistics(keyframeIcp, *keyframeProfiledMatcher, registrationStartTime, registrationEndTime);
+				icpStatistics.isKeyframeRegistration = true;
+				scansSinceKeyframe++;
+				return;
+			}
+		}
+		
+		PM::TransformationParameters correction;
+		if(likelihoodField)
+		{
+			icpMapLock.lock();
+			std::chrono::time_point<std::chrono::steady_clock> registrationStartTime = std::chrono::steady_clock::now();
+			LikelihoodFieldMatcher::Result result = likelihoodField->align(inputInMapFrame);
+			std::chrono::time_point<std::chrono::steady_clock> registrationEndTime = std::chrono::steady_clock::now();
+			icpMapLock.unlock();
+			
+			correction = result.correction;
+			updateLikelihoodFieldStatistics(result, inputInMapFrame.getNbPoints(), registrationStartTime, registrationEndTime);
+		}
+		else
+		{
+			icpMapLock.lock();
+			profiledMatcher->resetStatistics();
+			std::chrono::time_point<std::chrono::steady_clock> registrationStartTime = std::chrono::steady_clock::now();
+			correction = icp(inputInMapFrame);
+			std::chrono::time_point<std::chrono::steady_clock> registrationEndTime = std::chrono::steady_clock::now();
+			icpMapLock.unlock();
+			
+			updateIcpStatistics(icp, *profiledMatcher, registrationStartTime, registrationEndTime);
+		}
 		
 		sensorPose = correction * estimatedSensorPose;
+		icpStatistics.isKeyframeRegistration = false;
 		
-		if(shouldUpdateMap(timeStamp, sensorPose, icp.errorMinimizer->getOverlap()))
+		PM::DataPoints correctedInputInMapFrame = transformation->compute(inputInMapFrame, correction);
+		if(keyframeRegistrationPeriod > 1)
+		{
+			setKeyframe(correctedInputInMapFrame);
+		}
+		
+		if(sharedMap)
+		{
+			updateLocalReferenceIfNeeded();
+		}
+		else if(shouldUpdateMap(timeStamp, sensorPose, icpStatistics.overlap))
 		{
-			updateMap(transformation->compute(inputInMapFrame, correction), timeStamp);
+			updateMap(correctedInputInMapFrame, timeStamp);
 		}
 	}
 }
@@ -149,43 +259,354 @@ void Mapper::updateMap(const PM::DataPoints& currentInput, const std::chrono::ti
 	lastTimeMapWasUpdated = timeStamp;
 	lastSensorPoseWhereMapWasUpdated = sensorPose;
 	
-	if(isOnline && !isMapEmpty)
+	if(shardedMap)
 	{
-		mapBuilderFuture = std::async(&Mapper::buildMap, this, currentInput, getMap(), sensorPose);
+		if(isMapEmpty)
+		{
+			insertIntoShardedMap(currentInput, sensorPose);
+		}
+		else
+		{
+			mapBuilderFuture = localReferenceThreadPool->enqueue(std::bind(&Mapper::insertIntoShardedMap, this, currentInput, sensorPose));
+		}
+	}
+	else if(isOnline && !isMapEmpty)
+	{
+		mapBuilderFuture = std::async(&Mapper::buildMap, this, currentInput, getChunkedMap(), sensorPose);
 	}
 	else
 	{
-		buildMap(currentInput, getMap(), sensorPose);
+		buildMap(currentInput, getChunkedMap(), sensorPose);
 	}
 }
 
-void Mapper::buildMap(PM::DataPoints currentInput, PM::DataPoints currentMap, PM::TransformationParameters currentSensorPose)
+void Mapper::buildMap(PM::DataPoints currentInput, ChunkedPointCloud currentMap, PM::TransformationParameters currentSensorPose)
 {
+	memoryAccountant.setBytes("map_build_copies", computeMemoryFootprint(currentInput));
+	
+	const size_t inputDescriptorBytesPerPoint = computeDescriptorBytesPerPoint(currentInput);
+	currentInput = retainMapDescriptors(currentInput);
+	const size_t droppedBytesPerPoint = inputDescriptorBytesPerPoint - computeDescriptorBytesPerPoint(currentInput);
 	if(computeProbDynamic)
 	{
 		currentInput.addDescriptor("probabilityDynamic", PM::Matrix::Constant(1, currentInput.features.cols(), priorDynamic));
 	}
 	
+	bool isRegistrationReferenceUpdated = false;
+	// the occupancy grid follows the map point by point, unless the map was created or post filtered as a whole
+	const bool isOccupancyGridRebuilt = isMapEmpty || !mapPostFilters.empty();
 	if(isMapEmpty)
 	{
-		currentMap = currentInput;
+		updateElevationGrid(currentMap, currentInput, currentSensorPose, false);
+		currentMap = ChunkedPointCloud(currentInput, MAP_CHUNK_CAPACITY);
+		droppedDescriptorBytes += droppedBytesPerPoint * currentInput.getNbPoints();
 	}
 	else
 	{
+		// only the chunks within sensor range are copied, the others stay shared with the current map
+		int euclideanDim = is3D ? 3 : 2;
+		std::vector<unsigned> chunksInRange = currentMap.findChunksInRange(currentSensorPose.topRightCorner(euclideanDim, 1), sensorMaxRange);
+		PM::DataPoints mapInRange = currentMap.extract(chunksInRange);
+		memoryAccountant.setBytes("map_build_copies", computeMemoryFootprint(currentInput) + computeMemoryFootprint(mapInRange));
 		if(computeProbDynamic)
 		{
-			computeProbabilityOfPointsBeingDynamic(currentInput, currentMap, currentSensorPose);
+			// the chunks in range are processed together, so that neighborhoods are not cut at chunk borders
+			const bool isOccupancyGridCleared = occupancyGrid && !isOccupancyGridRebuilt;
+			const PM::DataPoints previousMapInRange = isOccupancyGridCleared ? mapInRange : PM::DataPoints();
+			computeProbabilityOfPointsBeingDynamic(currentInput, mapInRange, currentSensorPose);
+			if(isOccupancyGridCleared)
+			{
+				clearDynamicPointsFromOccupancyGrid(previousMapInRange, mapInRange);
+			}
+			currentMap.setChunks(chunksInRange, mapInRange);
 		}
 		
-		PM::DataPoints inputPointsToKeep = retrievePointsFurtherThanMinDistNewPoint(currentInput, currentMap, currentSensorPose);
-		currentMap.concatenate(inputPointsToKeep);
+		PM::DataPoints inputPointsToKeep = retrievePointsFurtherThanMinDistNewPoint(currentInput, mapInRange, currentSensorPose);
+		updateElevationGrid(currentMap, inputPointsToKeep, currentSensorPose, false);
+		currentMap.append(inputPointsToKeep);
+		droppedDescriptorBytes += droppedBytesPerPoint * inputPointsToKeep.getNbPoints();
+		if(!isOccupancyGridRebuilt)
+		{
+			addToOccupancyGrid(inputPointsToKeep);
+		}
+		
+		// without post filters, the map only gained the new points, so the likelihood field is updated around them only
+		if(likelihoodField && mapPostFilters.empty())
+		{
+			isRegistrationReferenceUpdated = addRegistrationReferencePoints(inputPointsToKeep);
+		}
+	}
+	
+	// post filters may depend on the whole map, in which case they are applied to a contiguous copy of it
+	if(!mapPostFilters.empty())
+	{
+		PM::DataPoints mapInSensorFrame = transformation->compute(currentMap.toDataPoints(), currentSensorPose.inverse());
+		memoryAccountant.setBytes("map_build_copies", computeMemoryFootprint(currentInput) + computeMemoryFootprint(mapInSensorFrame));
+		mapPostFilters.apply(mapInSensorFrame);
+		currentMap = ChunkedPointCloud(transformation->compute(mapInSensorFrame, currentSensorPose), MAP_CHUNK_CAPACITY);
 	}
 	
-	PM::DataPoints mapInSensorFrame = transformation->compute(currentMap, currentSensorPose.inverse());
-	mapPostFilters.apply(mapInSensorFrame);
-	currentMap = transformation->compute(mapInSensorFrame, currentSensorPose);
+	if(isOccupancyGridRebuilt)
+	{
+		rebuildOccupancyGrid(currentMap);
+	}
 	
-	setMap(currentMap, currentSensorPose);
+	if(isRegistrationReferenceUpdated)
+	{
+		storeMap(currentMap);
+	}
+	else
+	{
+		setMap(currentMap, currentSensorPose);
+	}
+	
+	memoryAccountant.setBytes("map_build_copies", 0);
+}
+
+void Mapper::rebuildOccupancyGrid(const ChunkedPointCloud& currentMap)
+{
+	if(!occupancyGrid)
+	{
+		return;
+	}
+	
+	std::lock_guard<std::mutex> lock(occupancyGridLock);
+	occupancyGrid->resetHitCounts();
+	for(unsigned i = 0; i < currentMap.getChunkCount(); i++)
+	{
+		const PM::DataPoints& chunk = currentMap.getChunk(i);
+		std::vector<bool> isStatic = findStaticPoints(chunk);
+		for(int j = 0; j < chunk.getNbPoints(); j++)
+		{
+			if(isStatic[j])
+			{
+				occupancyGrid->addPoint(chunk.features.col(j));
+			}
+		}
+	}
+	occupancyGrid->updateClearedCells();
+	memoryAccountant.setBytes("occupancy_grid", occupancyGrid->getBytes());
+}
+
+void Mapper::addToOccupancyGrid(const PM::DataPoints& points)
+{
+	if(!occupancyGrid)
+	{
+		return;
+	}
+	
+	std::vector<bool> isStatic = findStaticPoints(points);
+	std::lock_guard<std::mutex> lock(occupancyGridLock);
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		if(isStatic[i])
+		{
+			occupancyGrid->addPoint(points.features.col(i));
+		}
+	}
+	memoryAccountant.setBytes("occupancy_grid", occupancyGrid->getBytes());
+}
+
+void Mapper::clearDynamicPointsFromOccupancyGrid(const PM::DataPoints& previousPoints, const PM::DataPoints& currentPoints)
+{
+	if(!occupancyGrid)
+	{
+		return;
+	}
+	
+	std::vector<bool> wasStatic = findStaticPoints(previousPoints);
+	std::vector<bool> isStatic = findStaticPoints(currentPoints);
+	std::lock_guard<std::mutex> lock(occupancyGridLock);
+	for(int i = 0; i < currentPoints.getNbPoints(); i++)
+	{
+		if(wasStatic[i] && !isStatic[i])
+		{
+			occupancyGrid->removePoint(currentPoints.features.col(i));
+		}
+		else if(!wasStatic[i] && isStatic[i])
+		{
+			occupancyGrid->addPoint(currentPoints.features.col(i));
+		}
+	}
+}
+
+std::vector<bool> Mapper::findStaticPoints(const PM::DataPoints& points)
+{
+	std::vector<bool> isStatic(points.getNbPoints(), true);
+	if(computeProbDynamic && points.descriptorExists("probabilityDynamic"))
+	{
+		const PM::DataPoints::ConstView viewOnProbabilityDynamic = points.getDescriptorViewByName("probabilityDynamic");
+		for(int i = 0; i < points.getNbPoints(); i++)
+		{
+			isStatic[i] = viewOnProbabilityDynamic(0, i) < thresholdDynamic;
+		}
+	}
+	return isStatic;
+}
+
+void Mapper::updateElevationGrid(const ChunkedPointCloud& currentMap, const PM::DataPoints& newPoints, const PM::TransformationParameters& currentSensorPose,
+								 bool isCleared)
+{
+	if(!elevationGrid)
+	{
+		return;
+	}
+	
+	std::lock_guard<std::mutex> lock(elevationGridLock);
+	if(isCleared)
+	{
+		elevationGrid->clear();
+	}
+	
+	int euclideanDim = is3D ? 3 : 2;
+	if(elevationGrid->recenter(currentSensorPose(0, euclideanDim), currentSensorPose(1, euclideanDim)))
+	{
+		// the chunks are searched within the half diagonal of the window
+		for(unsigned chunkIndex: currentMap.findChunksInRange(currentSensorPose.topRightCorner(euclideanDim, 1), elevationGrid->getRadius() * std::sqrt(2)))
+		{
+			elevationGrid->refillStaleCells(currentMap.getChunk(chunkIndex));
+		}
+		elevationGrid->markStaleCellsFilled();
+	}
+	elevationGrid->addPoints(newPoints);
+	newElevationGridAvailable = true;
+	memoryAccountant.setBytes("elevation_grid", elevationGrid->getBytes());
+}
+
+void Mapper::insertIntoShardedMap(PM::DataPoints currentInput, PM::TransformationParameters currentSensorPose)
+{
+	const size_t inputDescriptorBytesPerPoint = computeDescriptorBytesPerPoint(currentInput);
+	currentInput = retainMapDescriptors(currentInput);
+	const size_t droppedBytesPerPoint = inputDescriptorBytesPerPoint - computeDescriptorBytesPerPoint(currentInput);
+	if(computeProbDynamic)
+	{
+		currentInput.addDescriptor("probabilityDynamic", PM::Matrix::Constant(1, currentInput.features.cols(), priorDynamic));
+	}
+	
+	int euclideanDim = is3D ? 3 : 2;
+	unsigned insertedPointCount = 0;
+	shardedMap->update(currentInput, currentSensorPose.topRightCorner(euclideanDim, 1), sensorMaxRange,
+					   [this, &currentInput, &currentSensorPose, &insertedPointCount](const PM::DataPoints& shardInput, PM::DataPoints& shardPoints)
+	{
+		insertedPointCount += updateShard(currentInput, shardInput, shardPoints, currentSensorPose);
+	});
+	droppedDescriptorBytes += droppedBytesPerPoint * insertedPointCount;
+	
+	setLocalReference(currentSensorPose);
+	isMapEmpty = false;
+}
+
+unsigned Mapper::updateShard(const PM::DataPoints& currentInput, const PM::DataPoints& shardInput, PM::DataPoints& shardPoints,
+							 const PM::TransformationParameters& currentSensorPose)
+{
+	unsigned insertedPointCount = shardInput.getNbPoints();
+	if(shardPoints.getNbPoints() == 0)
+	{
+		shardPoints = shardInput;
+	}
+	else
+	{
+		// the whole input is used since rays ending in other shards also cross this one
+		if(computeProbDynamic)
+		{
+			computeProbabilityOfPointsBeingDynamic(currentInput, shardPoints, currentSensorPose);
+		}
+		
+		insertedPointCount = 0;
+		if(shardInput.getNbPoints() > 0)
+		{
+			const PM::DataPoints shardPointsToKeep = retrievePointsFurtherThanMinDistNewPoint(shardInput, shardPoints, currentSensorPose);
+			shardPoints.concatenate(shardPointsToKeep);
+			insertedPointCount = shardPointsToKeep.getNbPoints();
+		}
+	}
+	
+	if(shardPoints.getNbPoints() > 0)
+	{
+		PM::DataPoints shardInSensorFrame = transformation->compute(shardPoints, currentSensorPose.inverse());
+		mapPostFilters.apply(shardInSensorFrame);
+		shardPoints = transformation->compute(shardInSensorFrame, currentSensorPose);
+	}
+	return insertedPointCount;
+}
+
+void Mapper::updateLocalReferenceIfNeeded()
+{
+	int euclideanDim = is3D ? 3 : 2;
+	PM::Vector lastSensorLocation = lastSensorPoseWhereMapWasUpdated.topRightCorner(euclideanDim, 1);
+	PM::Vector currentSensorLocation = sensorPose.topRightCorner(euclideanDim, 1);
+	if((currentSensorLocation - lastSensorLocation).norm() <= mapUpdateDistance)
+	{
+		return;
+	}
+	
+	// if previous local reference is not done being extracted
+	if(mapBuilderFuture.valid() && mapBuilderFuture.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+	{
+		return;
+	}
+	
+	lastSensorPoseWhereMapWasUpdated = sensorPose;
+	mapBuilderFuture = localReferenceThreadPool->enqueue(std::bind(&Mapper::setLocalReference, this, sensorPose));
+}
+
+void Mapper::setLocalReference(const PM::TransformationParameters& currentSensorPose)
+{
+	int euclideanDim = is3D ? 3 : 2;
+	PM::DataPoints localReference;
+	if(sharedMap)
+	{
+		localReference = sharedMap->extractLocalMap(currentSensorPose.topRightCorner(euclideanDim, 1), sensorMaxRange);
+	}
+	else
+	{
+		localReference = shardedMap->extractLocalMap(currentSensorPose.topRightCorner(euclideanDim, 1), sensorMaxRange);
+	}
+	if(localReference.getNbPoints() == 0)
+	{
+		return;
+	}
+	
+	setRegistrationReference(localReference);
+	isCoarseMapOutdated = true;
+}
+
+void Mapper::setRegistrationReference(const PM::DataPoints& reference)
+{
+	icpMapLock.lock();
+	if(likelihoodField)
+	{
+		likelihoodField->setReference(reference);
+	}
+	else
+	{
+		icp.setMap(reference);
+	}
+	referencePointCount = reference.getNbPoints();
+	icpMapLock.unlock();
+	
+	if(likelihoodField)
+	{
+		memoryAccountant.setBytes("reference_cloud", 0);
+		memoryAccountant.setBytes("reference_index", likelihoodField->getGridBytes());
+	}
+	else
+	{
+		memoryAccountant.setBytes("reference_cloud", computeMemoryFootprint(reference));
+		memoryAccountant.setBytes("reference_index", reference.getNbPoints() * KD_TREE_BYTES_PER_POINT);
+	}
+}
+
+bool Mapper::addRegistrationReferencePoints(const PM::DataPoints& points)
+{
+	icpMapLock.lock();
+	bool areReferencePointsAdded = likelihoodField->addReferencePoints(points);
+	if(areReferencePointsAdded)
+	{
+		referencePointCount += points.getNbPoints();
+	}
+	icpMapLock.unlock();
+	return areReferencePointsAdded;
 }
 
 void Mapper::computeProbabilityOfPointsBeingDynamic(const PM::DataPoints& currentInput, PM::DataPoints& currentMap,
@@ -303,6 +724,10 @@ PM::DataPoints Mapper::retrievePointsFurtherThanMinDistNewPoint(const PM::DataPo
 	PM::DataPoints cutMapInSensorFrame = transformation->compute(currentMap, currentSensorPose.inverse());
 	radiusFilter->inPlaceFilter(cutMapInSensorFrame);
 	PM::DataPoints cutMap = transformation->compute(cutMapInSensorFrame, currentSensorPose);
+	if(cutMap.getNbPoints() == 0)
+	{
+		return currentInput;
+	}
 	
 	PM::Matches matches(PM::Matches::Dists(1, currentInput.getNbPoints()), PM::Matches::Ids(1, currentInput.getNbPoints()));
 	std::shared_ptr<NNS> nns = std::shared_ptr<NNS>(NNS::create(cutMap.features, cutMap.features.rows() - 1, NNS::KDTREE_LINEAR_HEAP, NNS::TOUCH_STATISTICS));
@@ -341,9 +766,393 @@ void Mapper::convertToSphericalCoordinates(const PM::DataPoints& points, PM::Mat
 	}
 }
 
+Mapper::RelocalizationResult Mapper::relocalize(const PM::DataPoints& inputInSensorFrame, const std::vector<PM::TransformationParameters>& candidateSensorPoses,
+												float coarseVoxelSize, float minOverlap, float timeBound, ThreadPool& threadPool)
+{
+	const std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+	const std::chrono::time_point<std::chrono::steady_clock> deadline =
+			startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(timeBound));
+	
+	// a map being built around the lost pose must not overwrite the reference recut around the relocalized pose
+	if(mapBuilderFuture.valid())
+	{
+		mapBuilderFuture.wait();
+	}
+	
+	// world filters depend on the sensor pose, which is unknown here, and the input filters have already been applied when applyInputFilters is true
+	PM::DataPoints reading = inputInSensorFrame;
+	if(!applyInputFilters)
+	{
+		radiusFilter->inPlaceFilter(reading);
+		inputFilters.apply(reading);
+	}
+	
+	RelocalizationResult result;
+	result.isSuccessful = false;
+	result.overlap = 0;
+	result.residual = std::numeric_limits<float>::infinity();
+	result.hypothesisCount = candidateSensorPoses.size();
+	result.evaluatedHypothesisCount = 0;
+	result.failedHypothesisCount = 0;
+	if(candidateSensorPoses.empty())
+	{
+		result.duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		return result;
+	}
+	
+	// only the part of the map that the sensor can see from one of the candidate poses is needed
+	int euclideanDim = is3D ? 3 : 2;
+	PM::Vector regionCenter = PM::Vector::Zero(euclideanDim);
+	for(const PM::TransformationParameters& candidateSensorPose: candidateSensorPoses)
+	{
+		regionCenter += candidateSensorPose.topRightCorner(euclideanDim, 1);
+	}
+	regionCenter /= candidateSensorPoses.size();
+	float regionRadius = 0;
+	for(const PM::TransformationParameters& candidateSensorPose: candidateSensorPoses)
+	{
+		regionRadius = std::max<float>(regionRadius, (candidateSensorPose.topRightCorner(euclideanDim, 1) - regionCenter).norm());
+	}
+	updateCoarseMap(coarseVoxelSize, regionCenter, regionRadius + sensorMaxRange);
+	if(coarseMap.getNbPoints() == 0)
+	{
+		result.duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		return result;
+	}
+	
+	std::mutex resultLock;
+	std::atomic_uint nextHypothesisIndex(0);
+	std::exception_ptr workerError;
+	
+	std::vector<std::future<void>> workerFutures;
+	const size_t workerCount = std::min<size_t>(threadPool.getThreadCount(), candidateSensorPoses.size());
+	for(size_t i = 0; i < workerCount; i++)
+	{
+		workerFutures.push_back(threadPool.enqueue([&]
+		{
+			// the setup of a worker counts in the time bound, but is not interrupted by it
+			if(std::chrono::steady_clock::now() >= deadline)
+			{
+				return;
+			}
+			
+			try
+			{
+				// the copy shares the filtered coarse map and the matcher built on it, whose searches do not modify it, while the modules keeping the
+				// state of a registration are created for the worker
+				PM::ICPSequence hypothesisIcp(coarseIcp);
+				PM::ICPSequence workerIcp;
+				loadIcpConfig(workerIcp);
+				hypothesisIcp.errorMinimizer = workerIcp.errorMinimizer;
+				hypothesisIcp.transformationCheckers = workerIcp.transformationCheckers;
+				hypothesisIcp.inspector = workerIcp.inspector;
+				
+				for(unsigned j = nextHypothesisIndex++; j < candidateSensorPoses.size() && std::chrono::steady_clock::now() < deadline; j = nextHypothesisIndex++)
+				{
+					try
+					{
+						PM::TransformationParameters hypothesisPose = hypothesisIcp(reading, candidateSensorPoses[j]);
+						float overlap = hypothesisIcp.errorMinimizer->getOverlap();
+						float residual = computeResidual(hypothesisIcp.errorMinimizer->getErrorElements());
+						
+						std::lock_guard<std::mutex> lock(resultLock);
+						result.evaluatedHypothesisCount++;
+						if(overlap > result.overlap || (overlap == result.overlap && residual < result.residual))
+						{
+							result.sensorPose = hypothesisPose;
+							result.overlap = overlap;
+							result.residual = residual;
+						}
+					}
+					catch(const PM::ConvergenceError& e)
+					{
+						std::lock_guard<std::mutex> lock(resultLock);
+						result.evaluatedHypothesisCount++;
+						if(result.failedHypothesisCount++ == 0)
+						{
+							result.failureMessage = e.what();
+						}
+					}
+				}
+			}
+			catch(...)
+			{
+				// other errors, such as an invalid icp config, stop the relocalization and are rethrown once all the workers are done
+				std::lock_guard<std::mutex> lock(resultLock);
+				if(!workerError)
+				{
+					workerError = std::current_exception();
+				}
+				nextHypothesisIndex = candidateSensorPoses.size();
+			}
+		}));
+	}
+	for(std::future<void>& workerFuture: workerFutures)
+	{
+		workerFuture.wait();
+	}
+	if(workerError)
+	{
+		std::rethrow_exception(workerError);
+	}
+	
+	result.isSuccessful = result.sensorPose.size() > 0 && result.overlap >= minOverlap;
+	if(result.isSuccessful)
+	{
+		PM::TransformationParameters coarseSensorPose = transformation->correctParameters(result.sensorPose);
+		if(sharedMap || shardedMap)
+		{
+			lastSensorPoseWhereMapWasUpdated = coarseSensorPose;
+			setLocalReference(coarseSensorPose);
+		}
+		else
+		{
+			setMap(getChunkedMap(), coarseSensorPose);
+		}
+		// recutting the reference does not change the map from which the coarse map was built
+		isCoarseMapOutdated = false;
+		
+		try
+		{
+			result.sensorPose = refineRelocalization(inputInSensorFrame, coarseSensorPose);
+			sensorPose = result.sensorPose;
+			isKeyframeAvailable = false;
+		}
+		catch(const PM::ConvergenceError& e)
+		{
+			result.isSuccessful = false;
+			result.failureMessage = e.what();
+		}
+	}
+	result.duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	return result;
+}
+
+PM::TransformationParameters Mapper::refineRelocalization(const PM::DataPoints& inputInSensorFrame, const PM::TransformationParameters& coarseSensorPose)
+{
+	// like in processInput, the input is registered in the map frame against the reference recut around the coarse pose
+	PM::DataPoints inputInMapFrame = transformation->compute(inputInSensorFrame, coarseSensorPose);
+	inputFiltersWorld.apply(inputInMapFrame);
+	
+	PM::TransformationParameters correction;
+	std::lock_guard<ProfiledMutex> lock(icpMapLock);
+	if(likelihoodField)
+	{
+		correction = likelihoodField->align(inputInMapFrame).correction;
+	}
+	else
+	{
+		correction = icp(inputInMapFrame);
+	}
+	return transformation->correctParameters(correction * coarseSensorPose);
+}
+
+void Mapper::updateCoarseMap(float voxelSize, const PM::Vector& center, float radius)
+{
+	// the coarse map is kept while the search region stays within the region it was built for
+	if(!isCoarseMapOutdated && voxelSize == coarseMapVoxelSize && coarseMapCenter.size() == center.size() &&
+	   (center - coarseMapCenter).norm() + radius <= coarseMapRadius)
+	{
+		return;
+	}
+	isCoarseMapOutdated = false;
+	
+	PM::DataPoints mapInRegion;
+	if(sharedMap)
+	{
+		mapInRegion = sharedMap->extractLocalMap(center, radius);
+	}
+	else if(shardedMap)
+	{
+		mapInRegion = shardedMap->extractLocalMap(center, radius);
+	}
+	else
+	{
+		const ChunkedPointCloud chunkedMap = getChunkedMap();
+		const PM::DataPoints chunksInRegion = chunkedMap.extract(chunkedMap.findChunksInRange(center, radius));
+		mapInRegion = chunksInRegion.createSimilarEmpty(chunksInRegion.getNbPoints());
+		int pointCountInRegion = 0;
+		for(int i = 0; i < chunksInRegion.getNbPoints(); i++)
+		{
+			if((chunksInRegion.features.col(i).head(center.size()) - center).squaredNorm() < radius * radius)
+			{
+				mapInRegion.setColFrom(pointCountInRegion++, chunksInRegion, i);
+			}
+		}
+		mapInRegion.conservativeResize(pointCountInRegion);
+	}
+	
+	PM::Parameters voxelGridParams;
+	voxelGridParams["vSizeX"] = std::to_string(voxelSize);
+	voxelGridParams["vSizeY"] = std::to_string(voxelSize);
+	voxelGridParams["vSizeZ"] = std::to_string(voxelSize);
+	voxelGridParams["useCentroid"] = "1";
+	voxelGridParams["averageExistingDescriptors"] = "0";
+	std::shared_ptr<PM::DataPointsFilter> voxelGridFilter = PM::get().DataPointsFilterRegistrar.create("VoxelGridDataPointsFilter", voxelGridParams);
+	
+	coarseMap = voxelGridFilter->filter(mapInRegion);
+	coarseMapCenter = center;
+	coarseMapRadius = radius;
+	coarseMapVoxelSize = voxelSize;
+	
+	// the reference filters and the matcher are built once for all the hypotheses
+	loadIcpConfig(coarseIcp);
+	if(coarseMap.getNbPoints() > 0)
+	{
+		coarseIcp.setMap(coarseMap);
+	}
+	memoryAccountant.setBytes("coarse_map", computeMemoryFootprint(coarseMap) + coarseMap.getNbPoints() * KD_TREE_BYTES_PER_POINT);
+}
+
+void Mapper::setKeyframe(const PM::DataPoints& newKeyframe)
+{
+	keyframeIcp.setMap(newKeyframe);
+	isKeyframeAvailable = true;
+	scansSinceKeyframe = 0;
+	memoryAccountant.setBytes("keyframe", computeMemoryFootprint(newKeyframe) + newKeyframe.getNbPoints() * KD_TREE_BYTES_PER_POINT);
+}
+
+unsigned Mapper::retrieveIcpIterationCount(const PM::ICPSequence& registration)
+{
+	for(unsigned i = 0; i < registration.transformationCheckers.size(); i++)
+	{
+		const std::vector<std::string> conditionVariableNames = registration.transformationCheckers[i]->getConditionVariableNames();
+		for(unsigned j = 0; j < conditionVariableNames.size(); j++)
+		{
+			if(conditionVariableNames[j] == "Iteration")
+			{
+				return registration.transformationCheckers[i]->getConditionVariables()(j);
+			}
+		}
+	}
+	return 0;
+}
+
+void Mapper::updateIcpStatistics(const PM::ICPSequence& registration, const ProfiledMatcher& matcher,
+								 const std::chrono::time_point<std::chrono::steady_clock>& registrationStartTime,
+								 const std::chrono::time_point<std::chrono::steady_clock>& registrationEndTime)
+{
+	icpStatistics.iterationCount = retrieveIcpIterationCount(registration);
+	icpStatistics.residual = computeResidual(registration.errorMinimizer->getErrorElements());
+	icpStatistics.overlap = registration.errorMinimizer->getOverlap();
+	icpStatistics.referencePointCount = matcher.getReferencePointCount();
+	icpStatistics.readingPointCount = matcher.getReadingPointCount();
+	
+	const float registrationTime = std::chrono::duration<float>(registrationEndTime - registrationStartTime).count();
+	icpStatistics.filteringTime = registrationTime;
+	if(matcher.getMatchingCount() > 0)
+	{
+		icpStatistics.filteringTime = std::chrono::duration<float>(matcher.getFirstMatchingTime() - registrationStartTime).count();
+	}
+	icpStatistics.matchingTime = matcher.getMatchingTime();
+	icpStatistics.minimizationTime = std::max(0.0f, registrationTime - icpStatistics.filteringTime - icpStatistics.matchingTime);
+}
+
+PM::DataPoints Mapper::retainMapDescriptors(const PM::DataPoints& points)
+{
+	return retainMapDescriptors(points, mapDescriptors, mapReferenceDescriptors, computeProbDynamic);
+}
+
+PM::DataPoints Mapper::retainMapDescriptors(const PM::DataPoints& points, const std::vector<std::string>& mapDescriptors,
+											const std::vector<std::string>& mapReferenceDescriptors, bool computeProbDynamic)
+{
+	if(mapDescriptors.empty())
+	{
+		return points;
+	}
+	
+	return retainDescriptors(points, [&mapDescriptors, &mapReferenceDescriptors, computeProbDynamic](const std::string& descriptorName)
+	{
+		return std::find(mapDescriptors.begin(), mapDescriptors.end(), descriptorName) != mapDescriptors.end() ||
+			   std::find(mapReferenceDescriptors.begin(), mapReferenceDescriptors.end(), descriptorName) != mapReferenceDescriptors.end() ||
+			   (computeProbDynamic && descriptorName == "probabilityDynamic");
+	});
+}
+
+size_t Mapper::computeDescriptorBytesPerPoint(const PM::DataPoints& points)
+{
+	return points.descriptors.rows() * sizeof(T) + points.times.rows() * sizeof(std::int64_t);
+}
+
+PM::DataPoints Mapper::removeReferenceDescriptors(const PM::DataPoints& points)
+{
+	return removeReferenceDescriptors(points, mapReferenceDescriptors);
+}
+
+PM::DataPoints Mapper::removeReferenceDescriptors(const PM::DataPoints& points, const std::vector<std::string>& mapReferenceDescriptors)
+{
+	if(mapReferenceDescriptors.empty())
+	{
+		return points;
+	}
+	
+	return retainDescriptors(points, [&mapReferenceDescriptors](const std::string& descriptorName)
+	{
+		return std::find(mapReferenceDescriptors.begin(), mapReferenceDescriptors.end(), descriptorName) == mapReferenceDescriptors.end();
+	});
+}
+
+PM::DataPoints Mapper::retainDescriptors(const PM::DataPoints& points, const std::function<bool(const std::string&)>& isRetained)
+{
+	PM::DataPoints retainedPoints(points.features, points.featureLabels);
+	for(const PM::DataPoints::Label& descriptorLabel: points.descriptorLabels)
+	{
+		if(isRetained(descriptorLabel.text))
+		{
+			retainedPoints.addDescriptor(descriptorLabel.text, points.getDescriptorCopyByName(descriptorLabel.text));
+		}
+	}
+	for(const PM::DataPoints::Label& timeLabel: points.timeLabels)
+	{
+		if(isRetained(timeLabel.text))
+		{
+			retainedPoints.addTime(timeLabel.text, points.getTimeCopyByName(timeLabel.text));
+		}
+	}
+	return retainedPoints;
+}
+
+void Mapper::updateLikelihoodFieldStatistics(const LikelihoodFieldMatcher::Result& result, unsigned readingPointCount,
+											 const std::chrono::time_point<std::chrono::steady_clock>& registrationStartTime,
+											 const std::chrono::time_point<std::chrono::steady_clock>& registrationEndTime)
+{
+	icpStatistics.iterationCount = result.iterationCount;
+	icpStatistics.residual = result.residual;
+	icpStatistics.overlap = result.overlap;
+	icpStatistics.referencePointCount = result.referencePointCount;
+	icpStatistics.readingPointCount = readingPointCount;
+	
+	// the field replaces the matching step, so the whole registration is minimization
+	icpStatistics.filteringTime = 0;
+	icpStatistics.matchingTime = 0;
+	icpStatistics.minimizationTime = std::chrono::duration<float>(registrationEndTime - registrationStartTime).count();
+}
+
+float Mapper::computeResidual(const PM::ErrorMinimizer::ErrorElements& errorElements)
+{
+	const int euclideanDim = errorElements.reading.getEuclideanDim();
+	const PM::Matrix squaredDistances = (errorElements.reading.features.topRows(euclideanDim) -
+										 errorElements.reference.features.topRows(euclideanDim)).colwise().squaredNorm();
+	const float weightSum = errorElements.weights.row(0).sum();
+	return weightSum > 0 ? std::sqrt(squaredDistances.cwiseProduct(errorElements.weights.row(0)).sum() / weightSum) : 0;
+}
+
 PM::DataPoints Mapper::getMap()
 {
-	std::lock_guard<std::mutex> lock(mapLock);
+	return removeReferenceDescriptors(getChunkedMap().toDataPoints());
+}
+
+MapFile::Statistics Mapper::saveMap(const std::string& fileName, ThreadPool& threadPool)
+{
+	return MapFile::save(getChunkedMap(), fileName, threadPool, [this](const std::string& descriptorName)
+	{
+		return std::find(mapReferenceDescriptors.begin(), mapReferenceDescriptors.end(), descriptorName) == mapReferenceDescriptors.end();
+	});
+}
+
+ChunkedPointCloud Mapper::getChunkedMap()
+{
+	std::lock_guard<ProfiledMutex> lock(mapLock);
 	return map;
 }
 
@@ -354,39 +1163,235 @@ void Mapper::setMap(const PM::DataPoints& newMap, const PM::TransformationParame
 		throw std::runtime_error("compute prob dynamic is set to true, but field normals does not exist for map points.");
 	}
 	
-	PM::DataPoints cutMapInSensorFrame = transformation->compute(newMap, newSensorPose.inverse());
+	ChunkedPointCloud chunkedMap(retainMapDescriptors(newMap), MAP_CHUNK_CAPACITY);
+	if(chunkedMap.getChunkCount() > 0)
+	{
+		droppedDescriptorBytes += (computeDescriptorBytesPerPoint(newMap) - computeDescriptorBytesPerPoint(chunkedMap.getChunk(0))) * newMap.getNbPoints();
+	}
+	setMap(chunkedMap, newSensorPose);
+	rebuildOccupancyGrid(chunkedMap);
+	updateElevationGrid(chunkedMap, PM::DataPoints(), newSensorPose, true);
+}
+
+void Mapper::setMap(const ChunkedPointCloud& newMap, const PM::TransformationParameters& newSensorPose)
+{
+	int euclideanDim = is3D ? 3 : 2;
+	PM::DataPoints mapInRange = newMap.extract(newMap.findChunksInRange(newSensorPose.topRightCorner(euclideanDim, 1), sensorMaxRange));
+	PM::DataPoints cutMapInSensorFrame = transformation->compute(mapInRange, newSensorPose.inverse());
 	radiusFilter->inPlaceFilter(cutMapInSensorFrame);
 	PM::DataPoints cutMap = transformation->compute(cutMapInSensorFrame, newSensorPose);
 	
-	icpMapLock.lock();
-	icp.setMap(cutMap);
-	icpMapLock.unlock();
-	
+	setRegistrationReference(cutMap);
+	storeMap(newMap);
+}
+
+void Mapper::storeMap(const ChunkedPointCloud& newMap)
+{
 	mapLock.lock();
+	std::vector<unsigned> changedChunkIndexes = newMap.findChangedChunks(map);
+	if(!changedChunkIndexes.empty() || newMap.getChunkCount() != map.getChunkCount())
+	{
+		mapGeneration++;
+		if(mapHistorySize > 0)
+		{
+			mapHistory.push_back(changedChunkIndexes);
+			if(mapHistory.size() > mapHistorySize)
+			{
+				mapHistory.pop_front();
+			}
+		}
+	}
 	map = newMap;
 	newMapAvailable = true;
 	mapLock.unlock();
+	isCoarseMapOutdated = true;
+	
+	size_t featuresBytes = 0;
+	size_t descriptorsBytes = 0;
+	for(unsigned i = 0; i < newMap.getChunkCount(); i++)
+	{
+		const PM::DataPoints& chunk = newMap.getChunk(i);
+		featuresBytes += chunk.features.size() * sizeof(T);
+		descriptorsBytes += chunk.descriptors.size() * sizeof(T) + chunk.times.size() * sizeof(std::int64_t);
+	}
+	memoryAccountant.setBytes("map_features", featuresBytes);
+	memoryAccountant.setBytes("map_descriptors", descriptorsBytes);
+	
+	isMapEmpty = newMap.getPointCount() == 0;
+}
+
+void Mapper::setSharedMap(const std::shared_ptr<const SharedMap>& newSharedMap, const PM::TransformationParameters& newSensorPose, ThreadPool& threadPool)
+{
+	sharedMap = newSharedMap;
+	localReferenceThreadPool = &threadPool;
+	lastSensorPoseWhereMapWasUpdated = newSensorPose;
+	setLocalReference(newSensorPose);
+	isMapEmpty = sharedMap->getPointCount() == 0;
+}
+
+void Mapper::setShardedMap(const std::shared_ptr<ShardedMap>& newShardedMap, const PM::TransformationParameters& newSensorPose, ThreadPool& threadPool)
+{
+	shardedMap = newShardedMap;
+	localReferenceThreadPool = &threadPool;
+	lastSensorPoseWhereMapWasUpdated = newSensorPose;
+	setLocalReference(newSensorPose);
 	
-	isMapEmpty = newMap.getNbPoints() == 0;
+	// a session starting away from the mapped area begins its own part of the map
+	isMapEmpty = referencePointCount == 0;
 }
 
-bool Mapper::getNewMap(PM::DataPoints& mapOut)
+bool Mapper::getNewMap(PM::DataPoints& mapOut, std::uint64_t& generationOut)
 {
 	bool mapReturned = false;
 	
+	ChunkedPointCloud newMap(MAP_CHUNK_CAPACITY);
 	mapLock.lock();
 	if(newMapAvailable)
 	{
-		mapOut = map;
+		newMap = map;
+		generationOut = mapGeneration;
 		newMapAvailable = false;
 		mapReturned = true;
 	}
 	mapLock.unlock();
 	
+	if(mapReturned)
+	{
+		mapOut = removeReferenceDescriptors(newMap.toDataPoints());
+	}
 	return mapReturned;
 }
 
+std::uint64_t Mapper::getMapEpoch() const
+{
+	return mapEpoch;
+}
+
+void Mapper::enableMapHistory(unsigned historySize)
+{
+	std::lock_guard<ProfiledMutex> lock(mapLock);
+	mapHistorySize = historySize;
+	mapHistory.clear();
+}
+
+Mapper::MapDelta Mapper::getMapDelta(std::uint64_t sinceEpoch, std::uint64_t sinceGeneration)
+{
+	MapDelta delta;
+	ChunkedPointCloud currentMap(MAP_CHUNK_CAPACITY);
+	std::vector<bool> isChunkChanged;
+	mapLock.lock();
+	currentMap = map;
+	delta.epoch = mapEpoch;
+	delta.generation = mapGeneration;
+	delta.isFull = sinceEpoch != mapEpoch || sinceGeneration > mapGeneration || mapGeneration - sinceGeneration > mapHistory.size();
+	isChunkChanged.assign(currentMap.getChunkCount(), delta.isFull);
+	if(!delta.isFull)
+	{
+		for(size_t i = mapHistory.size() - (mapGeneration - sinceGeneration); i < mapHistory.size(); i++)
+		{
+			for(unsigned chunkIndex: mapHistory[i])
+			{
+				// chunks dropped since then are removed by the chunk count
+				if(chunkIndex < isChunkChanged.size())
+				{
+					isChunkChanged[chunkIndex] = true;
+				}
+			}
+		}
+	}
+	mapLock.unlock();
+	
+	delta.chunkCount = currentMap.getChunkCount();
+	for(unsigned i = 0; i < currentMap.getChunkCount(); i++)
+	{
+		if(isChunkChanged[i])
+		{
+			delta.chunkIndexes.push_back(i);
+			delta.chunks.push_back(removeReferenceDescriptors(currentMap.getChunk(i)));
+		}
+	}
+	return delta;
+}
+
 const PM::TransformationParameters& Mapper::getSensorPose()
 {
 	return sensorPose;
 }
+
+void Mapper::enableOccupancyGrid(float resolution, float minHeight, float maxHeight)
+{
+	occupancyGridLock.lock();
+	occupancyGrid = std::unique_ptr<OccupancyGrid>(new OccupancyGrid(resolution, is3D, minHeight, maxHeight));
+	occupancyGridLock.unlock();
+	
+	rebuildOccupancyGrid(getChunkedMap());
+}
+
+bool Mapper::getOccupancyGridChanges(OccupancyGrid::Patch& patch, bool isFullGridRequested)
+{
+	std::lock_guard<std::mutex> lock(occupancyGridLock);
+	return occupancyGrid && occupancyGrid->extractChanges(patch, isFullGridRequested);
+}
+
+void Mapper::enableElevationGrid(float resolution, float radius)
+{
+	elevationGridLock.lock();
+	elevationGrid = std::unique_ptr<ElevationGrid>(new ElevationGrid(resolution, radius));
+	elevationGridLock.unlock();
+	
+	updateElevationGrid(getChunkedMap(), PM::DataPoints(), sensorPose, true);
+}
+
+bool Mapper::getNewElevationGrid(PM::DataPoints& gridOut)
+{
+	std::lock_guard<std::mutex> lock(elevationGridLock);
+	if(!elevationGrid || !newElevationGridAvailable)
+	{
+		return false;
+	}
+	
+	gridOut = elevationGrid->toDataPoints();
+	newElevationGridAvailable = false;
+	return true;
+}
+
+unsigned Mapper::getMapPointCount()
+{
+	std::lock_guard<ProfiledMutex> lock(mapLock);
+	return map.getPointCount();
+}
+
+unsigned Mapper::getReferencePointCount()
+{
+	return referencePointCount;
+}
+
+size_t Mapper::getDroppedDescriptorBytes()
+{
+	return droppedDescriptorBytes;
+}
+
+Mapper::IcpStatistics Mapper::getIcpStatistics()
+{
+	return icpStatistics;
+}
+
+MemoryAccountant& Mapper::getMemoryAccountant()
+{
+	return memoryAccountant;
+}
+
+ProfiledMutex::Statistics Mapper::getMapLockStatistics()
+{
+	return mapLock.getStatistics();
+}
+
+ProfiledMutex::Statistics Mapper::getIcpMapLockStatistics()
+{
+	return icpMapLock.getStatistics();
+}
+
+size_t Mapper::computeMemoryFootprint(const PM::DataPoints& points)
+{
+	return points.features.size() * sizeof(T) + points.descriptors.size() * sizeof(T) + points.times.size() * sizeof(std::int64_t);
+}
@@ -1,20 +1,91 @@
+#include "MemoryAccountant.h"
+#include "ProfiledMutex.h"
+#include "ProfiledMatcher.h"
+#include "ThreadPool.h"
+#include "SharedMap.h"
+#include "ShardedMap.h"
+#include "ChunkedPointCloud.h"
+#include "LikelihoodFieldMatcher.h"
+#include "OccupancyGrid.h"
+#include "ElevationGrid.h"
+#include "MapFile.h"
 #include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <deque>
 #include <future>
+#include <functional>
+#include <mutex>
 
 typedef float T;
 typedef PointMatcher<T> PM;
 
 class Mapper
 {
+public:
+	struct IcpStatistics
+	{
+		unsigned iterationCount;
+		float residual;
+		float overlap;
+		unsigned referencePointCount;
+		unsigned readingPointCount;
+		float filteringTime;
+		float matchingTime;
+		// includes outlier rejection and transformation checks
+		float minimizationTime;
+		bool isKeyframeRegistration;
+	};
+	
+	struct RelocalizationResult
+	{
+		bool isSuccessful;
+		PM::TransformationParameters sensorPose;
+		float overlap;
+		float residual;
+		unsigned hypothesisCount;
+		unsigned evaluatedHypothesisCount;
+		// hypotheses whose registration did not converge, the message of the first one being kept
+		unsigned failedHypothesisCount;
+		std::string failureMessage;
+		float duration;
+	};
+	
+	// chunks to replace in the map of generation sinceGeneration to get the map of generation generation, the map being truncated to chunkCount chunks
+	struct MapDelta
+	{
+		std::uint64_t epoch;
+		std::uint64_t generation;
+		// the chunks are the whole map when the requested epoch is not that of the mapper or the requested generation is no longer in the history
+		bool isFull;
+		unsigned chunkCount;
+		std::vector<unsigned> chunkIndexes;
+		std::vector<PM::DataPoints> chunks;
+	};
+
 private:
 	PM::DataPointsFilters inputFilters;
 	PM::DataPointsFilters inputFiltersWorld;
 	PM::DataPointsFilters mapPostFilters;
 	PM::ICPSequence icp;
-	PM::DataPoints map;
+	PM::ICPSequence keyframeIcp;
+	ChunkedPointCloud map;
+	std::shared_ptr<const SharedMap> sharedMap;
+	std::shared_ptr<ShardedMap> shardedMap;
+	ThreadPool* localReferenceThreadPool;
+	PM::DataPoints coarseMap;
+	PM::ICPSequence coarseIcp;
+	PM::Vector coarseMapCenter;
+	float coarseMapRadius;
+	float coarseMapVoxelSize;
+	std::atomic_bool isCoarseMapOutdated;
 	PM::TransformationParameters sensorPose;
 	std::shared_ptr<PM::Transformation> transformation;
 	std::shared_ptr<PM::DataPointsFilter> radiusFilter;
+	std::shared_ptr<LikelihoodFieldMatcher> likelihoodField;
+	std::unique_ptr<OccupancyGrid> occupancyGrid;
+	std::mutex occupancyGridLock;
+	std::unique_ptr<ElevationGrid> elevationGrid;
+	std::mutex elevationGridLock;
 	std::chrono::time_point<std::chrono::steady_clock> lastTimeMapWasUpdated;
 	PM::TransformationParameters lastSensorPoseWhereMapWasUpdated;
 	std::string icpConfigFilePath;
@@ -34,22 +105,74 @@ private:
 	float epsilonD;
 	float alpha;
 	float beta;
+	int keyframeRegistrationPeriod;
+	float keyframeMinOverlap;
+	std::vector<std::string> mapDescriptors;
+	std::vector<std::string> mapReferenceDescriptors;
+	std::atomic<size_t> droppedDescriptorBytes;
 	bool is3D;
 	bool isOnline;
 	bool computeProbDynamic;
 	bool isMapping;
+	bool applyInputFilters;
 	bool newMapAvailable;
+	bool newElevationGridAvailable;
+	// start time of the mapper in nanoseconds, so that generations restarting at 0 after a restart are not mistaken for those of the previous run
+	const std::uint64_t mapEpoch;
+	std::uint64_t mapGeneration;
+	unsigned mapHistorySize;
+	// chunks changed by each of the last generations of the map, the last element being mapGeneration
+	std::deque<std::vector<unsigned>> mapHistory;
 	std::atomic_bool isMapEmpty;
-	std::mutex mapLock;
-	std::mutex icpMapLock;
+	std::atomic_uint referencePointCount;
+	std::shared_ptr<ProfiledMatcher> profiledMatcher;
+	std::shared_ptr<ProfiledMatcher> keyframeProfiledMatcher;
+	bool isKeyframeAvailable;
+	int scansSinceKeyframe;
+	IcpStatistics icpStatistics;
+	ProfiledMutex mapLock;
+	ProfiledMutex icpMapLock;
 	std::future<void> mapBuilderFuture;
+	MemoryAccountant memoryAccountant;
 	
 	bool shouldUpdateMap(const std::chrono::time_point<std::chrono::steady_clock>& currentTime, const PM::TransformationParameters& currentSensorPose,
 						 const float& currentOverlap);
 	
 	void updateMap(const PM::DataPoints& currentInput, const std::chrono::time_point<std::chrono::steady_clock>& timeStamp);
 	
-	void buildMap(PM::DataPoints currentInput, PM::DataPoints currentMap, PM::TransformationParameters currentSensorPose);
+	void buildMap(PM::DataPoints currentInput, ChunkedPointCloud currentMap, PM::TransformationParameters currentSensorPose);
+	
+	ChunkedPointCloud getChunkedMap();
+	
+	void setMap(const ChunkedPointCloud& newMap, const PM::TransformationParameters& newSensorPose);
+	
+	void storeMap(const ChunkedPointCloud& newMap);
+	
+	void setRegistrationReference(const PM::DataPoints& reference);
+	
+	bool addRegistrationReferencePoints(const PM::DataPoints& points);
+	
+	void rebuildOccupancyGrid(const ChunkedPointCloud& currentMap);
+	
+	void addToOccupancyGrid(const PM::DataPoints& points);
+	
+	void clearDynamicPointsFromOccupancyGrid(const PM::DataPoints& previousPoints, const PM::DataPoints& currentPoints);
+	
+	std::vector<bool> findStaticPoints(const PM::DataPoints& points);
+	
+	// the map must not contain the new points yet, since it is used to fill the cells entering the window
+	void updateElevationGrid(const ChunkedPointCloud& currentMap, const PM::DataPoints& newPoints, const PM::TransformationParameters& currentSensorPose,
+							 bool isCleared);
+	
+	void insertIntoShardedMap(PM::DataPoints currentInput, PM::TransformationParameters currentSensorPose);
+	
+	// returns the number of input points inserted in the shard
+	unsigned updateShard(const PM::DataPoints& currentInput, const PM::DataPoints& shardInput, PM::DataPoints& shardPoints,
+						 const PM::TransformationParameters& currentSensorPose);
+	
+	void updateLocalReferenceIfNeeded();
+	
+	void setLocalReference(const PM::TransformationParameters& currentSensorPose);
 	
 	PM::DataPoints retrievePointsFurtherThanMinDistNewPoint(const PM::DataPoints& currentInput, const PM::DataPoints& currentMap,
 															const PM::TransformationParameters& currentSensorPose);
@@ -58,23 +181,112 @@ private:
 												const PM::TransformationParameters& currentSensorPose);
 	
 	void convertToSphericalCoordinates(const PM::DataPoints& points, PM::Matrix& radii, PM::Matrix& angles);
+	
+	void loadIcpConfig(PM::ICPSequence& registration);
+	
+	void setKeyframe(const PM::DataPoints& newKeyframe);
+	
+	PM::DataPoints retainMapDescriptors(const PM::DataPoints& points);
+	
+	static size_t computeDescriptorBytesPerPoint(const PM::DataPoints& points);
+	
+	PM::DataPoints removeReferenceDescriptors(const PM::DataPoints& points);
+	
+	static PM::DataPoints retainDescriptors(const PM::DataPoints& points, const std::function<bool(const std::string&)>& isRetained);
+	
+	void updateCoarseMap(float voxelSize, const PM::Vector& center, float radius);
+	
+	PM::TransformationParameters refineRelocalization(const PM::DataPoints& inputInSensorFrame, const PM::TransformationParameters& coarseSensorPose);
+	
+	static float computeResidual(const PM::ErrorMinimizer::ErrorElements& errorElements);
+	
+	unsigned retrieveIcpIterationCount(const PM::ICPSequence& registration);
+	
+	void updateIcpStatistics(const PM::ICPSequence& registration, const ProfiledMatcher& matcher,
+							 const std::chrono::time_point<std::chrono::steady_clock>& registrationStartTime,
+							 const std::chrono::time_point<std::chrono::steady_clock>& registrationEndTime);
+	
+	void updateLikelihoodFieldStatistics(const LikelihoodFieldMatcher::Result& result, unsigned readingPointCount,
+										 const std::chrono::time_point<std::chrono::steady_clock>& registrationStartTime,
+										 const std::chrono::time_point<std::chrono::steady_clock>& registrationEndTime);
 
 public:
 	Mapper(std::string icpConfigFilePath, std::string inputFiltersConfigFilePath, std::string inputFiltersWorldFilePath, std::string mapPostFiltersConfigFilePath, std::string mapUpdateCondition,
 		   float mapUpdateOverlap, float mapUpdateDelay, float mapUpdateDistance, float minDistNewPoint, float sensorMaxRange,
 		   float priorDynamic, float thresholdDynamic, float beamHalfAngle, float epsilonA, float epsilonD, float alpha, float beta,
-		   bool is3D, bool isOnline, bool computeProbDynamic, bool isMapping);
+		   int keyframeRegistrationPeriod, float keyframeMinOverlap, std::vector<std::string> mapDescriptors, std::vector<std::string> mapReferenceDescriptors,
+		   std::string registrationMethod, float likelihoodFieldResolution, float likelihoodFieldMaxDistance, bool is3D, bool isOnline, bool computeProbDynamic,
+		   bool isMapping, bool applyInputFilters);
 	
 	void loadYamlConfig();
 	
+	// when applyInputFilters is true, applies the sensor range and the input filters, which do not depend on the sensor pose, so that it can run before the
+	// previous input is registered
+	void preprocessInput(PM::DataPoints& inputInSensorFrame);
+	
+	// the input must have been preprocessed with preprocessInput
 	void processInput(PM::DataPoints& inputInSensorFrame, const PM::TransformationParameters& estimatedSensorPose,
 					  const std::chrono::time_point<std::chrono::steady_clock>& timeStamp);
 	
+	// the input must have been preprocessed with preprocessInput, and no hypothesis is started after timeBound, the coarse map update, the hypotheses being
+	// evaluated at that time and the refinement of the best one not being interrupted. Hypotheses that do not converge are failed ones, and other errors
+	// are thrown.
+	RelocalizationResult relocalize(const PM::DataPoints& inputInSensorFrame, const std::vector<PM::TransformationParameters>& candidateSensorPoses,
+									float coarseVoxelSize, float minOverlap, float timeBound, ThreadPool& threadPool);
+	
 	PM::DataPoints getMap();
 	
+	// writes a snapshot of the map chunk by chunk, without copying it
+	MapFile::Statistics saveMap(const std::string& fileName, ThreadPool& threadPool);
+	
 	void setMap(const PM::DataPoints& newMap, const PM::TransformationParameters& newSensorPose);
 	
-	bool getNewMap(PM::DataPoints& mapOut);
+	void setSharedMap(const std::shared_ptr<const SharedMap>& newSharedMap, const PM::TransformationParameters& newSensorPose, ThreadPool& threadPool);
+	
+	void setShardedMap(const std::shared_ptr<ShardedMap>& newShardedMap, const PM::TransformationParameters& newSensorPose, ThreadPool& threadPool);
+	
+	bool getNewMap(PM::DataPoints& mapOut, std::uint64_t& generationOut);
+	
+	std::uint64_t getMapEpoch() const;
+	
+	// keeps the chunks changed by the last historySize generations of the map, so that getMapDelta returns only them
+	void enableMapHistory(unsigned historySize);
+	
+	MapDelta getMapDelta(std::uint64_t sinceEpoch, std::uint64_t sinceGeneration);
+	
+	void enableOccupancyGrid(float resolution, float minHeight, float maxHeight);
+	
+	// returns false when no cell changed since the last call and the full grid is not requested
+	bool getOccupancyGridChanges(OccupancyGrid::Patch& patch, bool isFullGridRequested);
+	
+	void enableElevationGrid(float resolution, float radius);
+	
+	bool getNewElevationGrid(PM::DataPoints& gridOut);
 	
 	const PM::TransformationParameters& getSensorPose();
+	
+	unsigned getMapPointCount();
+	
+	unsigned getReferencePointCount();
+	
+	// bytes of the descriptors and times dropped by map_descriptors from the points inserted in the map since the start
+	size_t getDroppedDescriptorBytes();
+	
+	IcpStatistics getIcpStatistics();
+	
+	MemoryAccountant& getMemoryAccountant();
+	
+	ProfiledMutex::Statistics getMapLockStatistics();
+	
+	ProfiledMutex::Statistics getIcpMapLockStatistics();
+	
+	static size_t computeMemoryFootprint(const PM::DataPoints& points);
+	
+	// keeps the descriptors and times listed in mapDescriptors or mapReferenceDescriptors, and probabilityDynamic when it is computed, all of them when
+	// mapDescriptors is empty
+	static PM::DataPoints retainMapDescriptors(const PM::DataPoints& points, const std::vector<std::string>& mapDescriptors,
+											   const std::vector<std::string>& mapReferenceDescriptors, bool computeProbDynamic);
+	
+	// removes the descriptors only kept in the map for registration, before it is published or saved
+	static PM::DataPoints removeReferenceDescriptors(const PM::DataPoints& points, const std::vector<std::string>& mapReferenceDescriptors);
 };
@@ -0,0 +1,78 @@
+#include "MemoryAccountant.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+MemoryAccountant::Component& MemoryAccountant::retrieveComponent(const std::string& name)
+{
+	std::map<std::string, Component>::iterator it = components.find(name);
+	if(it == components.end())
+	{
+		Component component = {name, 0, 0};
+		it = components.insert(std::make_pair(name, component)).first;
+	}
+	return it->second;
+}
+
+void MemoryAccountant::setBytes(const std::string& name, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(componentsLock);
+	Component& component = retrieveComponent(name);
+	component.bytes = bytes;
+	component.highWaterMark = std::max(component.highWaterMark, bytes);
+}
+
+void MemoryAccountant::addBytes(const std::string& name, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(componentsLock);
+	Component& component = retrieveComponent(name);
+	component.bytes += bytes;
+	component.highWaterMark = std::max(component.highWaterMark, component.bytes);
+}
+
+void MemoryAccountant::removeBytes(const std::string& name, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(componentsLock);
+	Component& component = retrieveComponent(name);
+	component.bytes -= std::min(component.bytes, bytes);
+}
+
+std::vector<MemoryAccountant::Component> MemoryAccountant::getComponents()
+{
+	std::lock_guard<std::mutex> lock(componentsLock);
+	std::vector<Component> componentsOut;
+	for(std::map<std::string, Component>::const_iterator it = components.begin(); it != components.end(); ++it)
+	{
+		componentsOut.push_back(it->second);
+	}
+	return componentsOut;
+}
+
+MemoryAccountant::ProcessMemory MemoryAccountant::getProcessMemory()
+{
+	ProcessMemory processMemory = {0, 0};
+	
+	std::ifstream ifs("/proc/self/status");
+	std::string line;
+	while(std::getline(ifs, line))
+	{
+		std::stringstream lineStream(line);
+		std::string field;
+		size_t kiloBytes;
+		if(!(lineStream >> field >> kiloBytes))
+		{
+			continue;
+		}
+		
+		if(field == "VmRSS:")
+		{
+			processMemory.residentBytes = kiloBytes * 1024;
+		}
+		else if(field == "VmHWM:")
+		{
+			processMemory.residentHighWaterMark = kiloBytes * 1024;
+		}
+	}
+	
+	return processMemory;
+}
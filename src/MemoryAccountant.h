@@ -0,0 +1,43 @@
+#ifndef MEMORY_ACCOUNTANT_H
+#define MEMORY_ACCOUNTANT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class MemoryAccountant
+{
+public:
+	struct Component
+	{
+		std::string name;
+		size_t bytes;
+		size_t highWaterMark;
+	};
+	
+	struct ProcessMemory
+	{
+		size_t residentBytes;
+		size_t residentHighWaterMark;
+	};
+	
+private:
+	std::map<std::string, Component> components;
+	std::mutex componentsLock;
+	
+	Component& retrieveComponent(const std::string& name);
+	
+public:
+	void setBytes(const std::string& name, size_t bytes);
+	
+	void addBytes(const std::string& name, size_t bytes);
+	
+	void removeBytes(const std::string& name, size_t bytes);
+	
+	std::vector<Component> getComponents();
+	
+	static ProcessMemory getProcessMemory();
+};
+
+#endif
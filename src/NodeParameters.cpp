@@ -1,5 +1,7 @@
 #include "NodeParameters.h"
 #include <fstream>
+#include <algorithm>
+#include <sstream>
 
 NodeParameters::NodeParameters(ros::NodeHandle privateNodeHandle)
 {
@@ -12,9 +14,12 @@ void NodeParameters::retrieveParameters(const ros::NodeHandle& nodeHandle)
 {
 	nodeHandle.param<std::string>("odom_frame", odomFrame, "odom");
 	nodeHandle.param<std::string>("sensor_frame", sensorFrame, "velodyne");
+	nodeHandle.param<std::string>("sensor_frames", sensorFramesString, "");
+	nodeHandle.param<std::string>("sensor_input_filters_configs", sensorInputFiltersConfigsString, "");
 	nodeHandle.param<std::string>("robot_frame", robotFrame, "base_link");
 	nodeHandle.param<std::string>("initial_map_file_name", initialMapFileName, "");
 	nodeHandle.param<std::string>("initial_map_pose", initialMapPoseString, "[[1, 0, 0, 0], [0, 1, 0, 0], [0, 0, 1, 0], [0, 0, 0, 1]]");
+	nodeHandle.param<float>("initial_map_radius", initialMapRadius, 0);
 	nodeHandle.param<std::string>("final_map_file_name", finalMapFileName, "map.vtk");
 	nodeHandle.param<std::string>("icp_config", icpConfig, "");
 	nodeHandle.param<std::string>("input_filters_config", inputFiltersConfig, "");
@@ -25,7 +30,18 @@ void NodeParameters::retrieveParameters(const ros::NodeHandle& nodeHandle)
 	nodeHandle.param<float>("map_update_delay", mapUpdateDelay, 1);
 	nodeHandle.param<float>("map_update_distance", mapUpdateDistance, 0.5);
 	nodeHandle.param<float>("map_publish_rate", mapPublishRate, 10);
+	nodeHandle.param<bool>("publish_quantized_map", publishQuantizedMap, false);
+	nodeHandle.param<int>("map_history_size", mapHistorySize, 100);
 	nodeHandle.param<float>("map_tf_publish_rate", mapTfPublishRate, 10);
+	nodeHandle.param<float>("occupancy_grid_publish_rate", occupancyGridPublishRate, 0);
+	nodeHandle.param<bool>("occupancy_grid_publish_updates", occupancyGridPublishUpdates, true);
+	nodeHandle.param<float>("occupancy_grid_resolution", occupancyGridResolution, 0.05);
+	nodeHandle.param<float>("occupancy_grid_min_height", occupancyGridMinHeight, 0.1);
+	nodeHandle.param<float>("occupancy_grid_max_height", occupancyGridMaxHeight, 2);
+	nodeHandle.param<float>("elevation_grid_publish_rate", elevationGridPublishRate, 0);
+	nodeHandle.param<float>("elevation_grid_resolution", elevationGridResolution, 0.2);
+	nodeHandle.param<float>("elevation_grid_radius", elevationGridRadius, 20);
+	nodeHandle.param<float>("sensor_sync_tolerance", sensorSyncTolerance, 0.05);
 	nodeHandle.param<float>("max_idle_time", maxIdleTime, 10);
 	nodeHandle.param<float>("min_dist_new_point", minDistNewPoint, 0.03);
 	nodeHandle.param<float>("sensor_max_range", sensorMaxRange, 80);
@@ -36,9 +52,37 @@ void NodeParameters::retrieveParameters(const ros::NodeHandle& nodeHandle)
 	nodeHandle.param<float>("epsilon_d", epsilonD, 0.01);
 	nodeHandle.param<float>("alpha", alpha, 0.8);
 	nodeHandle.param<float>("beta", beta, 0.99);
+	nodeHandle.param<int>("keyframe_registration_period", keyframeRegistrationPeriod, 1);
+	nodeHandle.param<float>("keyframe_min_overlap", keyframeMinOverlap, 0.5);
+	nodeHandle.param<std::string>("map_descriptors", mapDescriptorsString, "");
+	nodeHandle.param<std::string>("map_reference_descriptors", mapReferenceDescriptorsString, "");
+	nodeHandle.param<std::string>("quantized_map_descriptors", quantizedMapDescriptorsString, "");
+	nodeHandle.param<std::string>("registration_method", registrationMethod, "icp");
+	nodeHandle.param<float>("likelihood_field_resolution", likelihoodFieldResolution, 0.05);
+	nodeHandle.param<float>("likelihood_field_max_distance", likelihoodFieldMaxDistance, 0.5);
+	nodeHandle.param<float>("relocalization_overlap_threshold", relocalizationOverlapThreshold, 0);
+	nodeHandle.param<float>("relocalization_min_overlap", relocalizationMinOverlap, 0.6);
+	nodeHandle.param<float>("relocalization_radius", relocalizationRadius, 2);
+	nodeHandle.param<float>("relocalization_translation_step", relocalizationTranslationStep, 0.5);
+	nodeHandle.param<float>("relocalization_yaw_range", relocalizationYawRange, 0.8);
+	nodeHandle.param<float>("relocalization_yaw_step", relocalizationYawStep, 0.2);
+	nodeHandle.param<float>("relocalization_voxel_size", relocalizationVoxelSize, 0.5);
+	nodeHandle.param<float>("relocalization_time_bound", relocalizationTimeBound, 0.3);
+	nodeHandle.param<int>("worker_thread_count", workerThreadCount, 0);
+	nodeHandle.param<std::string>("localization_sessions", localizationSessionsString, "");
+	nodeHandle.param<float>("shared_map_tile_size", sharedMapTileSize, 20);
+	nodeHandle.param<float>("latency_deadline", latencyDeadline, 0);
+	nodeHandle.param<float>("max_overrun_rate", maxOverrunRate, 0.1);
+	nodeHandle.param<int>("overrun_window_size", overrunWindowSize, 100);
+	nodeHandle.param<float>("diagnostics_publish_rate", diagnosticsPublishRate, 1);
+	nodeHandle.param<float>("stationary_translation_threshold", stationaryTranslationThreshold, 0.01);
+	nodeHandle.param<float>("stationary_rotation_threshold", stationaryRotationThreshold, 0.01);
+	nodeHandle.param<float>("stationary_delay", stationaryDelay, 2);
+	nodeHandle.param<int>("stationary_registration_period", stationaryRegistrationPeriod, 1);
 	nodeHandle.param<bool>("is_3D", is3D, true);
 	nodeHandle.param<bool>("is_online", isOnline, true);
 	nodeHandle.param<bool>("compute_prob_dynamic", computeProbDynamic, false);
+	nodeHandle.param<bool>("apply_input_filters", applyInputFilters, false);
 	nodeHandle.param<bool>("is_mapping", isMapping, true);
 }
 
@@ -54,6 +98,11 @@ void NodeParameters::validateParameters()
 		ifs.close();
 	}
 	
+	if(initialMapRadius < 0)
+	{
+		throw std::runtime_error("Invalid initial map radius: " + std::to_string(initialMapRadius));
+	}
+	
 	if(!isOnline)
 	{
 		std::ofstream ofs(finalMapFileName.c_str(), std::ios_base::app);
@@ -93,7 +142,7 @@ void NodeParameters::validateParameters()
 		}
 		ifs.close();
 	}
-
+	
 	if(!mapPostFiltersConfig.empty())
 	{
 		std::ifstream ifs(mapPostFiltersConfig.c_str());
@@ -104,6 +153,31 @@ void NodeParameters::validateParameters()
 		ifs.close();
 	}
 	
+	for(const std::string& sensorInputFiltersConfig: sensorInputFiltersConfigs)
+	{
+		std::ifstream ifs(sensorInputFiltersConfig.c_str());
+		if(!ifs.good())
+		{
+			throw std::runtime_error("Invalid sensor input filters config file: " + sensorInputFiltersConfig);
+		}
+		ifs.close();
+	}
+	
+	if(!sensorInputFiltersConfigs.empty() && sensorInputFiltersConfigs.size() != sensorFrames.size())
+	{
+		throw std::runtime_error("The number of sensor input filters configs does not match the number of sensor frames.");
+	}
+	
+	if(sensorSyncTolerance < 0)
+	{
+		throw std::runtime_error("Invalid sensor sync tolerance: " + std::to_string(sensorSyncTolerance));
+	}
+	
+	if(sensorFrames.size() > 1 && computeProbDynamic)
+	{
+		throw std::runtime_error("compute prob dynamic is set to true, but it is not supported with multiple sensors.");
+	}
+	
 	if(mapUpdateCondition != "overlap" && mapUpdateCondition != "delay" && mapUpdateCondition != "distance")
 	{
 		throw std::runtime_error("Invalid map update condition: " + mapUpdateCondition);
@@ -129,11 +203,51 @@ void NodeParameters::validateParameters()
 		throw std::runtime_error("Invalid map publish rate: " + std::to_string(mapPublishRate));
 	}
 	
+	if(mapHistorySize < 0)
+	{
+		throw std::runtime_error("Invalid map history size: " + std::to_string(mapHistorySize));
+	}
+	
 	if(mapTfPublishRate <= 0)
 	{
 		throw std::runtime_error("Invalid map tf publish rate: " + std::to_string(mapTfPublishRate));
 	}
 	
+	if(occupancyGridPublishRate < 0)
+	{
+		throw std::runtime_error("Invalid occupancy grid publish rate: " + std::to_string(occupancyGridPublishRate));
+	}
+	
+	if(occupancyGridResolution <= 0)
+	{
+		throw std::runtime_error("Invalid occupancy grid resolution: " + std::to_string(occupancyGridResolution));
+	}
+	
+	if(occupancyGridMinHeight >= occupancyGridMaxHeight)
+	{
+		throw std::runtime_error("Occupancy grid min height must be lower than occupancy grid max height.");
+	}
+	
+	if(elevationGridPublishRate < 0)
+	{
+		throw std::runtime_error("Invalid elevation grid publish rate: " + std::to_string(elevationGridPublishRate));
+	}
+	
+	if(elevationGridPublishRate > 0 && !is3D)
+	{
+		throw std::runtime_error("The elevation grid is only available in 3D.");
+	}
+	
+	if(elevationGridResolution <= 0)
+	{
+		throw std::runtime_error("Invalid elevation grid resolution: " + std::to_string(elevationGridResolution));
+	}
+	
+	if(elevationGridRadius <= 0)
+	{
+		throw std::runtime_error("Invalid elevation grid radius: " + std::to_string(elevationGridRadius));
+	}
+	
 	if(!isOnline)
 	{
 		if(maxIdleTime < 0)
@@ -187,6 +301,137 @@ void NodeParameters::validateParameters()
 		throw std::runtime_error("Invalid beta: " + std::to_string(beta));
 	}
 	
+	if(keyframeRegistrationPeriod <= 0)
+	{
+		throw std::runtime_error("Invalid keyframe registration period: " + std::to_string(keyframeRegistrationPeriod));
+	}
+	
+	if(keyframeMinOverlap < 0 || keyframeMinOverlap > 1)
+	{
+		throw std::runtime_error("Invalid keyframe min overlap: " + std::to_string(keyframeMinOverlap));
+	}
+	
+	if(registrationMethod != "icp" && registrationMethod != "likelihood_field")
+	{
+		throw std::runtime_error("Invalid registration method: " + registrationMethod);
+	}
+	
+	if(registrationMethod == "likelihood_field" && is3D)
+	{
+		throw std::runtime_error("The likelihood field registration method is only available in 2D.");
+	}
+	
+	if(likelihoodFieldResolution <= 0)
+	{
+		throw std::runtime_error("Invalid likelihood field resolution: " + std::to_string(likelihoodFieldResolution));
+	}
+	
+	if(likelihoodFieldMaxDistance <= 0)
+	{
+		throw std::runtime_error("Invalid likelihood field max distance: " + std::to_string(likelihoodFieldMaxDistance));
+	}
+	
+	if(relocalizationOverlapThreshold < 0 || relocalizationOverlapThreshold > 1)
+	{
+		throw std::runtime_error("Invalid relocalization overlap threshold: " + std::to_string(relocalizationOverlapThreshold));
+	}
+	
+	if(relocalizationMinOverlap < 0 || relocalizationMinOverlap > 1)
+	{
+		throw std::runtime_error("Invalid relocalization min overlap: " + std::to_string(relocalizationMinOverlap));
+	}
+	
+	if(relocalizationRadius < 0)
+	{
+		throw std::runtime_error("Invalid relocalization radius: " + std::to_string(relocalizationRadius));
+	}
+	
+	if(relocalizationTranslationStep <= 0)
+	{
+		throw std::runtime_error("Invalid relocalization translation step: " + std::to_string(relocalizationTranslationStep));
+	}
+	
+	if(relocalizationYawRange < 0 || relocalizationYawRange > M_PI)
+	{
+		throw std::runtime_error("Invalid relocalization yaw range: " + std::to_string(relocalizationYawRange));
+	}
+	
+	if(relocalizationYawStep <= 0)
+	{
+		throw std::runtime_error("Invalid relocalization yaw step: " + std::to_string(relocalizationYawStep));
+	}
+	
+	if(relocalizationVoxelSize <= 0)
+	{
+		throw std::runtime_error("Invalid relocalization voxel size: " + std::to_string(relocalizationVoxelSize));
+	}
+	
+	if(relocalizationTimeBound <= 0)
+	{
+		throw std::runtime_error("Invalid relocalization time bound: " + std::to_string(relocalizationTimeBound));
+	}
+	
+	if(workerThreadCount < 0)
+	{
+		throw std::runtime_error("Invalid worker thread count: " + std::to_string(workerThreadCount));
+	}
+	
+	if(sharedMapTileSize <= 0)
+	{
+		throw std::runtime_error("Invalid shared map tile size: " + std::to_string(sharedMapTileSize));
+	}
+	
+	if(latencyDeadline < 0)
+	{
+		throw std::runtime_error("Invalid latency deadline: " + std::to_string(latencyDeadline));
+	}
+	
+	if(maxOverrunRate < 0 || maxOverrunRate > 1)
+	{
+		throw std::runtime_error("Invalid max overrun rate: " + std::to_string(maxOverrunRate));
+	}
+	
+	if(overrunWindowSize <= 0)
+	{
+		throw std::runtime_error("Invalid overrun window size: " + std::to_string(overrunWindowSize));
+	}
+	
+	if(diagnosticsPublishRate <= 0)
+	{
+		throw std::runtime_error("Invalid diagnostics publish rate: " + std::to_string(diagnosticsPublishRate));
+	}
+	
+	if(stationaryTranslationThreshold < 0)
+	{
+		throw std::runtime_error("Invalid stationary translation threshold: " + std::to_string(stationaryTranslationThreshold));
+	}
+	
+	if(stationaryRotationThreshold < 0)
+	{
+		throw std::runtime_error("Invalid stationary rotation threshold: " + std::to_string(stationaryRotationThreshold));
+	}
+	
+	if(stationaryDelay < 0)
+	{
+		throw std::runtime_error("Invalid stationary delay: " + std::to_string(stationaryDelay));
+	}
+	
+	if(stationaryRegistrationPeriod <= 0)
+	{
+		throw std::runtime_error("Invalid stationary registration period: " + std::to_string(stationaryRegistrationPeriod));
+	}
+	
+	if(computeProbDynamic && !mapDescriptors.empty() && std::find(mapDescriptors.begin(), mapDescriptors.end(), "normals") == mapDescriptors.end() &&
+	   std::find(mapReferenceDescriptors.begin(), mapReferenceDescriptors.end(), "normals") == mapReferenceDescriptors.end())
+	{
+		throw std::runtime_error("compute prob dynamic is set to true, but normals are not part of the map descriptors.");
+	}
+	
+	if(computeProbDynamic && std::find(mapReferenceDescriptors.begin(), mapReferenceDescriptors.end(), "normals") != mapReferenceDescriptors.end())
+	{
+		throw std::runtime_error("compute prob dynamic is set to true, but normals are a map reference descriptor, so that saved maps could not be reloaded.");
+	}
+	
 	if(!isMapping && initialMapFileName.empty())
 	{
 		throw std::runtime_error("is mapping is set to false, but initial map file name was not specified.");
@@ -196,6 +441,7 @@ void NodeParameters::validateParameters()
 void NodeParameters::parseComplexParameters()
 {
 	parseInitialMapPose();
+	parseSensors();
 }
 
 void NodeParameters::parseInitialMapPose()
@@ -232,3 +478,37 @@ void NodeParameters::parseInitialMapPose()
 		}
 	}
 }
+
+void NodeParameters::parseSensors()
+{
+	sensorFrames = parseList(sensorFramesString);
+	if(sensorFrames.empty())
+	{
+		sensorFrames.push_back(sensorFrame);
+	}
+	sensorFrame = sensorFrames[0];
+	
+	sensorInputFiltersConfigs = parseList(sensorInputFiltersConfigsString);
+	
+	localizationSessions = parseList(localizationSessionsString);
+	
+	mapDescriptors = parseList(mapDescriptorsString);
+	mapReferenceDescriptors = parseList(mapReferenceDescriptorsString);
+	quantizedMapDescriptors = parseList(quantizedMapDescriptorsString);
+}
+
+std::vector<std::string> NodeParameters::parseList(std::string listString)
+{
+	listString.erase(std::remove(listString.begin(), listString.end(), '['), listString.end());
+	listString.erase(std::remove(listString.begin(), listString.end(), ']'), listString.end());
+	std::replace(listString.begin(), listString.end(), ',', ' ');
+	
+	std::vector<std::string> list;
+	std::string element;
+	std::stringstream listStream(listString);
+	while(listStream >> element)
+	{
+		list.push_back(element);
+	}
+	return list;
+}
@@ -14,14 +14,23 @@ private:
 	void parseComplexParameters();
 	
 	void parseInitialMapPose();
-
+	
+	void parseSensors();
+	
+	std::vector<std::string> parseList(std::string listString);
+	
 public:
 	std::string odomFrame;
 	std::string sensorFrame;
+	std::string sensorFramesString;
+	std::vector<std::string> sensorFrames;
+	std::string sensorInputFiltersConfigsString;
+	std::vector<std::string> sensorInputFiltersConfigs;
 	std::string robotFrame;
 	std::string initialMapFileName;
 	std::string initialMapPoseString;
 	PM::TransformationParameters initialMapPose;
+	float initialMapRadius;
 	std::string finalMapFileName;
 	std::string icpConfig;
 	std::string inputFiltersConfig;
@@ -32,7 +41,18 @@ public:
 	float mapUpdateDelay;
 	float mapUpdateDistance;
 	float mapPublishRate;
+	bool publishQuantizedMap;
+	int mapHistorySize;
 	float mapTfPublishRate;
+	float occupancyGridPublishRate;
+	bool occupancyGridPublishUpdates;
+	float occupancyGridResolution;
+	float occupancyGridMinHeight;
+	float occupancyGridMaxHeight;
+	float elevationGridPublishRate;
+	float elevationGridResolution;
+	float elevationGridRadius;
+	float sensorSyncTolerance;
 	float maxIdleTime;
 	float minDistNewPoint;
 	float sensorMaxRange;
@@ -43,9 +63,41 @@ public:
 	float epsilonD;
 	float alpha;
 	float beta;
+	int keyframeRegistrationPeriod;
+	float keyframeMinOverlap;
+	std::string mapDescriptorsString;
+	std::vector<std::string> mapDescriptors;
+	std::string mapReferenceDescriptorsString;
+	std::vector<std::string> mapReferenceDescriptors;
+	std::string quantizedMapDescriptorsString;
+	std::vector<std::string> quantizedMapDescriptors;
+	std::string registrationMethod;
+	float likelihoodFieldResolution;
+	float likelihoodFieldMaxDistance;
+	float relocalizationOverlapThreshold;
+	float relocalizationMinOverlap;
+	float relocalizationRadius;
+	float relocalizationTranslationStep;
+	float relocalizationYawRange;
+	float relocalizationYawStep;
+	float relocalizationVoxelSize;
+	float relocalizationTimeBound;
+	int workerThreadCount;
+	std::string localizationSessionsString;
+	std::vector<std::string> localizationSessions;
+	float sharedMapTileSize;
+	float latencyDeadline;
+	float maxOverrunRate;
+	int overrunWindowSize;
+	float diagnosticsPublishRate;
+	float stationaryTranslationThreshold;
+	float stationaryRotationThreshold;
+	float stationaryDelay;
+	int stationaryRegistrationPeriod;
 	bool is3D;
 	bool isOnline;
 	bool computeProbDynamic;
+	bool applyInputFilters;
 	bool isMapping;
 	
 	NodeParameters(ros::NodeHandle privateNodeHandle);
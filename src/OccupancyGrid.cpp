@@ -0,0 +1,199 @@
+#include "OccupancyGrid.h"
+#include <algorithm>
+#include <cmath>
+
+const std::int8_t UNKNOWN_CELL = -1;
+const std::int8_t FREE_CELL = 0;
+const std::int8_t OCCUPIED_CELL = 100;
+
+// cells added around a point outside the grid, so that the grid is not reallocated for every new point at its border
+const int GROWTH_MARGIN = 128;
+
+OccupancyGrid::OccupancyGrid(float resolution, bool is3D, float minHeight, float maxHeight):
+		resolution(resolution),
+		is3D(is3D),
+		minHeight(minHeight),
+		maxHeight(maxHeight),
+		originCellX(0),
+		originCellY(0),
+		width(0),
+		height(0),
+		isResized(false),
+		changedMinX(0),
+		changedMinY(0),
+		changedMaxX(-1),
+		changedMaxY(-1)
+{
+}
+
+bool OccupancyGrid::retrieveCellIndex(const Eigen::Ref<const PM::Vector>& point, bool isGrowthAllowed, int& cellIndex)
+{
+	if(is3D && (point(2) < minHeight || point(2) > maxHeight))
+	{
+		return false;
+	}
+	
+	int cellX = std::floor(point(0) / resolution) - originCellX;
+	int cellY = std::floor(point(1) / resolution) - originCellY;
+	if(cellX < 0 || cellX >= width || cellY < 0 || cellY >= height)
+	{
+		if(!isGrowthAllowed)
+		{
+			return false;
+		}
+		
+		growToInclude(cellX + originCellX, cellY + originCellY);
+		cellX = std::floor(point(0) / resolution) - originCellX;
+		cellY = std::floor(point(1) / resolution) - originCellY;
+	}
+	
+	cellIndex = cellY * width + cellX;
+	return true;
+}
+
+void OccupancyGrid::growToInclude(int cellX, int cellY)
+{
+	int newOriginCellX = cellX - GROWTH_MARGIN;
+	int newOriginCellY = cellY - GROWTH_MARGIN;
+	int newEndCellX = cellX + GROWTH_MARGIN + 1;
+	int newEndCellY = cellY + GROWTH_MARGIN + 1;
+	if(width > 0)
+	{
+		newOriginCellX = std::min(newOriginCellX, originCellX);
+		newOriginCellY = std::min(newOriginCellY, originCellY);
+		newEndCellX = std::max(newEndCellX, originCellX + width);
+		newEndCellY = std::max(newEndCellY, originCellY + height);
+	}
+	const int newWidth = newEndCellX - newOriginCellX;
+	const int newHeight = newEndCellY - newOriginCellY;
+	
+	std::vector<std::uint32_t> newHitCounts(newWidth * newHeight, 0);
+	std::vector<std::int8_t> newCells(newWidth * newHeight, UNKNOWN_CELL);
+	const int offsetX = originCellX - newOriginCellX;
+	const int offsetY = originCellY - newOriginCellY;
+	for(int y = 0; y < height; y++)
+	{
+		std::copy(hitCounts.begin() + y * width, hitCounts.begin() + (y + 1) * width, newHitCounts.begin() + (y + offsetY) * newWidth + offsetX);
+		std::copy(cells.begin() + y * width, cells.begin() + (y + 1) * width, newCells.begin() + (y + offsetY) * newWidth + offsetX);
+	}
+	
+	originCellX = newOriginCellX;
+	originCellY = newOriginCellY;
+	width = newWidth;
+	height = newHeight;
+	hitCounts.swap(newHitCounts);
+	cells.swap(newCells);
+	isResized = true;
+}
+
+void OccupancyGrid::updateCell(int cellIndex)
+{
+	std::int8_t newCell = hitCounts[cellIndex] > 0 ? OCCUPIED_CELL : FREE_CELL;
+	if(cells[cellIndex] == newCell)
+	{
+		return;
+	}
+	
+	cells[cellIndex] = newCell;
+	const int cellX = cellIndex % width;
+	const int cellY = cellIndex / width;
+	if(changedMinX > changedMaxX)
+	{
+		changedMinX = changedMaxX = cellX;
+		changedMinY = changedMaxY = cellY;
+	}
+	else
+	{
+		changedMinX = std::min(changedMinX, cellX);
+		changedMaxX = std::max(changedMaxX, cellX);
+		changedMinY = std::min(changedMinY, cellY);
+		changedMaxY = std::max(changedMaxY, cellY);
+	}
+}
+
+void OccupancyGrid::addPoint(const Eigen::Ref<const PM::Vector>& point)
+{
+	int cellIndex;
+	if(retrieveCellIndex(point, true, cellIndex))
+	{
+		hitCounts[cellIndex]++;
+		updateCell(cellIndex);
+	}
+}
+
+void OccupancyGrid::removePoint(const Eigen::Ref<const PM::Vector>& point)
+{
+	int cellIndex;
+	if(retrieveCellIndex(point, false, cellIndex) && hitCounts[cellIndex] > 0)
+	{
+		hitCounts[cellIndex]--;
+		updateCell(cellIndex);
+	}
+}
+
+void OccupancyGrid::resetHitCounts()
+{
+	std::fill(hitCounts.begin(), hitCounts.end(), 0);
+}
+
+void OccupancyGrid::updateClearedCells()
+{
+	for(int i = 0; i < width * height; i++)
+	{
+		if(hitCounts[i] == 0 && cells[i] == OCCUPIED_CELL)
+		{
+			updateCell(i);
+		}
+	}
+}
+
+bool OccupancyGrid::extractChanges(Patch& patch, bool isFullGridRequested)
+{
+	if(width == 0)
+	{
+		return false;
+	}
+	
+	patch.isFullGrid = isResized || isFullGridRequested;
+	if(!patch.isFullGrid && changedMinX > changedMaxX)
+	{
+		return false;
+	}
+	
+	patch.resolution = resolution;
+	patch.originX = originCellX * resolution;
+	patch.originY = originCellY * resolution;
+	patch.gridWidth = width;
+	patch.gridHeight = height;
+	if(patch.isFullGrid)
+	{
+		patch.x = 0;
+		patch.y = 0;
+		patch.width = width;
+		patch.height = height;
+		patch.cells = cells;
+	}
+	else
+	{
+		patch.x = changedMinX;
+		patch.y = changedMinY;
+		patch.width = changedMaxX - changedMinX + 1;
+		patch.height = changedMaxY - changedMinY + 1;
+		patch.cells.resize(patch.width * patch.height);
+		for(unsigned y = 0; y < patch.height; y++)
+		{
+			std::vector<std::int8_t>::const_iterator rowStart = cells.begin() + (patch.y + y) * width + patch.x;
+			std::copy(rowStart, rowStart + patch.width, patch.cells.begin() + y * patch.width);
+		}
+	}
+	
+	isResized = false;
+	changedMinX = changedMinY = 0;
+	changedMaxX = changedMaxY = -1;
+	return true;
+}
+
+size_t OccupancyGrid::getBytes() const
+{
+	return hitCounts.size() * sizeof(std::uint32_t) + cells.size() * sizeof(std::int8_t);
+}
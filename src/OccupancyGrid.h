@@ -0,0 +1,71 @@
+#ifndef OCCUPANCY_GRID_H
+#define OCCUPANCY_GRID_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// 2D occupancy grid counting the map points in each cell, updated point by point as the map changes and growing to include new points
+class OccupancyGrid
+{
+public:
+	struct Patch
+	{
+		// the whole grid is sent after it grew, since the previous cells moved
+		bool isFullGrid;
+		float resolution;
+		T originX;
+		T originY;
+		unsigned gridWidth;
+		unsigned gridHeight;
+		unsigned x;
+		unsigned y;
+		unsigned width;
+		unsigned height;
+		std::vector<std::int8_t> cells;
+	};
+	
+private:
+	float resolution;
+	bool is3D;
+	float minHeight;
+	float maxHeight;
+	int originCellX;
+	int originCellY;
+	int width;
+	int height;
+	std::vector<std::uint32_t> hitCounts;
+	std::vector<std::int8_t> cells;
+	bool isResized;
+	int changedMinX;
+	int changedMinY;
+	int changedMaxX;
+	int changedMaxY;
+	
+	bool retrieveCellIndex(const Eigen::Ref<const PM::Vector>& point, bool isGrowthAllowed, int& cellIndex);
+	
+	void growToInclude(int cellX, int cellY);
+	
+	void updateCell(int cellIndex);
+	
+public:
+	OccupancyGrid(float resolution, bool is3D, float minHeight, float maxHeight);
+	
+	void addPoint(const Eigen::Ref<const PM::Vector>& point);
+	
+	void removePoint(const Eigen::Ref<const PM::Vector>& point);
+	
+	// sets all hit counts to zero while keeping the cells, so that a rebuild followed by updateClearedCells only reports the cells that changed
+	void resetHitCounts();
+	
+	void updateClearedCells();
+	
+	bool extractChanges(Patch& patch, bool isFullGridRequested);
+	
+	size_t getBytes() const;
+};
+
+#endif
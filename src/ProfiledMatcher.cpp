@@ -0,0 +1,67 @@
+#include "ProfiledMatcher.h"
+
+ProfiledMatcher::ProfiledMatcher(std::shared_ptr<PM::Matcher> matcher):
+		PM::Matcher("ProfiledMatcher", PM::ParametersDoc(), PM::Parameters()),
+		matcher(matcher),
+		matchingTime(0),
+		matchingCount(0),
+		readingPointCount(0),
+		referencePointCount(0)
+{
+}
+
+void ProfiledMatcher::init(const PM::DataPoints& filteredReference)
+{
+	referencePointCount = filteredReference.getNbPoints();
+	matcher->init(filteredReference);
+}
+
+PM::Matches ProfiledMatcher::findClosests(const PM::DataPoints& filteredReading)
+{
+	std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+	if(matchingCount == 0)
+	{
+		firstMatchingTime = startTime;
+	}
+	
+	unsigned long visitCountBefore = matcher->getVisitCount();
+	PM::Matches matches = matcher->findClosests(filteredReading);
+	visitCounter += matcher->getVisitCount() - visitCountBefore;
+	
+	matchingTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	matchingCount++;
+	readingPointCount = filteredReading.getNbPoints();
+	return matches;
+}
+
+void ProfiledMatcher::resetStatistics()
+{
+	matchingTime = 0;
+	matchingCount = 0;
+	readingPointCount = 0;
+}
+
+std::chrono::time_point<std::chrono::steady_clock> ProfiledMatcher::getFirstMatchingTime() const
+{
+	return firstMatchingTime;
+}
+
+float ProfiledMatcher::getMatchingTime() const
+{
+	return matchingTime;
+}
+
+unsigned ProfiledMatcher::getMatchingCount() const
+{
+	return matchingCount;
+}
+
+unsigned ProfiledMatcher::getReadingPointCount() const
+{
+	return readingPointCount;
+}
+
+unsigned ProfiledMatcher::getReferencePointCount() const
+{
+	return referencePointCount;
+}
@@ -0,0 +1,41 @@
+#ifndef PROFILED_MATCHER_H
+#define PROFILED_MATCHER_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <chrono>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Matcher forwarding to another matcher while recording the time spent matching and the size of the matched clouds
+class ProfiledMatcher: public PM::Matcher
+{
+private:
+	std::shared_ptr<PM::Matcher> matcher;
+	std::chrono::time_point<std::chrono::steady_clock> firstMatchingTime;
+	float matchingTime;
+	unsigned matchingCount;
+	unsigned readingPointCount;
+	unsigned referencePointCount;
+	
+public:
+	ProfiledMatcher(std::shared_ptr<PM::Matcher> matcher);
+	
+	virtual void init(const PM::DataPoints& filteredReference);
+	
+	virtual PM::Matches findClosests(const PM::DataPoints& filteredReading);
+	
+	void resetStatistics();
+	
+	std::chrono::time_point<std::chrono::steady_clock> getFirstMatchingTime() const;
+	
+	float getMatchingTime() const;
+	
+	unsigned getMatchingCount() const;
+	
+	unsigned getReadingPointCount() const;
+	
+	unsigned getReferencePointCount() const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef PROFILED_MUTEX_H
+#define PROFILED_MUTEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Drop-in replacement for std::mutex which records wait and hold times when PROFILE_LOCKS is defined
+class ProfiledMutex
+{
+public:
+	struct Statistics
+	{
+		unsigned long lockCount;
+		unsigned long contentionCount;
+		unsigned maxContenderCount;
+		float totalWaitTime;
+		float maxWaitTime;
+		float totalHoldTime;
+		float maxHoldTime;
+	};
+	
+private:
+	std::mutex mutex;
+#ifdef PROFILE_LOCKS
+	std::atomic_uint contenderCount;
+	std::chrono::time_point<std::chrono::steady_clock> lockTime;
+	Statistics statistics;
+	std::mutex statisticsLock;
+#endif
+	
+public:
+	ProfiledMutex()
+	{
+#ifdef PROFILE_LOCKS
+		contenderCount = 0;
+		statistics = Statistics();
+#endif
+	}
+	
+	void lock()
+	{
+#ifdef PROFILE_LOCKS
+		std::chrono::time_point<std::chrono::steady_clock> requestTime = std::chrono::steady_clock::now();
+		unsigned otherContenderCount = contenderCount++;
+		mutex.lock();
+		lockTime = std::chrono::steady_clock::now();
+		float waitTime = std::chrono::duration<float>(lockTime - requestTime).count();
+		
+		std::lock_guard<std::mutex> lock(statisticsLock);
+		statistics.lockCount++;
+		statistics.contentionCount += otherContenderCount > 0;
+		statistics.maxContenderCount = std::max(statistics.maxContenderCount, otherContenderCount);
+		statistics.totalWaitTime += waitTime;
+		statistics.maxWaitTime = std::max(statistics.maxWaitTime, waitTime);
+#else
+		mutex.lock();
+#endif
+	}
+	
+	bool try_lock()
+	{
+#ifdef PROFILE_LOCKS
+		if(!mutex.try_lock())
+		{
+			return false;
+		}
+		contenderCount++;
+		lockTime = std::chrono::steady_clock::now();
+		
+		std::lock_guard<std::mutex> lock(statisticsLock);
+		statistics.lockCount++;
+		return true;
+#else
+		return mutex.try_lock();
+#endif
+	}
+	
+	void unlock()
+	{
+#ifdef PROFILE_LOCKS
+		float holdTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - lockTime).count();
+		{
+			std::lock_guard<std::mutex> lock(statisticsLock);
+			statistics.totalHoldTime += holdTime;
+			statistics.maxHoldTime = std::max(statistics.maxHoldTime, holdTime);
+		}
+		contenderCount--;
+#endif
+		mutex.unlock();
+	}
+	
+	Statistics getStatistics()
+	{
+#ifdef PROFILE_LOCKS
+		std::lock_guard<std::mutex> lock(statisticsLock);
+		return statistics;
+#else
+		return Statistics();
+#endif
+	}
+	
+	static bool isProfilingEnabled()
+	{
+#ifdef PROFILE_LOCKS
+		return true;
+#else
+		return false;
+#endif
+	}
+};
+
+#endif
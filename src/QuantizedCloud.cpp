@@ -0,0 +1,194 @@
+#include "QuantizedCloud.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+const std::string QuantizedCloud::QUANTIZATION_PREFIX = "quantization ";
+
+// quantized values are kept symmetric around the origin
+const T MAX_QUANTIZED_VALUE = 32767;
+
+void QuantizedCloud::addField(sensor_msgs::PointCloud2& message, const std::string& name, const Eigen::Ref<const PM::Matrix>& values,
+							  std::vector<T>& origins, std::vector<T>& scales)
+{
+	T minValue = std::numeric_limits<T>::infinity();
+	T maxValue = -std::numeric_limits<T>::infinity();
+	for(int i = 0; i < values.cols(); i++)
+	{
+		if(std::isfinite(values(0, i)))
+		{
+			minValue = std::min(minValue, values(0, i));
+			maxValue = std::max(maxValue, values(0, i));
+		}
+	}
+	const T origin = minValue <= maxValue ? (minValue + maxValue) / 2 : 0;
+	const T scale = minValue < maxValue ? (maxValue - minValue) / (2 * MAX_QUANTIZED_VALUE) : 1;
+	origins.push_back(origin);
+	scales.push_back(scale);
+	
+	sensor_msgs::PointField field;
+	field.name = name;
+	field.offset = message.fields.size() / 2 * sizeof(std::int16_t);
+	field.datatype = sensor_msgs::PointField::INT16;
+	field.count = 1;
+	message.fields.push_back(field);
+	
+	char quantization[64];
+	std::snprintf(quantization, sizeof(quantization), "%.9g %.9g", origin, scale);
+	sensor_msgs::PointField quantizationField;
+	quantizationField.name = QUANTIZATION_PREFIX + name + " " + quantization;
+	quantizationField.offset = 0;
+	quantizationField.datatype = sensor_msgs::PointField::FLOAT32;
+	quantizationField.count = 0;
+	message.fields.push_back(quantizationField);
+}
+
+sensor_msgs::PointCloud2 QuantizedCloud::encode(const PM::DataPoints& points, const std::vector<std::string>& descriptorNames, const std::string& frameId,
+												const ros::Time& stamp)
+{
+	const int euclideanDim = points.getEuclideanDim();
+	const int pointCount = points.getNbPoints();
+	
+	std::vector<const PM::Matrix*> sourceMatrices;
+	std::vector<int> sourceRows;
+	sensor_msgs::PointCloud2 message;
+	std::vector<T> origins;
+	std::vector<T> scales;
+	const char* coordinateNames[] = {"x", "y", "z"};
+	for(int i = 0; i < euclideanDim; i++)
+	{
+		addField(message, coordinateNames[i], points.features.row(i), origins, scales);
+		sourceMatrices.push_back(&points.features);
+		sourceRows.push_back(i);
+	}
+	for(const std::string& descriptorName: descriptorNames)
+	{
+		if(!points.descriptorExists(descriptorName))
+		{
+			continue;
+		}
+		const unsigned startingRow = points.getDescriptorStartingRow(descriptorName);
+		const unsigned span = points.getDescriptorDimension(descriptorName);
+		for(unsigned i = 0; i < span; i++)
+		{
+			const std::string fieldName = span == 1 ? descriptorName : descriptorName + "_" + std::to_string(i);
+			addField(message, fieldName, points.descriptors.row(startingRow + i), origins, scales);
+			sourceMatrices.push_back(&points.descriptors);
+			sourceRows.push_back(startingRow + i);
+		}
+	}
+	
+	message.header.frame_id = frameId;
+	message.header.stamp = stamp;
+	message.height = 1;
+	message.width = pointCount;
+	message.is_bigendian = false;
+	message.is_dense = true;
+	message.point_step = origins.size() * sizeof(std::int16_t);
+	message.row_step = message.point_step * pointCount;
+	message.data.resize(message.row_step);
+	
+	// values are written point by point, as expected by PointCloud2 readers, non-finite values being written as the origin
+	std::uint8_t* data = message.data.data();
+	for(int i = 0; i < pointCount; i++)
+	{
+		for(size_t j = 0; j < origins.size(); j++)
+		{
+			const T value = (*sourceMatrices[j])(sourceRows[j], i);
+			const std::int16_t quantizedValue = std::isfinite(value) ? std::lround((value - origins[j]) / scales[j]) : 0;
+			std::memcpy(data, &quantizedValue, sizeof(quantizedValue));
+			data += sizeof(quantizedValue);
+		}
+	}
+	return message;
+}
+
+PM::DataPoints QuantizedCloud::decode(const sensor_msgs::PointCloud2& message)
+{
+	std::map<std::string, std::pair<T, T>> quantizations;
+	std::vector<const sensor_msgs::PointField*> fields;
+	for(const sensor_msgs::PointField& field: message.fields)
+	{
+		if(field.name.compare(0, QUANTIZATION_PREFIX.size(), QUANTIZATION_PREFIX) == 0)
+		{
+			std::istringstream quantizationStream(field.name.substr(QUANTIZATION_PREFIX.size()));
+			std::string fieldName;
+			T origin;
+			T scale;
+			if(!(quantizationStream >> fieldName >> origin >> scale))
+			{
+				throw std::runtime_error("Invalid quantization field: " + field.name);
+			}
+			quantizations[fieldName] = std::make_pair(origin, scale);
+		}
+		else if(field.datatype == sensor_msgs::PointField::INT16 && field.count == 1)
+		{
+			fields.push_back(&field);
+		}
+	}
+	
+	PM::DataPoints::Labels featureLabels;
+	PM::DataPoints::Labels descriptorLabels;
+	std::vector<bool> isFeatureField;
+	for(const sensor_msgs::PointField* field: fields)
+	{
+		if(quantizations.find(field->name) == quantizations.end())
+		{
+			throw std::runtime_error("Missing quantization of field " + field->name);
+		}
+		
+		// components of a descriptor follow each other, named after it followed by their index
+		const bool isFeature = field->name == "x" || field->name == "y" || field->name == "z";
+		const size_t underscorePosition = field->name.find_last_of('_');
+		const std::string descriptorName = field->name.substr(0, underscorePosition);
+		const bool isComponent = underscorePosition != std::string::npos && field->name.find_first_not_of("0123456789", underscorePosition + 1) == std::string::npos;
+		isFeatureField.push_back(isFeature);
+		if(isFeature)
+		{
+			featureLabels.push_back(PM::DataPoints::Label(field->name, 1));
+		}
+		else if(isComponent && !descriptorLabels.empty() && descriptorLabels.back().text == descriptorName &&
+				field->name.substr(underscorePosition + 1) == std::to_string(descriptorLabels.back().span))
+		{
+			descriptorLabels.back().span++;
+		}
+		else
+		{
+			descriptorLabels.push_back(PM::DataPoints::Label(isComponent && field->name.substr(underscorePosition + 1) == "0" ? descriptorName : field->name, 1));
+		}
+	}
+	featureLabels.push_back(PM::DataPoints::Label("pad", 1));
+	
+	const int pointCount = message.width * message.height;
+	if(message.data.size() < static_cast<size_t>(pointCount) * message.point_step)
+	{
+		throw std::runtime_error("Quantized cloud is too short.");
+	}
+	PM::DataPoints points(featureLabels, descriptorLabels, pointCount);
+	points.features.bottomRows(1).setOnes();
+	for(int i = 0; i < pointCount; i++)
+	{
+		int featureRow = 0;
+		int descriptorRow = 0;
+		for(size_t j = 0; j < fields.size(); j++)
+		{
+			std::int16_t quantizedValue;
+			std::memcpy(&quantizedValue, &message.data[i * message.point_step + fields[j]->offset], sizeof(quantizedValue));
+			const std::pair<T, T>& quantization = quantizations[fields[j]->name];
+			const T value = quantization.first + quantization.second * quantizedValue;
+			if(isFeatureField[j])
+			{
+				points.features(featureRow++, i) = value;
+			}
+			else
+			{
+				points.descriptors(descriptorRow++, i) = value;
+			}
+		}
+	}
+	return points;
+}
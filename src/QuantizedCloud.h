@@ -0,0 +1,31 @@
+#ifndef QUANTIZED_CLOUD_H
+#define QUANTIZED_CLOUD_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Encodes points in a PointCloud2 of INT16 fields, to publish large maps to remote operators. The coordinates are the fields x, y and z, and a descriptor is
+// a field named after it, or one field per component named after it followed by _0, _1, ... Each INT16 field is followed by a field of count 0 named
+// "quantization <field> <origin> <scale>", the field being decoded as origin + scale * value.
+class QuantizedCloud
+{
+private:
+	static const std::string QUANTIZATION_PREFIX;
+	
+	static void addField(sensor_msgs::PointCloud2& message, const std::string& name, const Eigen::Ref<const PM::Matrix>& values, std::vector<T>& origins,
+						 std::vector<T>& scales);
+	
+public:
+	// descriptors that are not in the points are skipped, times are never encoded
+	static sensor_msgs::PointCloud2 encode(const PM::DataPoints& points, const std::vector<std::string>& descriptorNames, const std::string& frameId,
+										   const ros::Time& stamp);
+	
+	static PM::DataPoints decode(const sensor_msgs::PointCloud2& message);
+};
+
+#endif
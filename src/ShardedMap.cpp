@@ -0,0 +1,208 @@
+#include "ShardedMap.h"
+#include <cmath>
+
+ShardedMap::ShardedMap(float tileSize):
+		tileSize(tileSize),
+		updateCount(0)
+{
+}
+
+std::int64_t ShardedMap::computeTileKey(int tileX, int tileY) const
+{
+	return (static_cast<std::int64_t>(tileX) << 32) | static_cast<std::uint32_t>(tileY);
+}
+
+int ShardedMap::computeTileCoordinate(T coordinate) const
+{
+	return std::floor(coordinate / tileSize);
+}
+
+std::vector<std::int64_t> ShardedMap::computeTileKeysInRange(const PM::Vector& center, float radius) const
+{
+	std::vector<std::int64_t> tileKeys;
+	for(int tileX = computeTileCoordinate(center(0) - radius); tileX <= computeTileCoordinate(center(0) + radius); tileX++)
+	{
+		for(int tileY = computeTileCoordinate(center(1) - radius); tileY <= computeTileCoordinate(center(1) + radius); tileY++)
+		{
+			tileKeys.push_back(computeTileKey(tileX, tileY));
+		}
+	}
+	return tileKeys;
+}
+
+void ShardedMap::update(const PM::DataPoints& input, const PM::Vector& center, float radius, const ShardUpdater& updateShard)
+{
+	std::unordered_map<std::int64_t, std::vector<int>> shardInputIndexes;
+	for(int i = 0; i < input.getNbPoints(); i++)
+	{
+		shardInputIndexes[computeTileKey(computeTileCoordinate(input.features(0, i)), computeTileCoordinate(input.features(1, i)))].push_back(i);
+	}
+	
+	// shards are never removed, so they can be updated after releasing the lock on the shard table
+	std::vector<std::pair<Shard*, const std::vector<int>*>> shardsToUpdate;
+	shardsLock.lock();
+	if(radius > 0)
+	{
+		for(std::int64_t tileKey: computeTileKeysInRange(center, radius))
+		{
+			if(shards.count(tileKey))
+			{
+				shardInputIndexes[tileKey];
+			}
+		}
+	}
+	for(const std::pair<const std::int64_t, std::vector<int>>& shardInput: shardInputIndexes)
+	{
+		std::unique_ptr<Shard>& shard = shards[shardInput.first];
+		if(!shard)
+		{
+			shard = std::unique_ptr<Shard>(new Shard);
+			shard->points = std::make_shared<PM::DataPoints>(input.createSimilarEmpty(0));
+		}
+		shardsToUpdate.push_back(std::make_pair(shard.get(), &shardInput.second));
+	}
+	shardsLock.unlock();
+	
+	for(const std::pair<Shard*, const std::vector<int>*>& shardToUpdate: shardsToUpdate)
+	{
+		const std::vector<int>& inputIndexes = *shardToUpdate.second;
+		PM::DataPoints shardInput = input.createSimilarEmpty(inputIndexes.size());
+		for(size_t i = 0; i < inputIndexes.size(); i++)
+		{
+			shardInput.setColFrom(i, input, inputIndexes[i]);
+		}
+		
+		std::lock_guard<std::mutex> lock(shardToUpdate.first->lock);
+		if(shardToUpdate.first->points.use_count() > 1)
+		{
+			shardToUpdate.first->points = std::make_shared<PM::DataPoints>(*shardToUpdate.first->points);
+		}
+		updateShard(shardInput, *shardToUpdate.first->points);
+	}
+	updateCount++;
+}
+
+void ShardedMap::addPoints(const PM::DataPoints& points)
+{
+	update(points, PM::Vector::Zero(points.getEuclideanDim()), 0, [](const PM::DataPoints& shardInput, PM::DataPoints& shardPoints)
+	{
+		if(shardPoints.getNbPoints() == 0)
+		{
+			shardPoints = shardInput;
+		}
+		else
+		{
+			shardPoints.concatenate(shardInput);
+		}
+	});
+}
+
+PM::DataPoints ShardedMap::extractLocalMap(const PM::Vector& center, float radius) const
+{
+	std::vector<Shard*> localShards;
+	shardsLock.lock();
+	for(std::int64_t tileKey: computeTileKeysInRange(center, radius))
+	{
+		std::unordered_map<std::int64_t, std::unique_ptr<Shard>>::const_iterator shard = shards.find(tileKey);
+		if(shard != shards.end())
+		{
+			localShards.push_back(shard->second.get());
+		}
+	}
+	shardsLock.unlock();
+	
+	const int euclideanDim = center.rows();
+	PM::DataPoints localMap;
+	for(Shard* shard: localShards)
+	{
+		std::lock_guard<std::mutex> lock(shard->lock);
+		const PM::DataPoints& shardPoints = *shard->points;
+		int localPointCount = 0;
+		PM::DataPoints shardLocalMap = shardPoints.createSimilarEmpty(shardPoints.getNbPoints());
+		for(int i = 0; i < shardPoints.getNbPoints(); i++)
+		{
+			if((shardPoints.features.col(i).head(euclideanDim) - center).squaredNorm() < radius * radius)
+			{
+				shardLocalMap.setColFrom(localPointCount, shardPoints, i);
+				localPointCount++;
+			}
+		}
+		shardLocalMap.conservativeResize(localPointCount);
+		
+		if(localMap.getNbPoints() == 0)
+		{
+			localMap = shardLocalMap;
+		}
+		else
+		{
+			localMap.concatenate(shardLocalMap);
+		}
+	}
+	
+	return localMap;
+}
+
+PM::DataPoints ShardedMap::getPoints() const
+{
+	std::vector<Shard*> allShards;
+	shardsLock.lock();
+	for(const std::pair<const std::int64_t, std::unique_ptr<Shard>>& shard: shards)
+	{
+		allShards.push_back(shard.second.get());
+	}
+	shardsLock.unlock();
+	
+	PM::DataPoints points;
+	for(Shard* shard: allShards)
+	{
+		std::lock_guard<std::mutex> lock(shard->lock);
+		if(points.getNbPoints() == 0)
+		{
+			points = *shard->points;
+		}
+		else
+		{
+			points.concatenate(*shard->points);
+		}
+	}
+	
+	return points;
+}
+
+std::vector<std::shared_ptr<const PM::DataPoints>> ShardedMap::getShardPoints() const
+{
+	std::lock_guard<std::mutex> shardsTableLock(shardsLock);
+	std::vector<std::shared_ptr<const PM::DataPoints>> shardPoints;
+	for(const std::pair<const std::int64_t, std::unique_ptr<Shard>>& shard: shards)
+	{
+		std::lock_guard<std::mutex> lock(shard.second->lock);
+		if(shard.second->points->getNbPoints() > 0)
+		{
+			shardPoints.push_back(shard.second->points);
+		}
+	}
+	return shardPoints;
+}
+
+unsigned ShardedMap::getPointCount() const
+{
+	std::lock_guard<std::mutex> shardsTableLock(shardsLock);
+	unsigned pointCount = 0;
+	for(const std::pair<const std::int64_t, std::unique_ptr<Shard>>& shard: shards)
+	{
+		std::lock_guard<std::mutex> lock(shard.second->lock);
+		pointCount += shard.second->points->getNbPoints();
+	}
+	return pointCount;
+}
+
+unsigned ShardedMap::getShardCount() const
+{
+	std::lock_guard<std::mutex> lock(shardsLock);
+	return shards.size();
+}
+
+unsigned ShardedMap::getUpdateCount() const
+{
+	return updateCount;
+}
@@ -0,0 +1,64 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Map split in square tiles, each shard having its own lock so that inputs of several robots are merged concurrently when they fall in different tiles
+class ShardedMap
+{
+public:
+	// receives the input points falling in a shard and the shard points to update, while the shard is locked
+	typedef std::function<void(const PM::DataPoints& shardInput, PM::DataPoints& shardPoints)> ShardUpdater;
+	
+private:
+	// the points of a shard are shared with the snapshots taken by getShardPoints, and copied by an update while a snapshot holds them
+	struct Shard
+	{
+		std::mutex lock;
+		std::shared_ptr<PM::DataPoints> points;
+	};
+	
+	float tileSize;
+	mutable std::mutex shardsLock;
+	std::unordered_map<std::int64_t, std::unique_ptr<Shard>> shards;
+	std::atomic_uint updateCount;
+	
+	std::int64_t computeTileKey(int tileX, int tileY) const;
+	
+	int computeTileCoordinate(T coordinate) const;
+	
+	std::vector<std::int64_t> computeTileKeysInRange(const PM::Vector& center, float radius) const;
+	
+public:
+	ShardedMap(float tileSize);
+	
+	// shards within radius of center are updated even when no input point falls in them, to let the updater clear their dynamic points
+	void update(const PM::DataPoints& input, const PM::Vector& center, float radius, const ShardUpdater& updateShard);
+	
+	void addPoints(const PM::DataPoints& points);
+	
+	PM::DataPoints extractLocalMap(const PM::Vector& center, float radius) const;
+	
+	PM::DataPoints getPoints() const;
+	
+	// points of the shards that are not empty, taken without copying them
+	std::vector<std::shared_ptr<const PM::DataPoints>> getShardPoints() const;
+	
+	unsigned getPointCount() const;
+	
+	unsigned getShardCount() const;
+	
+	unsigned getUpdateCount() const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "SharedMap.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+SharedMap::SharedMap(const PM::DataPoints& points, float tileSize):
+		tileSize(tileSize)
+{
+	std::vector<std::int64_t> pointTileKeys(points.getNbPoints());
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		pointTileKeys[i] = computeTileKey(computeTileCoordinate(points.features(0, i)), computeTileCoordinate(points.features(1, i)));
+	}
+	
+	std::vector<int> sortedPointIndexes(points.getNbPoints());
+	std::iota(sortedPointIndexes.begin(), sortedPointIndexes.end(), 0);
+	std::stable_sort(sortedPointIndexes.begin(), sortedPointIndexes.end(), [&pointTileKeys](int a, int b)
+	{
+		return pointTileKeys[a] < pointTileKeys[b];
+	});
+	
+	// points of the same tile are stored contiguously so that a tile is extracted as a single range
+	this->points = points.createSimilarEmpty();
+	for(int i = 0; i < points.getNbPoints(); i++)
+	{
+		this->points.setColFrom(i, points, sortedPointIndexes[i]);
+		
+		std::int64_t tileKey = pointTileKeys[sortedPointIndexes[i]];
+		std::unordered_map<std::int64_t, TileRange>::iterator tileRange = tileRanges.find(tileKey);
+		if(tileRange == tileRanges.end())
+		{
+			TileRange newTileRange = {i, 1};
+			tileRanges[tileKey] = newTileRange;
+		}
+		else
+		{
+			tileRange->second.pointCount++;
+		}
+	}
+}
+
+std::int64_t SharedMap::computeTileKey(int tileX, int tileY) const
+{
+	return (static_cast<std::int64_t>(tileX) << 32) | static_cast<std::uint32_t>(tileY);
+}
+
+int SharedMap::computeTileCoordinate(T coordinate) const
+{
+	return std::floor(coordinate / tileSize);
+}
+
+PM::DataPoints SharedMap::extractLocalMap(const PM::Vector& center, float radius) const
+{
+	const int euclideanDim = points.getEuclideanDim();
+	const int minTileX = computeTileCoordinate(center(0) - radius);
+	const int maxTileX = computeTileCoordinate(center(0) + radius);
+	const int minTileY = computeTileCoordinate(center(1) - radius);
+	const int maxTileY = computeTileCoordinate(center(1) + radius);
+	
+	std::vector<TileRange> localTileRanges;
+	int candidatePointCount = 0;
+	for(int tileX = minTileX; tileX <= maxTileX; tileX++)
+	{
+		for(int tileY = minTileY; tileY <= maxTileY; tileY++)
+		{
+			std::unordered_map<std::int64_t, TileRange>::const_iterator tileRange = tileRanges.find(computeTileKey(tileX, tileY));
+			if(tileRange != tileRanges.end())
+			{
+				localTileRanges.push_back(tileRange->second);
+				candidatePointCount += tileRange->second.pointCount;
+			}
+		}
+	}
+	
+	int localPointCount = 0;
+	PM::DataPoints localMap = points.createSimilarEmpty(candidatePointCount);
+	for(const TileRange& tileRange: localTileRanges)
+	{
+		for(int i = tileRange.firstPointIndex; i < tileRange.firstPointIndex + tileRange.pointCount; i++)
+		{
+			if((points.features.col(i).head(euclideanDim) - center.head(euclideanDim)).squaredNorm() < radius * radius)
+			{
+				localMap.setColFrom(localPointCount, points, i);
+				localPointCount++;
+			}
+		}
+	}
+	localMap.conservativeResize(localPointCount);
+	
+	return localMap;
+}
+
+const PM::DataPoints& SharedMap::getPoints() const
+{
+	return points;
+}
+
+unsigned SharedMap::getPointCount() const
+{
+	return points.getNbPoints();
+}
+
+unsigned SharedMap::getTileCount() const
+{
+	return tileRanges.size();
+}
@@ -0,0 +1,41 @@
+#ifndef SHARED_MAP_H
+#define SHARED_MAP_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <cstdint>
+#include <unordered_map>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Map held once in memory and shared by several localization sessions, its points being grouped by square tile to extract local references quickly
+class SharedMap
+{
+private:
+	struct TileRange
+	{
+		int firstPointIndex;
+		int pointCount;
+	};
+	
+	PM::DataPoints points;
+	float tileSize;
+	std::unordered_map<std::int64_t, TileRange> tileRanges;
+	
+	std::int64_t computeTileKey(int tileX, int tileY) const;
+	
+	int computeTileCoordinate(T coordinate) const;
+	
+public:
+	SharedMap(const PM::DataPoints& points, float tileSize);
+	
+	PM::DataPoints extractLocalMap(const PM::Vector& center, float radius) const;
+	
+	const PM::DataPoints& getPoints() const;
+	
+	unsigned getPointCount() const;
+	
+	unsigned getTileCount() const;
+};
+
+#endif
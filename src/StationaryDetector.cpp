@@ -0,0 +1,91 @@
+#include "StationaryDetector.h"
+#include <algorithm>
+#include <cmath>
+
+StationaryDetector::StationaryDetector(float translationThreshold, float rotationThreshold, double delay, unsigned registrationPeriod):
+		translationThreshold(translationThreshold),
+		rotationThreshold(rotationThreshold),
+		delay(delay),
+		registrationPeriod(registrationPeriod),
+		isStationary(false),
+		hasRegisteredScan(false),
+		lastMotionTime(0),
+		scansSinceLastRegistration(0),
+		registeredScanCount(0),
+		skippedScanCount(0),
+		totalRegistrationTime(0),
+		savedRegistrationTime(0)
+{
+}
+
+bool StationaryDetector::isMotionSignificant(const PM::TransformationParameters& motion) const
+{
+	const int euclideanDim = motion.rows() - 1;
+	float rotation;
+	if(euclideanDim == 3)
+	{
+		rotation = std::acos(std::min(1.0f, std::max(-1.0f, (motion.topLeftCorner(3, 3).trace() - 1) / 2)));
+	}
+	else
+	{
+		rotation = std::abs(std::atan2(motion(1, 0), motion(0, 0)));
+	}
+	return motion.topRightCorner(euclideanDim, 1).norm() > translationThreshold || rotation > rotationThreshold;
+}
+
+bool StationaryDetector::shouldRegister(const PM::TransformationParameters& sensorToOdom, double timeStamp)
+{
+	std::lock_guard<std::mutex> lock(detectorLock);
+	
+	if(!hasRegisteredScan)
+	{
+		return true;
+	}
+	
+	// motion is measured from the last registered scan so that slow creeping is not missed while scans are skipped
+	if(isMotionSignificant(lastRegisteredSensorToOdom.inverse() * sensorToOdom))
+	{
+		isStationary = false;
+		lastMotionTime = timeStamp;
+		return true;
+	}
+	
+	if(!isStationary || ++scansSinceLastRegistration >= registrationPeriod)
+	{
+		return true;
+	}
+	
+	skippedScanCount++;
+	savedRegistrationTime += totalRegistrationTime / registeredScanCount;
+	return false;
+}
+
+void StationaryDetector::reportRegistration(const PM::TransformationParameters& sensorToOdom, const PM::TransformationParameters& correction,
+											double timeStamp, float registrationDuration)
+{
+	std::lock_guard<std::mutex> lock(detectorLock);
+	
+	if(!hasRegisteredScan || isMotionSignificant(correction))
+	{
+		lastMotionTime = timeStamp;
+	}
+	isStationary = timeStamp - lastMotionTime >= delay;
+	
+	hasRegisteredScan = true;
+	lastRegisteredSensorToOdom = sensorToOdom;
+	scansSinceLastRegistration = 0;
+	registeredScanCount++;
+	totalRegistrationTime += registrationDuration;
+}
+
+StationaryDetector::Statistics StationaryDetector::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(detectorLock);
+	
+	Statistics statistics;
+	statistics.isStationary = isStationary;
+	statistics.registeredScanCount = registeredScanCount;
+	statistics.skippedScanCount = skippedScanCount;
+	statistics.savedRegistrationTime = savedRegistrationTime;
+	return statistics;
+}
@@ -0,0 +1,51 @@
+#ifndef STATIONARY_DETECTOR_H
+#define STATIONARY_DETECTOR_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <mutex>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Decides which scans are registered, dropping to one scan every registration period once neither odometry nor ICP report motion
+class StationaryDetector
+{
+public:
+	struct Statistics
+	{
+		bool isStationary;
+		unsigned long registeredScanCount;
+		unsigned long skippedScanCount;
+		float savedRegistrationTime;
+	};
+	
+private:
+	float translationThreshold;
+	float rotationThreshold;
+	double delay;
+	unsigned registrationPeriod;
+	bool isStationary;
+	bool hasRegisteredScan;
+	PM::TransformationParameters lastRegisteredSensorToOdom;
+	double lastMotionTime;
+	unsigned scansSinceLastRegistration;
+	unsigned long registeredScanCount;
+	unsigned long skippedScanCount;
+	float totalRegistrationTime;
+	float savedRegistrationTime;
+	std::mutex detectorLock;
+	
+	bool isMotionSignificant(const PM::TransformationParameters& motion) const;
+	
+public:
+	StationaryDetector(float translationThreshold, float rotationThreshold, double delay, unsigned registrationPeriod);
+	
+	bool shouldRegister(const PM::TransformationParameters& sensorToOdom, double timeStamp);
+	
+	void reportRegistration(const PM::TransformationParameters& sensorToOdom, const PM::TransformationParameters& correction, double timeStamp,
+							float registrationDuration);
+	
+	Statistics getStatistics();
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "SyntheticScene.h"
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+const float SyntheticScene::SCAN_PERIOD = 0.1;
+const float SCENE_SIZE = 40;
+const float WALL_HEIGHT = 4;
+const float WALL_THICKNESS = 0.2;
+const float SENSOR_HEIGHT = 1;
+const float SENSOR_SPEED = 1.5;
+const float MIN_RANGE = 0.5;
+const float CLEARANCE_AROUND_TRAJECTORY = 2.5;
+const unsigned MAX_PLACEMENT_ATTEMPTS_PER_OBSTACLE = 100;
+
+SyntheticScene::SyntheticScene(bool is3D, unsigned beamCount, float verticalFieldOfView, unsigned pointsPerBeam, float maxRange, float rangeNoise,
+							   unsigned obstacleCount, unsigned movingObjectCount, unsigned seed):
+		is3D(is3D),
+		beamCount(is3D ? beamCount : 1),
+		verticalFieldOfView(verticalFieldOfView),
+		pointsPerBeam(pointsPerBeam),
+		maxRange(maxRange),
+		rangeNoise(rangeNoise),
+		seed(seed),
+		trajectorySize(0.3 * SCENE_SIZE)
+{
+	generateScene(obstacleCount, movingObjectCount);
+}
+
+void SyntheticScene::generateScene(unsigned obstacleCount, unsigned movingObjectCount)
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> positionDistribution(-SCENE_SIZE / 2 + 1, SCENE_SIZE / 2 - 1);
+	std::uniform_real_distribution<float> unitDistribution(0, 1);
+	
+	for(int side = -1; side <= 1; side += 2)
+	{
+		Box wallAlongX = {Eigen::Vector3f(0, side * SCENE_SIZE / 2, WALL_HEIGHT / 2), Eigen::Vector3f(SCENE_SIZE / 2, WALL_THICKNESS / 2, WALL_HEIGHT / 2),
+						  Eigen::Vector3f::Zero(), 0};
+		Box wallAlongY = {Eigen::Vector3f(side * SCENE_SIZE / 2, 0, WALL_HEIGHT / 2), Eigen::Vector3f(WALL_THICKNESS / 2, SCENE_SIZE / 2, WALL_HEIGHT / 2),
+						  Eigen::Vector3f::Zero(), 0};
+		boxes.push_back(wallAlongX);
+		boxes.push_back(wallAlongY);
+	}
+	
+	std::vector<Eigen::Vector2f> trajectorySamples;
+	for(int i = 0; i < 200; i++)
+	{
+		float heading;
+		trajectorySamples.push_back(computeTrajectoryPosition(i * 2 * M_PI * trajectorySize / (200 * SENSOR_SPEED), heading));
+	}
+	
+	unsigned placedObstacleCount = 0;
+	unsigned placementAttemptCount = 0;
+	while(placedObstacleCount < obstacleCount)
+	{
+		if(placementAttemptCount == MAX_PLACEMENT_ATTEMPTS_PER_OBSTACLE * obstacleCount)
+		{
+			throw std::runtime_error("Invalid obstacle count: only " + std::to_string(placedObstacleCount) + " of " + std::to_string(obstacleCount) +
+									 " obstacles could be placed away from the trajectory.");
+		}
+		placementAttemptCount++;
+		
+		Eigen::Vector2f position(positionDistribution(generator), positionDistribution(generator));
+		float footprintRadius = 0.3 + 1.2 * unitDistribution(generator);
+		
+		bool isTooClose = false;
+		for(const Eigen::Vector2f& sample: trajectorySamples)
+		{
+			isTooClose = isTooClose || (sample - position).norm() < footprintRadius + CLEARANCE_AROUND_TRAJECTORY;
+		}
+		if(isTooClose)
+		{
+			continue;
+		}
+		
+		float height = 0.5 + (WALL_HEIGHT - 0.5) * unitDistribution(generator);
+		if(placedObstacleCount % 2 == 0)
+		{
+			Cylinder pillar = {position, footprintRadius / 2, height};
+			cylinders.push_back(pillar);
+		}
+		else
+		{
+			Box box = {Eigen::Vector3f(position.x(), position.y(), height / 2), Eigen::Vector3f(footprintRadius, footprintRadius * unitDistribution(generator) + 0.2, height / 2),
+					   Eigen::Vector3f::Zero(), 0};
+			boxes.push_back(box);
+		}
+		placedObstacleCount++;
+	}
+	
+	for(unsigned i = 0; i < movingObjectCount; i++)
+	{
+		float motionDirection = 2 * M_PI * unitDistribution(generator);
+		float motionAmplitude = 1 + 3 * unitDistribution(generator);
+		Box pedestrian = {Eigen::Vector3f(positionDistribution(generator), positionDistribution(generator), 0.85), Eigen::Vector3f(0.25, 0.25, 0.85),
+						  Eigen::Vector3f(motionAmplitude * std::cos(motionDirection), motionAmplitude * std::sin(motionDirection), 0),
+						  0.05f + 0.15f * unitDistribution(generator)};
+		boxes.push_back(pedestrian);
+	}
+}
+
+Eigen::Vector2f SyntheticScene::computeTrajectoryPosition(float time, float& heading) const
+{
+	const float angle = SENSOR_SPEED * time / trajectorySize;
+	heading = std::atan2(std::cos(2 * angle), std::cos(angle));
+	return Eigen::Vector2f(trajectorySize * std::sin(angle), trajectorySize * std::sin(angle) * std::cos(angle));
+}
+
+float SyntheticScene::intersectBox(const Box& box, const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float time) const
+{
+	const Eigen::Vector3f center = box.center + box.motionAmplitude * std::sin(2 * M_PI * box.motionFrequency * time);
+	float entry = -std::numeric_limits<float>::infinity();
+	float exit = std::numeric_limits<float>::infinity();
+	for(int i = 0; i < 3; i++)
+	{
+		const float lowerSlab = center(i) - box.halfSize(i) - origin(i);
+		const float upperSlab = center(i) + box.halfSize(i) - origin(i);
+		if(std::abs(direction(i)) < 1e-9)
+		{
+			if(lowerSlab > 0 || upperSlab < 0)
+			{
+				return std::numeric_limits<float>::infinity();
+			}
+			continue;
+		}
+		const float firstHit = std::min(lowerSlab / direction(i), upperSlab / direction(i));
+		const float secondHit = std::max(lowerSlab / direction(i), upperSlab / direction(i));
+		entry = std::max(entry, firstHit);
+		exit = std::min(exit, secondHit);
+	}
+	
+	// rays starting inside a box (e.g. a pedestrian walking through the sensor) see through it
+	if(entry > exit || entry <= 0)
+	{
+		return std::numeric_limits<float>::infinity();
+	}
+	return entry;
+}
+
+float SyntheticScene::intersectCylinder(const Cylinder& cylinder, const Eigen::Vector3f& origin, const Eigen::Vector3f& direction) const
+{
+	const Eigen::Vector2f offset = origin.head<2>() - cylinder.center;
+	const Eigen::Vector2f planarDirection = direction.head<2>();
+	const float a = planarDirection.squaredNorm();
+	const float b = 2 * offset.dot(planarDirection);
+	const float c = offset.squaredNorm() - cylinder.radius * cylinder.radius;
+	const float discriminant = b * b - 4 * a * c;
+	if(a < 1e-9 || discriminant < 0)
+	{
+		return std::numeric_limits<float>::infinity();
+	}
+	
+	const float hit = (-b - std::sqrt(discriminant)) / (2 * a);
+	const float hitHeight = origin.z() + hit * direction.z();
+	if(hit <= 0 || hitHeight < 0 || hitHeight > cylinder.height)
+	{
+		return std::numeric_limits<float>::infinity();
+	}
+	return hit;
+}
+
+float SyntheticScene::castRay(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float time) const
+{
+	float closestHit = std::numeric_limits<float>::infinity();
+	if(direction.z() < 0)
+	{
+		closestHit = -origin.z() / direction.z();
+	}
+	for(const Box& box: boxes)
+	{
+		closestHit = std::min(closestHit, intersectBox(box, origin, direction, time));
+	}
+	for(const Cylinder& cylinder: cylinders)
+	{
+		closestHit = std::min(closestHit, intersectCylinder(cylinder, origin, direction));
+	}
+	return closestHit;
+}
+
+PM::TransformationParameters SyntheticScene::getSensorPose(unsigned scanIndex) const
+{
+	float heading;
+	const Eigen::Vector2f position = computeTrajectoryPosition(scanIndex * SCAN_PERIOD, heading);
+	
+	int homogeneousDim = is3D ? 4 : 3;
+	PM::TransformationParameters sensorPose = PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim);
+	sensorPose.topLeftCorner(2, 2) = Eigen::Rotation2Df(heading).toRotationMatrix();
+	sensorPose.topRightCorner(2, 1) = position;
+	if(is3D)
+	{
+		sensorPose(2, 3) = SENSOR_HEIGHT;
+	}
+	return sensorPose;
+}
+
+PM::DataPoints SyntheticScene::generateScan(unsigned scanIndex) const
+{
+	std::seed_seq noiseSeed = {seed, scanIndex};
+	std::mt19937 generator(noiseSeed);
+	std::normal_distribution<float> rangeNoiseDistribution(0, rangeNoise);
+	
+	const float time = scanIndex * SCAN_PERIOD;
+	float heading;
+	const Eigen::Vector2f position = computeTrajectoryPosition(time, heading);
+	const Eigen::Vector3f origin(position.x(), position.y(), SENSOR_HEIGHT);
+	const Eigen::Matrix3f sensorOrientation = Eigen::AngleAxisf(heading, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+	
+	const int euclideanDim = is3D ? 3 : 2;
+	PM::Matrix features(euclideanDim + 1, beamCount * pointsPerBeam);
+	int pointCount = 0;
+	for(unsigned i = 0; i < beamCount; i++)
+	{
+		float elevation = 0;
+		if(beamCount > 1)
+		{
+			elevation = -verticalFieldOfView / 2 + i * verticalFieldOfView / (beamCount - 1);
+		}
+		
+		for(unsigned j = 0; j < pointsPerBeam; j++)
+		{
+			const float azimuth = j * 2 * M_PI / pointsPerBeam;
+			const Eigen::Vector3f directionInSensorFrame(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation));
+			
+			const float range = castRay(origin, sensorOrientation * directionInSensorFrame, time);
+			if(range < MIN_RANGE || range > maxRange)
+			{
+				continue;
+			}
+			
+			const float noisyRange = range + rangeNoiseDistribution(generator);
+			features.col(pointCount).head(euclideanDim) = noisyRange * directionInSensorFrame.head(euclideanDim);
+			features(euclideanDim, pointCount) = 1;
+			pointCount++;
+		}
+	}
+	features.conservativeResize(Eigen::NoChange, pointCount);
+	
+	PM::DataPoints::Labels featureLabels;
+	featureLabels.push_back(PM::DataPoints::Label("x", 1));
+	featureLabels.push_back(PM::DataPoints::Label("y", 1));
+	if(is3D)
+	{
+		featureLabels.push_back(PM::DataPoints::Label("z", 1));
+	}
+	featureLabels.push_back(PM::DataPoints::Label("pad", 1));
+	
+	return PM::DataPoints(features, featureLabels);
+}
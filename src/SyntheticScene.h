@@ -0,0 +1,60 @@
+#ifndef SYNTHETIC_SCENE_H
+#define SYNTHETIC_SCENE_H
+
+#include <pointmatcher/PointMatcher.h>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// Procedural scene scanned by a simulated lidar moving along a figure-eight, deterministic for a given seed
+class SyntheticScene
+{
+private:
+	struct Box
+	{
+		Eigen::Vector3f center;
+		Eigen::Vector3f halfSize;
+		Eigen::Vector3f motionAmplitude;
+		float motionFrequency;
+	};
+	
+	struct Cylinder
+	{
+		Eigen::Vector2f center;
+		float radius;
+		float height;
+	};
+	
+	bool is3D;
+	unsigned beamCount;
+	float verticalFieldOfView;
+	unsigned pointsPerBeam;
+	float maxRange;
+	float rangeNoise;
+	unsigned seed;
+	float trajectorySize;
+	std::vector<Box> boxes;
+	std::vector<Cylinder> cylinders;
+	
+	void generateScene(unsigned obstacleCount, unsigned movingObjectCount);
+	
+	Eigen::Vector2f computeTrajectoryPosition(float time, float& heading) const;
+	
+	float castRay(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float time) const;
+	
+	float intersectBox(const Box& box, const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float time) const;
+	
+	float intersectCylinder(const Cylinder& cylinder, const Eigen::Vector3f& origin, const Eigen::Vector3f& direction) const;
+	
+public:
+	static const float SCAN_PERIOD;
+	
+	SyntheticScene(bool is3D, unsigned beamCount, float verticalFieldOfView, unsigned pointsPerBeam, float maxRange, float rangeNoise,
+				   unsigned obstacleCount, unsigned movingObjectCount, unsigned seed);
+	
+	PM::TransformationParameters getSensorPose(unsigned scanIndex) const;
+	
+	PM::DataPoints generateScan(unsigned scanIndex) const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount):
+		isStopping(false)
+{
+	if(threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	
+	for(unsigned i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	tasksLock.lock();
+	isStopping = true;
+	tasksLock.unlock();
+	taskAvailable.notify_all();
+	
+	for(std::thread& worker: workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while(true)
+	{
+		std::unique_lock<std::mutex> lock(tasksLock);
+		taskAvailable.wait(lock, [this]
+		{
+			return isStopping || !tasks.empty();
+		});
+		if(tasks.empty())
+		{
+			return;
+		}
+		std::function<void()> task = tasks.front();
+		tasks.pop_front();
+		lock.unlock();
+		
+		task();
+	}
+}
+
+std::future<void> ThreadPool::enqueue(const std::function<void()>& task)
+{
+	std::shared_ptr<std::packaged_task<void()>> packagedTask = std::make_shared<std::packaged_task<void()>>(task);
+	std::future<void> future = packagedTask->get_future();
+	
+	tasksLock.lock();
+	tasks.push_back([packagedTask]
+	{
+		(*packagedTask)();
+	});
+	tasksLock.unlock();
+	taskAvailable.notify_one();
+	
+	return future;
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+	return workers.size();
+}
@@ -0,0 +1,35 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads executing tasks in submission order
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	bool isStopping;
+	std::mutex tasksLock;
+	std::condition_variable taskAvailable;
+	
+	void workerLoop();
+	
+public:
+	// a thread count of 0 uses one thread per hardware thread
+	ThreadPool(unsigned threadCount);
+	
+	~ThreadPool();
+	
+	std::future<void> enqueue(const std::function<void()>& task);
+	
+	unsigned getThreadCount() const;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "TileIndex.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+TileIndex::TileIndex(float tileSize):
+		tileSize(tileSize)
+{
+}
+
+std::string TileIndex::retrieveDirectory(const std::string& fileName)
+{
+	size_t slashPosition = fileName.find_last_of('/');
+	if(slashPosition == std::string::npos)
+	{
+		return "";
+	}
+	return fileName.substr(0, slashPosition + 1);
+}
+
+void TileIndex::addTile(const Tile& tile)
+{
+	tiles.push_back(tile);
+}
+
+void TileIndex::save(const std::string& fileName) const
+{
+	std::ofstream stream(fileName.c_str());
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open " + fileName + " for writing.");
+	}
+	
+	// each tile is a line holding its file name, point count, min corner and max corner
+	// corners are written with enough digits to be read back as the same floats, so that no point falls outside the bounds of its tile
+	const std::string directory = retrieveDirectory(fileName);
+	stream << std::setprecision(9);
+	stream << "tile_size " << tileSize << "\n";
+	stream << "dimension " << (tiles.empty() ? 0 : tiles[0].minCorner.size()) << "\n";
+	for(const Tile& tile: tiles)
+	{
+		std::string relativeFileName = tile.fileName;
+		if(!directory.empty() && relativeFileName.compare(0, directory.size(), directory) == 0)
+		{
+			relativeFileName = relativeFileName.substr(directory.size());
+		}
+		stream << relativeFileName << " " << tile.pointCount;
+		for(int i = 0; i < tile.minCorner.size(); i++)
+		{
+			stream << " " << tile.minCorner(i);
+		}
+		for(int i = 0; i < tile.maxCorner.size(); i++)
+		{
+			stream << " " << tile.maxCorner(i);
+		}
+		stream << "\n";
+	}
+	
+	stream.close();
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to write " + fileName + ".");
+	}
+}
+
+TileIndex TileIndex::load(const std::string& fileName)
+{
+	std::ifstream stream(fileName.c_str());
+	if(!stream)
+	{
+		throw std::runtime_error("Unable to open tile index " + fileName + ".");
+	}
+	
+	std::string tileSizeKey;
+	float tileSize;
+	std::string dimensionKey;
+	int dimension;
+	if(!(stream >> tileSizeKey >> tileSize >> dimensionKey >> dimension) || tileSizeKey != "tile_size" || dimensionKey != "dimension")
+	{
+		throw std::runtime_error(fileName + " is not a tile index.");
+	}
+	
+	TileIndex tileIndex(tileSize);
+	const std::string directory = retrieveDirectory(fileName);
+	Tile tile;
+	while(stream >> tile.fileName >> tile.pointCount)
+	{
+		tile.fileName = tile.fileName[0] == '/' ? tile.fileName : directory + tile.fileName;
+		tile.minCorner = PM::Vector(dimension);
+		tile.maxCorner = PM::Vector(dimension);
+		for(int i = 0; i < dimension; i++)
+		{
+			stream >> tile.minCorner(i);
+		}
+		for(int i = 0; i < dimension; i++)
+		{
+			stream >> tile.maxCorner(i);
+		}
+		if(!stream)
+		{
+			throw std::runtime_error("Invalid tile " + tile.fileName + " in tile index " + fileName + ".");
+		}
+		tileIndex.addTile(tile);
+	}
+	return tileIndex;
+}
+
+std::vector<TileIndex::Tile> TileIndex::findTilesInRange(const PM::Vector& center, float radius) const
+{
+	if(radius <= 0)
+	{
+		return tiles;
+	}
+	
+	std::vector<Tile> tilesInRange;
+	for(const Tile& tile: tiles)
+	{
+		if(tile.minCorner.size() != center.size())
+		{
+			throw std::runtime_error("Invalid tile index dimension.");
+		}
+		PM::Vector closestPoint = center.cwiseMax(tile.minCorner).cwiseMin(tile.maxCorner);
+		if((closestPoint - center).norm() < radius)
+		{
+			tilesInRange.push_back(tile);
+		}
+	}
+	return tilesInRange;
+}
+
+float TileIndex::getTileSize() const
+{
+	return tileSize;
+}
+
+const std::vector<TileIndex::Tile>& TileIndex::getTiles() const
+{
+	return tiles;
+}
@@ -0,0 +1,47 @@
+#ifndef TILE_INDEX_H
+#define TILE_INDEX_H
+
+#include <pointmatcher/PointMatcher.h>
+#include <string>
+#include <vector>
+
+typedef float T;
+typedef PointMatcher<T> PM;
+
+// List of the tile files of a map with their bounds, saved as text so that only the tiles needed are loaded
+class TileIndex
+{
+public:
+	struct Tile
+	{
+		std::string fileName;
+		unsigned pointCount;
+		PM::Vector minCorner;
+		PM::Vector maxCorner;
+	};
+	
+private:
+	float tileSize;
+	std::vector<Tile> tiles;
+	
+	static std::string retrieveDirectory(const std::string& fileName);
+	
+public:
+	TileIndex(float tileSize);
+	
+	void addTile(const Tile& tile);
+	
+	// tile file names are saved relative to the directory of the index
+	void save(const std::string& fileName) const;
+	
+	static TileIndex load(const std::string& fileName);
+	
+	// tiles whose bounding box is closer than radius to center, all tiles when radius is 0
+	std::vector<Tile> findTilesInRange(const PM::Vector& center, float radius) const;
+	
+	float getTileSize() const;
+	
+	const std::vector<Tile>& getTiles() const;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "ToolArguments.h"
+#include <stdexcept>
+
+std::map<std::string, std::string> parseArguments(int argc, char** argv)
+{
+	std::map<std::string, std::string> arguments;
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string name = argv[i];
+		if(name.compare(0, 2, "--") != 0)
+		{
+			throw std::runtime_error("Invalid argument: " + name);
+		}
+		arguments[name.substr(2)] = argv[i + 1];
+	}
+	return arguments;
+}
+
+std::string getArgument(const std::map<std::string, std::string>& arguments, const std::string& name, const std::string& defaultValue)
+{
+	std::map<std::string, std::string>::const_iterator it = arguments.find(name);
+	return it != arguments.end() ? it->second : defaultValue;
+}
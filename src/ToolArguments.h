@@ -0,0 +1,12 @@
+#ifndef TOOL_ARGUMENTS_H
+#define TOOL_ARGUMENTS_H
+
+#include <map>
+#include <string>
+
+// arguments of the offline tools, given as "--name value" pairs
+std::map<std::string, std::string> parseArguments(int argc, char** argv);
+
+std::string getArgument(const std::map<std::string, std::string>& arguments, const std::string& name, const std::string& defaultValue);
+
+#endif
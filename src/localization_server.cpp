@@ -0,0 +1,415 @@
+#include "NodeParameters.h"
+#include "Mapper.h"
+#include "SharedMap.h"
+#include "ShardedMap.h"
+#include "ThreadPool.h"
+#include "MapFile.h"
+#include "AtomicTransformation.h"
+#include "LaserScanConverter.h"
+#include "QuantizedCloud.h"
+#include <ros/ros.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include <tf2_ros/transform_listener.h>
+#include <pointmatcher_ros/PointMatcher_ROS.h>
+#include <map_msgs/SaveMap.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include <functional>
+
+// Robot localized against the shared map, with its own registration state and frames prefixed by its name
+struct LocalizationSession
+{
+	std::string name;
+	std::string odomFrame;
+	std::string sensorFrame;
+	std::string robotFrame;
+	std::unique_ptr<Mapper> mapper;
+	AtomicTransformation odomToMap;
+	ros::Subscriber subscriber;
+	ros::Publisher odomPublisher;
+	LaserScanConverter laserScanConverter;
+	std::atomic_bool isBusy;
+	std::atomic_uint processedInputCount;
+	std::atomic_uint droppedInputCount;
+};
+
+std::unique_ptr<NodeParameters> params;
+std::shared_ptr<PM::Transformation> transformation;
+std::shared_ptr<const SharedMap> sharedMap;
+std::shared_ptr<ShardedMap> shardedMap;
+std::vector<std::unique_ptr<LocalizationSession>> sessions;
+std::unique_ptr<ThreadPool> threadPool;
+ros::Publisher mapPublisher;
+ros::Publisher quantizedMapPublisher;
+ros::Publisher diagnosticsPublisher;
+ros::ServiceServer saveMapService;
+std::unique_ptr<tf2_ros::Buffer> tfBuffer;
+std::unique_ptr<tf2_ros::TransformBroadcaster> tfBroadcaster;
+
+// sessions share a read-only map when localizing, and a map locked per tile when they build it together
+void loadMap()
+{
+	PM::DataPoints initialMap;
+	if(!params->initialMapFileName.empty())
+	{
+		// sessions start at the origin of the map frame, whose position in the initial map is the translation of the inverse of its pose
+		int euclideanDim = params->is3D ? 3 : 2;
+		const PM::Vector startPosition = params->initialMapPose.inverse().topRightCorner(euclideanDim, 1);
+		MapFile::Statistics statistics;
+		initialMap = MapFile::load(params->initialMapFileName, startPosition, params->initialMapRadius, *threadPool, statistics);
+		ROS_INFO("Loaded %u map points from %s in %.2f s (%.1f MB/s)", statistics.pointCount, params->initialMapFileName.c_str(), statistics.duration,
+				 statistics.memoryBytes / 1e6 / std::max(statistics.duration, 1e-6f));
+		
+		if(initialMap.getEuclideanDim() != euclideanDim)
+		{
+			throw std::runtime_error("Invalid initial map dimension.");
+		}
+		
+		initialMap = transformation->compute(Mapper::retainMapDescriptors(initialMap, params->mapDescriptors, params->mapReferenceDescriptors,
+																		  params->computeProbDynamic), params->initialMapPose);
+	}
+	
+	if(params->isMapping)
+	{
+		shardedMap = std::make_shared<ShardedMap>(params->sharedMapTileSize);
+		if(initialMap.getNbPoints() > 0)
+		{
+			shardedMap->addPoints(initialMap);
+		}
+	}
+	else
+	{
+		sharedMap = std::make_shared<const SharedMap>(initialMap, params->sharedMapTileSize);
+	}
+}
+
+PM::TransformationParameters findTransform(std::string sourceFrame, std::string targetFrame, ros::Time time, int transformDimension)
+{
+	geometry_msgs::TransformStamped tf = tfBuffer->lookupTransform(targetFrame, sourceFrame, time, ros::Duration(0.1));
+	return PointMatcher_ROS::rosTfToPointMatcherTransformation<T>(tf, transformDimension);
+}
+
+template<typename ValueType>
+diagnostic_msgs::KeyValue toKeyValue(const std::string& key, const ValueType& value)
+{
+	std::stringstream valueStream;
+	valueStream << value;
+	diagnostic_msgs::KeyValue keyValue;
+	keyValue.key = key;
+	keyValue.value = valueStream.str();
+	return keyValue;
+}
+
+// Releases a session once its input is processed, whether it could be localized or not
+struct SessionReleaser
+{
+	LocalizationSession& session;
+	
+	~SessionReleaser()
+	{
+		session.isBusy = false;
+	}
+};
+
+void localizeInput(LocalizationSession& session, const std::function<PM::DataPoints()>& convert, const ros::Time& timeStamp)
+{
+	try
+	{
+		PM::DataPoints input = convert();
+		PM::TransformationParameters sensorToOdom = findTransform(session.sensorFrame, session.odomFrame, timeStamp, input.getHomogeneousDim());
+		PM::TransformationParameters robotToSensor = findTransform(session.robotFrame, session.sensorFrame, timeStamp, input.getHomogeneousDim());
+		
+		session.mapper->preprocessInput(input);
+		PM::TransformationParameters sensorToMapBeforeUpdate = session.odomToMap.load() * sensorToOdom;
+		session.mapper->processInput(input, sensorToMapBeforeUpdate, std::chrono::time_point<std::chrono::steady_clock>(std::chrono::nanoseconds(timeStamp.toNSec())));
+		PM::TransformationParameters sensorToMapAfterUpdate = session.mapper->getSensorPose();
+		session.odomToMap.store(transformation->correctParameters(sensorToMapAfterUpdate * sensorToOdom.inverse()));
+		
+		nav_msgs::Odometry odomMsgOut = PointMatcher_ROS::pointMatcherTransformationToOdomMsg<T>(sensorToMapAfterUpdate * robotToSensor, "map", timeStamp);
+		session.odomPublisher.publish(odomMsgOut);
+		session.processedInputCount++;
+	}
+	catch(tf2::TransformException& ex)
+	{
+		ROS_WARN("%s", ex.what());
+	}
+	catch(const std::exception& e)
+	{
+		ROS_WARN_STREAM("Unable to localize input of session " << session.name << ": " << e.what());
+	}
+}
+
+void submitInput(size_t sessionIndex, const std::function<PM::DataPoints()>& convert, const ros::Time& timeStamp)
+{
+	LocalizationSession& session = *sessions[sessionIndex];
+	
+	// a session registers one input at a time, inputs received in the meantime are dropped to keep its latency bounded
+	if(session.isBusy.exchange(true))
+	{
+		session.droppedInputCount++;
+		return;
+	}
+	
+	threadPool->enqueue([&session, convert, timeStamp]
+	{
+		SessionReleaser sessionReleaser{session};
+		localizeInput(session, convert, timeStamp);
+	});
+}
+
+void pointCloud2Callback(size_t sessionIndex, const sensor_msgs::PointCloud2ConstPtr& cloudMsgIn)
+{
+	submitInput(sessionIndex, [cloudMsgIn]
+	{
+		return PointMatcher_ROS::rosMsgToPointMatcherCloud<T>(*cloudMsgIn);
+	}, cloudMsgIn->header.stamp);
+}
+
+void laserScanCallback(size_t sessionIndex, const sensor_msgs::LaserScanConstPtr& scanMsgIn)
+{
+	// inputs of a session are never converted concurrently, so its converter needs no lock
+	submitInput(sessionIndex, [sessionIndex, scanMsgIn]
+	{
+		return sessions[sessionIndex]->laserScanConverter.convert(*scanMsgIn);
+	}, scanMsgIn->header.stamp);
+}
+
+bool saveMapCallback(map_msgs::SaveMap::Request& req, map_msgs::SaveMap::Response& res)
+{
+	try
+	{
+		ROS_INFO("Saving map to %s", req.filename.data.c_str());
+		MapFile::DescriptorSelector isDescriptorSaved = [](const std::string& descriptorName)
+		{
+			return std::find(params->mapReferenceDescriptors.begin(), params->mapReferenceDescriptors.end(), descriptorName) ==
+				   params->mapReferenceDescriptors.end();
+		};
+		
+		// shards are saved from a snapshot that updates copy only when they change it, and the read-only shared map in place, so that the map is not copied
+		MapFile::Statistics statistics;
+		if(shardedMap)
+		{
+			statistics = MapFile::save(shardedMap->getShardPoints(), req.filename.data, *threadPool, isDescriptorSaved);
+		}
+		else
+		{
+			statistics = MapFile::save(sharedMap->getPoints(), req.filename.data, *threadPool, isDescriptorSaved);
+		}
+		ROS_INFO("Saved %u map points in %.2f s: %.1f MB in memory, %.1f MB on disk (ratio %.2f, %.1f MB/s)", statistics.pointCount, statistics.duration,
+				 statistics.memoryBytes / 1e6, statistics.fileBytes / 1e6, statistics.memoryBytes / std::max<double>(statistics.fileBytes, 1),
+				 statistics.memoryBytes / 1e6 / std::max(statistics.duration, 1e-6f));
+		return true;
+	}
+	catch(const std::runtime_error& e)
+	{
+		ROS_ERROR_STREAM("Unable to save: " << e.what());
+		return false;
+	}
+}
+
+void publishMap(const PM::DataPoints& points)
+{
+	PM::DataPoints map = Mapper::removeReferenceDescriptors(points, params->mapReferenceDescriptors);
+	sensor_msgs::PointCloud2 mapMsgOut = PointMatcher_ROS::pointMatcherCloudToRosMsg<T>(map, "map", ros::Time::now());
+	mapPublisher.publish(mapMsgOut);
+	if(params->publishQuantizedMap)
+	{
+		quantizedMapPublisher.publish(QuantizedCloud::encode(map, params->quantizedMapDescriptors, "map", mapMsgOut.header.stamp));
+	}
+}
+
+void mapPublisherLoop()
+{
+	ros::Rate publishRate(params->mapPublishRate);
+	
+	unsigned lastPublishedUpdateCount = 0;
+	while(ros::ok())
+	{
+		unsigned updateCount = shardedMap->getUpdateCount();
+		if(updateCount != lastPublishedUpdateCount)
+		{
+			publishMap(shardedMap->getPoints());
+			lastPublishedUpdateCount = updateCount;
+		}
+		
+		publishRate.sleep();
+	}
+}
+
+void mapTfPublisherLoop()
+{
+	ros::Rate publishRate(params->mapTfPublishRate);
+	
+	while(ros::ok())
+	{
+		for(const std::unique_ptr<LocalizationSession>& session: sessions)
+		{
+			geometry_msgs::TransformStamped currentOdomToMapTf = PointMatcher_ROS::pointMatcherTransformationToRosTf<T>(session->odomToMap.load(), "map",
+																														session->odomFrame, ros::Time::now());
+			tfBroadcaster->sendTransform(currentOdomToMapTf);
+		}
+		
+		publishRate.sleep();
+	}
+}
+
+void diagnosticsPublisherLoop()
+{
+	ros::Rate publishRate(params->diagnosticsPublishRate);
+	
+	while(ros::ok())
+	{
+		diagnostic_msgs::DiagnosticArray diagnosticsMsgOut;
+		diagnosticsMsgOut.header.stamp = ros::Time::now();
+		
+		diagnostic_msgs::DiagnosticStatus sharedMapStatus;
+		sharedMapStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+		sharedMapStatus.name = "localization_server: shared map";
+		sharedMapStatus.message = "OK";
+		if(shardedMap)
+		{
+			sharedMapStatus.values.push_back(toKeyValue("points", shardedMap->getPointCount()));
+			sharedMapStatus.values.push_back(toKeyValue("tiles", shardedMap->getShardCount()));
+			sharedMapStatus.values.push_back(toKeyValue("updates", shardedMap->getUpdateCount()));
+		}
+		else
+		{
+			sharedMapStatus.values.push_back(toKeyValue("points", sharedMap->getPointCount()));
+			sharedMapStatus.values.push_back(toKeyValue("tiles", sharedMap->getTileCount()));
+			sharedMapStatus.values.push_back(toKeyValue("bytes", Mapper::computeMemoryFootprint(sharedMap->getPoints())));
+		}
+		sharedMapStatus.values.push_back(toKeyValue("worker_threads", threadPool->getThreadCount()));
+		diagnosticsMsgOut.status.push_back(sharedMapStatus);
+		
+		for(const std::unique_ptr<LocalizationSession>& session: sessions)
+		{
+			Mapper::IcpStatistics icpStatistics = session->mapper->getIcpStatistics();
+			
+			diagnostic_msgs::DiagnosticStatus sessionStatus;
+			sessionStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+			sessionStatus.name = "localization_server: " + session->name;
+			sessionStatus.message = "OK";
+			sessionStatus.values.push_back(toKeyValue("processed_inputs", session->processedInputCount));
+			sessionStatus.values.push_back(toKeyValue("dropped_inputs", session->droppedInputCount));
+			sessionStatus.values.push_back(toKeyValue("overlap", icpStatistics.overlap));
+			sessionStatus.values.push_back(toKeyValue("residual", icpStatistics.residual));
+			sessionStatus.values.push_back(toKeyValue("reference_points", session->mapper->getReferencePointCount()));
+			diagnosticsMsgOut.status.push_back(sessionStatus);
+		}
+		
+		diagnosticsPublisher.publish(diagnosticsMsgOut);
+		
+		publishRate.sleep();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "localization_server");
+	ros::NodeHandle n;
+	ros::NodeHandle pn("~");
+	
+	params = std::unique_ptr<NodeParameters>(new NodeParameters(pn));
+	if(params->localizationSessions.empty())
+	{
+		throw std::runtime_error("No localization session was specified.");
+	}
+	
+	transformation = PM::get().TransformationRegistrar.create("RigidTransformation");
+	threadPool = std::unique_ptr<ThreadPool>(new ThreadPool(params->workerThreadCount));
+	
+	loadMap();
+	
+	tfBuffer = std::unique_ptr<tf2_ros::Buffer>(new tf2_ros::Buffer);
+	tf2_ros::TransformListener tfListener(*tfBuffer);
+	tfBroadcaster = std::unique_ptr<tf2_ros::TransformBroadcaster>(new tf2_ros::TransformBroadcaster);
+	
+	int homogeneousDim = params->is3D ? 4 : 3;
+	for(size_t i = 0; i < params->localizationSessions.size(); i++)
+	{
+		std::unique_ptr<LocalizationSession> session(new LocalizationSession);
+		session->name = params->localizationSessions[i];
+		session->odomFrame = session->name + "/" + params->odomFrame;
+		session->sensorFrame = session->name + "/" + params->sensorFrame;
+		session->robotFrame = session->name + "/" + params->robotFrame;
+		session->mapper = std::unique_ptr<Mapper>(new Mapper(params->icpConfig, params->inputFiltersConfig, params->inputFiltersWorldConfig, params->mapPostFiltersConfig,
+															 params->mapUpdateCondition, params->mapUpdateOverlap, params->mapUpdateDelay, params->mapUpdateDistance,
+															 params->minDistNewPoint, params->sensorMaxRange, params->priorDynamic, params->thresholdDynamic,
+															 params->beamHalfAngle, params->epsilonA, params->epsilonD, params->alpha, params->beta,
+															 params->keyframeRegistrationPeriod, params->keyframeMinOverlap, params->mapDescriptors, params->mapReferenceDescriptors,
+															 params->registrationMethod, params->likelihoodFieldResolution, params->likelihoodFieldMaxDistance,
+															 params->is3D, true, params->computeProbDynamic, params->isMapping,
+															 params->applyInputFilters));
+		if(shardedMap)
+		{
+			session->mapper->setShardedMap(shardedMap, PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim), *threadPool);
+		}
+		else
+		{
+			session->mapper->setSharedMap(sharedMap, PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim), *threadPool);
+		}
+		session->odomToMap.store(PM::Matrix::Identity(homogeneousDim, homogeneousDim));
+		session->isBusy = false;
+		session->processedInputCount = 0;
+		session->droppedInputCount = 0;
+		session->odomPublisher = n.advertise<nav_msgs::Odometry>(session->name + "/icp_odom", 50, true);
+		sessions.push_back(std::move(session));
+	}
+	
+	for(size_t i = 0; i < sessions.size(); i++)
+	{
+		std::string topic = sessions[i]->name + "/points_in";
+		if(params->is3D)
+		{
+			sessions[i]->subscriber = n.subscribe<sensor_msgs::PointCloud2>(topic, 1, [i](const sensor_msgs::PointCloud2ConstPtr& cloudMsgIn)
+			{
+				pointCloud2Callback(i, cloudMsgIn);
+			});
+		}
+		else
+		{
+			sessions[i]->subscriber = n.subscribe<sensor_msgs::LaserScan>(topic, 1, [i](const sensor_msgs::LaserScanConstPtr& scanMsgIn)
+			{
+				laserScanCallback(i, scanMsgIn);
+			});
+		}
+	}
+	
+	mapPublisher = n.advertise<sensor_msgs::PointCloud2>("map", 2, true);
+	if(params->publishQuantizedMap)
+	{
+		quantizedMapPublisher = n.advertise<sensor_msgs::PointCloud2>("quantized_map", 2, true);
+	}
+	diagnosticsPublisher = n.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 10);
+	saveMapService = n.advertiseService("save_map", saveMapCallback);
+	
+	std::thread mapPublisherThread;
+	if(shardedMap)
+	{
+		mapPublisherThread = std::thread(mapPublisherLoop);
+	}
+	else
+	{
+		publishMap(sharedMap->getPoints());
+	}
+	std::thread mapTfPublisherThread = std::thread(mapTfPublisherLoop);
+	std::thread diagnosticsPublisherThread = std::thread(diagnosticsPublisherLoop);
+	
+	ros::spin();
+	
+	if(shardedMap)
+	{
+		mapPublisherThread.join();
+	}
+	mapTfPublisherThread.join();
+	diagnosticsPublisherThread.join();
+	
+	// pending registrations and local reference extractions complete before the sessions are destroyed
+	threadPool.reset();
+	
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include "MapMerger.h"
+#include "MapFile.h"
+#include "ThreadPool.h"
+#include "ToolArguments.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+struct MapEntry
+{
+	std::string fileName;
+	std::vector<T> poseValues;
+};
+
+// each line of the list is a map file name, optionally followed by the row-major pose of the map in the merged frame
+std::vector<MapEntry> readMapList(const std::string& mapListFileName)
+{
+	std::ifstream stream(mapListFileName.c_str());
+	if(!stream.good())
+	{
+		throw std::runtime_error("Invalid map list: " + mapListFileName);
+	}
+	
+	std::vector<MapEntry> mapEntries;
+	std::string line;
+	while(std::getline(stream, line))
+	{
+		std::istringstream lineStream(line);
+		MapEntry mapEntry;
+		if(!(lineStream >> mapEntry.fileName) || mapEntry.fileName[0] == '#')
+		{
+			continue;
+		}
+		T value;
+		while(lineStream >> value)
+		{
+			mapEntry.poseValues.push_back(value);
+		}
+		if(!mapEntry.poseValues.empty() && mapEntry.poseValues.size() != 9 && mapEntry.poseValues.size() != 16)
+		{
+			throw std::runtime_error("Invalid pose of map " + mapEntry.fileName);
+		}
+		mapEntries.push_back(mapEntry);
+	}
+	return mapEntries;
+}
+
+int main(int argc, char** argv)
+{
+	std::map<std::string, std::string> arguments;
+	try
+	{
+		arguments = parseArguments(argc, argv);
+		if(arguments.find("maps") == arguments.end())
+		{
+			throw std::runtime_error("Missing map list.");
+		}
+	}
+	catch(const std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << "Usage: map_merge --maps list.txt [--output merged.cmap] [--min_dist_new_point 0.03] [--tile_size 50] [--seam_radius 0] "
+					 "[--worker_thread_count 0] [--work_directory /tmp]" << std::endl;
+		return 1;
+	}
+	
+	try
+	{
+		const std::vector<MapEntry> mapEntries = readMapList(getArgument(arguments, "maps", ""));
+		const std::string outputFileName = getArgument(arguments, "output", "merged.cmap");
+		ThreadPool threadPool(std::stoul(getArgument(arguments, "worker_thread_count", "0")));
+		MapMerger mapMerger(std::stof(getArgument(arguments, "tile_size", "50")), std::stof(getArgument(arguments, "min_dist_new_point", "0.03")),
+							std::stof(getArgument(arguments, "seam_radius", "0")), getArgument(arguments, "work_directory", "/tmp"));
+		std::shared_ptr<PM::Transformation> transformation = PM::get().TransformationRegistrar.create("RigidTransformation");
+		
+		// maps are read one chunk at a time and spilled to disk, those listed first having priority over the next ones where they overlap
+		for(const MapEntry& mapEntry: mapEntries)
+		{
+			const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+			unsigned mapPointCount = 0;
+			MapFile::readChunks(mapEntry.fileName, threadPool, [&](const PM::DataPoints& chunk)
+			{
+				const int homogeneousDim = chunk.getEuclideanDim() + 1;
+				if(mapEntry.poseValues.empty())
+				{
+					mapMerger.addMapChunk(chunk);
+				}
+				else
+				{
+					if(mapEntry.poseValues.size() != static_cast<size_t>(homogeneousDim * homogeneousDim))
+					{
+						throw std::runtime_error("Pose of map " + mapEntry.fileName + " does not match its dimension.");
+					}
+					PM::TransformationParameters pose(homogeneousDim, homogeneousDim);
+					for(int i = 0; i < homogeneousDim * homogeneousDim; i++)
+					{
+						pose(i / homogeneousDim, i % homogeneousDim) = mapEntry.poseValues[i];
+					}
+					mapMerger.addMapChunk(transformation->compute(chunk, pose));
+				}
+				mapPointCount += chunk.getNbPoints();
+			});
+			mapMerger.finishMap();
+			const float duration = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+			std::cout << "Added " << mapPointCount << " points from " << mapEntry.fileName << " (" << duration << " s)" << std::endl;
+		}
+		
+		const MapMerger::Statistics mergeStatistics = mapMerger.merge(threadPool);
+		const MapFile::Statistics saveStatistics = MapFile::save(mapMerger.getMergedMap(), outputFileName, threadPool, [](const std::string& descriptorName)
+		{
+			return true;
+		});
+		
+		std::cout << "Input points: " << mergeStatistics.inputPointCount << std::endl;
+		std::cout << "Duplicate points: " << mergeStatistics.duplicatePointCount << std::endl;
+		std::cout << "Seam normals estimated again: " << mergeStatistics.seamPointCount << std::endl;
+		std::cout << "Merged tiles: " << mergeStatistics.tileCount << std::endl;
+		std::cout << "Merged points: " << mergeStatistics.outputPointCount << std::endl;
+		std::cout << "Saved " << outputFileName << " (" << saveStatistics.fileBytes / 1e6 << " MB) in " << saveStatistics.duration << " s" << std::endl;
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	
+	return 0;
+}
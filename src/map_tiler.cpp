@@ -0,0 +1,61 @@
+#include "MapTiler.h"
+#include "MapFile.h"
+#include "ThreadPool.h"
+#include "ToolArguments.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	std::map<std::string, std::string> arguments;
+	try
+	{
+		arguments = parseArguments(argc, argv);
+		if(arguments.find("map") == arguments.end())
+		{
+			throw std::runtime_error("Missing map.");
+		}
+	}
+	catch(const std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << "Usage: map_tiler --map map.cmap [--output map.tiles] [--tile_size 50] [--extension .cmap] [--min_x -inf] [--max_x inf] "
+					 "[--min_y -inf] [--max_y inf] [--min_z -inf] [--max_z inf] [--worker_thread_count 0] [--work_directory /tmp]" << std::endl;
+		return 1;
+	}
+	
+	try
+	{
+		const std::string mapFileName = getArgument(arguments, "map", "");
+		const std::string outputFileName = getArgument(arguments, "output", "map.tiles");
+		PM::Vector cropMinCorner(3);
+		PM::Vector cropMaxCorner(3);
+		const std::string axisNames[] = {"x", "y", "z"};
+		for(int i = 0; i < 3; i++)
+		{
+			cropMinCorner(i) = std::stof(getArgument(arguments, "min_" + axisNames[i], "-inf"));
+			cropMaxCorner(i) = std::stof(getArgument(arguments, "max_" + axisNames[i], "inf"));
+		}
+		
+		ThreadPool threadPool(std::stoul(getArgument(arguments, "worker_thread_count", "0")));
+		MapTiler mapTiler(std::stof(getArgument(arguments, "tile_size", "50")), cropMinCorner, cropMaxCorner, getArgument(arguments, "work_directory", "/tmp"));
+		
+		// the map is streamed once, chunk by chunk, rather than loaded whole
+		MapFile::readChunks(mapFileName, threadPool, [&mapTiler, &threadPool](const PM::DataPoints& chunk)
+		{
+			mapTiler.addChunk(chunk, threadPool);
+		});
+		const MapTiler::Statistics statistics = mapTiler.save(outputFileName, getArgument(arguments, "extension", ".cmap"), threadPool);
+		
+		std::cout << "Input points: " << statistics.inputPointCount << std::endl;
+		std::cout << "Cropped points: " << statistics.inputPointCount - statistics.outputPointCount << std::endl;
+		std::cout << "Tiles: " << statistics.tileCount << std::endl;
+		std::cout << "Saved index " << outputFileName << std::endl;
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	
+	return 0;
+}
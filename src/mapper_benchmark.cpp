@@ -0,0 +1,222 @@
+#include "Mapper.h"
+#include "SyntheticScene.h"
+#include "ToolArguments.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+std::string formatScanFileName(unsigned scanIndex)
+{
+	std::stringstream fileNameStream;
+	fileNameStream << "scan_" << std::setfill('0') << std::setw(5) << scanIndex << ".vtk";
+	return fileNameStream.str();
+}
+
+void writePose(std::ostream& os, const std::string& scanFileName, const PM::TransformationParameters& pose)
+{
+	os << scanFileName;
+	for(int i = 0; i < pose.rows(); i++)
+	{
+		for(int j = 0; j < pose.cols(); j++)
+		{
+			os << " " << pose(i, j);
+		}
+	}
+	os << std::endl;
+}
+
+bool readPose(std::istream& is, int homogeneousDim, std::string& scanFileName, PM::TransformationParameters& pose)
+{
+	pose = PM::TransformationParameters(homogeneousDim, homogeneousDim);
+	if(!(is >> scanFileName))
+	{
+		return false;
+	}
+	for(int i = 0; i < homogeneousDim * homogeneousDim; i++)
+	{
+		if(!(is >> pose(i / homogeneousDim, i % homogeneousDim)))
+		{
+			throw std::runtime_error("Invalid pose of scan " + scanFileName);
+		}
+	}
+	return true;
+}
+
+PM::TransformationParameters generateOdometryNoise(std::mt19937& generator, float translationNoise, int homogeneousDim)
+{
+	std::normal_distribution<float> noiseDistribution(0, 1);
+	PM::TransformationParameters noise = PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim);
+	noise.topLeftCorner(2, 2) = Eigen::Rotation2Df(0.1 * translationNoise * noiseDistribution(generator)).toRotationMatrix();
+	noise(0, homogeneousDim - 1) = translationNoise * noiseDistribution(generator);
+	noise(1, homogeneousDim - 1) = translationNoise * noiseDistribution(generator);
+	return noise;
+}
+
+void computePoseError(const PM::TransformationParameters& estimatedPose, const PM::TransformationParameters& groundTruthPose, float& translationError,
+					  float& rotationError)
+{
+	const int euclideanDim = estimatedPose.rows() - 1;
+	const PM::TransformationParameters error = groundTruthPose.inverse() * estimatedPose;
+	translationError = error.topRightCorner(euclideanDim, 1).norm();
+	if(euclideanDim == 3)
+	{
+		rotationError = std::acos(std::min(1.0f, std::max(-1.0f, (error.topLeftCorner(3, 3).trace() - 1) / 2)));
+	}
+	else
+	{
+		rotationError = std::abs(std::atan2(error(1, 0), error(0, 0)));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::map<std::string, std::string> arguments;
+	try
+	{
+		arguments = parseArguments(argc, argv);
+		
+		const std::string registrationMethod = getArgument(arguments, "registration_method", "icp");
+		if(registrationMethod != "icp" && registrationMethod != "likelihood_field")
+		{
+			throw std::runtime_error("Invalid registration method: " + registrationMethod);
+		}
+		if(registrationMethod == "likelihood_field" && getArgument(arguments, "is_3D", "true") == "true")
+		{
+			throw std::runtime_error("The likelihood field registration method is only available in 2D.");
+		}
+	}
+	catch(const std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << "Usage: mapper_benchmark [--is_3D true] [--scan_count 300] [--seed 0] [--beam_count 16] [--vertical_fov 0.52] "
+					 "[--points_per_beam 900] [--max_range 80] [--range_noise 0.01] [--obstacle_count 40] [--moving_object_count 5] "
+					 "[--odometry_noise 0.01] [--keyframe_period 1] [--keyframe_min_overlap 0.5] [--registration_method icp] "
+					 "[--likelihood_field_resolution 0.05] [--likelihood_field_max_distance 0.5] [--icp_config file] [--input_filters_config file] "
+					 "[--apply_input_filters false] [--map_post_filters_config file] [--read_sequence directory] [--write_sequence directory] [--output mapper_benchmark.csv]" << std::endl;
+		return 1;
+	}
+	
+	const bool is3D = getArgument(arguments, "is_3D", "true") == "true";
+	const unsigned scanCount = std::stoul(getArgument(arguments, "scan_count", "300"));
+	const unsigned seed = std::stoul(getArgument(arguments, "seed", "0"));
+	const float odometryNoise = std::stof(getArgument(arguments, "odometry_noise", "0.01"));
+	const std::string readSequenceDirectory = getArgument(arguments, "read_sequence", "");
+	const std::string writeSequenceDirectory = getArgument(arguments, "write_sequence", "");
+	const int homogeneousDim = is3D ? 4 : 3;
+	
+	SyntheticScene scene(is3D, std::stoul(getArgument(arguments, "beam_count", "16")), std::stof(getArgument(arguments, "vertical_fov", "0.52")),
+						 std::stoul(getArgument(arguments, "points_per_beam", "900")), std::stof(getArgument(arguments, "max_range", "80")),
+						 std::stof(getArgument(arguments, "range_noise", "0.01")), std::stoul(getArgument(arguments, "obstacle_count", "40")),
+						 std::stoul(getArgument(arguments, "moving_object_count", "5")), seed);
+	
+	Mapper mapper(getArgument(arguments, "icp_config", ""), getArgument(arguments, "input_filters_config", ""), "",
+				  getArgument(arguments, "map_post_filters_config", ""), "overlap", 0.9, 1, 0.5, 0.03, std::stof(getArgument(arguments, "max_range", "80")),
+				  0.6, 0.9, 0.01, 0.01, 0.01, 0.8, 0.99, std::stoi(getArgument(arguments, "keyframe_period", "1")),
+				  std::stof(getArgument(arguments, "keyframe_min_overlap", "0.5")), std::vector<std::string>(), std::vector<std::string>(),
+				  getArgument(arguments, "registration_method", "icp"), std::stof(getArgument(arguments, "likelihood_field_resolution", "0.05")),
+				  std::stof(getArgument(arguments, "likelihood_field_max_distance", "0.5")), is3D, false, false, true,
+				  getArgument(arguments, "apply_input_filters", "false") == "true");
+	std::shared_ptr<PM::Transformation> transformation = PM::get().TransformationRegistrar.create("RigidTransformation");
+	
+	std::ifstream readPosesStream;
+	if(!readSequenceDirectory.empty())
+	{
+		readPosesStream.open((readSequenceDirectory + "/poses.txt").c_str());
+		if(!readPosesStream.good())
+		{
+			std::cerr << "Invalid sequence directory: " << readSequenceDirectory << std::endl;
+			return 1;
+		}
+	}
+	std::ofstream writePosesStream;
+	if(!writeSequenceDirectory.empty())
+	{
+		writePosesStream.open((writeSequenceDirectory + "/poses.txt").c_str());
+		if(!writePosesStream.good())
+		{
+			std::cerr << "Invalid sequence directory: " << writeSequenceDirectory << std::endl;
+			return 1;
+		}
+	}
+	std::ofstream output(getArgument(arguments, "output", "mapper_benchmark.csv").c_str());
+	output << "scan,processing_time,icp_iterations,residual,overlap,reference_points,reading_points,filtering_time,matching_time,"
+			  "minimization_time,keyframe_registration,map_points,translation_error,rotation_error" << std::endl;
+	
+	std::mt19937 odometryNoiseGenerator(seed);
+	PM::TransformationParameters odomToMap = PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim);
+	PM::TransformationParameters sensorToOdom = PM::TransformationParameters::Identity(homogeneousDim, homogeneousDim);
+	PM::TransformationParameters previousGroundTruthPose;
+	float totalProcessingTime = 0;
+	float maxProcessingTime = 0;
+	float translationError = 0;
+	float rotationError = 0;
+	unsigned processedScanCount = 0;
+	for(unsigned i = 0; i < scanCount; i++)
+	{
+		PM::DataPoints scan;
+		PM::TransformationParameters groundTruthPose;
+		std::string scanFileName = formatScanFileName(i);
+		if(!readSequenceDirectory.empty())
+		{
+			if(!readPose(readPosesStream, homogeneousDim, scanFileName, groundTruthPose))
+			{
+				break;
+			}
+			scan = PM::DataPoints::load(readSequenceDirectory + "/" + scanFileName);
+		}
+		else
+		{
+			scan = scene.generateScan(i);
+			groundTruthPose = scene.getSensorPose(i);
+		}
+		
+		if(!writeSequenceDirectory.empty())
+		{
+			scan.save(writeSequenceDirectory + "/" + scanFileName);
+			writePose(writePosesStream, scanFileName, groundTruthPose);
+		}
+		
+		if(i == 0)
+		{
+			sensorToOdom = groundTruthPose;
+		}
+		else
+		{
+			sensorToOdom = sensorToOdom * previousGroundTruthPose.inverse() * groundTruthPose * generateOdometryNoise(odometryNoiseGenerator, odometryNoise, homogeneousDim);
+		}
+		previousGroundTruthPose = groundTruthPose;
+		
+		std::chrono::time_point<std::chrono::steady_clock> timeStamp(std::chrono::milliseconds(static_cast<long>(i * SyntheticScene::SCAN_PERIOD * 1000)));
+		std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+		mapper.preprocessInput(scan);
+		mapper.processInput(scan, odomToMap * sensorToOdom, timeStamp);
+		float processingTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		
+		const PM::TransformationParameters sensorPose = mapper.getSensorPose();
+		odomToMap = transformation->correctParameters(sensorPose * sensorToOdom.inverse());
+		computePoseError(sensorPose, groundTruthPose, translationError, rotationError);
+		
+		Mapper::IcpStatistics icpStatistics = mapper.getIcpStatistics();
+		output << i << "," << processingTime << "," << icpStatistics.iterationCount << "," << icpStatistics.residual << "," << icpStatistics.overlap << ","
+			   << icpStatistics.referencePointCount << "," << icpStatistics.readingPointCount << "," << icpStatistics.filteringTime << ","
+			   << icpStatistics.matchingTime << "," << icpStatistics.minimizationTime << "," << icpStatistics.isKeyframeRegistration << ","
+			   << mapper.getMapPointCount() << "," << translationError << "," << rotationError << std::endl;
+		
+		totalProcessingTime += processingTime;
+		maxProcessingTime = std::max(maxProcessingTime, processingTime);
+		processedScanCount++;
+	}
+	
+	std::cout << "Processed scans: " << processedScanCount << std::endl;
+	std::cout << "Mean processing time: " << (processedScanCount > 0 ? totalProcessingTime / processedScanCount : 0) << " s" << std::endl;
+	std::cout << "Max processing time: " << maxProcessingTime << " s" << std::endl;
+	std::cout << "Final map points: " << mapper.getMapPointCount() << std::endl;
+	std::cout << "Final translation error: " << translationError << " m" << std::endl;
+	std::cout << "Final rotation error: " << rotationError << " rad" << std::endl;
+	
+	return 0;
+}
@@ -1,37 +1,183 @@
 #include "NodeParameters.h"
 #include "Mapper.h"
+#include "LatencyWatchdog.h"
+#include "StationaryDetector.h"
+#include "AtomicTransformation.h"
+#include "LaserScanConverter.h"
+#include "QuantizedCloud.h"
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/transform_listener.h>
 #include <pointmatcher_ros/PointMatcher_ROS.h>
 #include <std_srvs/Empty.h>
 #include <map_msgs/SaveMap.h>
+#include <map_msgs/OccupancyGridUpdate.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <norlab_icp_mapper/GetMapDelta.h>
+#include <norlab_icp_mapper/MapGeneration.h>
 #include <memory>
+#include <atomic>
 #include <mutex>
 #include <thread>
+#include <sstream>
+#include <fstream>
+#include <deque>
+#include <condition_variable>
+#include <functional>
+
+enum Stage
+{
+	RECEPTION,
+	CONVERSION,
+	TF_LOOKUP,
+	PREPROCESSING,
+	SYNCHRONIZATION,
+	QUEUING,
+	REGISTRATION,
+	PUBLICATION,
+	STAGE_COUNT
+};
+const std::vector<std::string> stageNames = {"reception", "conversion", "tf_lookup", "preprocessing", "synchronization", "queuing", "registration", "publication"};
+
+enum SensorStage
+{
+	SENSOR_RECEPTION,
+	SENSOR_CONVERSION,
+	SENSOR_TF_LOOKUP,
+	SENSOR_FILTERING,
+	SENSOR_STAGE_COUNT
+};
+const std::vector<std::string> sensorStageNames = {"reception", "conversion", "tf_lookup", "filtering"};
+
+enum HighRatePoseStage
+{
+	POSE_RECEPTION,
+	POSE_COMPOSITION,
+	POSE_STAGE_COUNT
+};
+const std::vector<std::string> highRatePoseStageNames = {"reception", "composition"};
+
+// Sequence numbers of the last message of an input topic, from which the messages dropped before reaching the callback are counted
+struct MessageSequence
+{
+	bool hasLastSequence = false;
+	std::uint32_t lastSequence = 0;
+};
+
+struct RawSensorInput
+{
+	std::function<PM::DataPoints()> convert;
+	ros::Time timeStamp;
+	size_t bytes;
+	float receptionDuration;
+};
+
+// Input of one lidar, preprocessed on its own thread before being merged with the other lidars
+struct SensorInput
+{
+	std::string frame;
+	PM::DataPointsFilters filters;
+	ros::Subscriber subscriber;
+	std::thread preprocessingThread;
+	std::mutex rawInputsLock;
+	std::condition_variable rawInputAvailable;
+	std::deque<RawSensorInput> rawInputs;
+	std::unique_ptr<LatencyWatchdog> stageTimings;
+	
+	// only used by the subscriber callback
+	MessageSequence messageSequence;
+	
+	// only used by the preprocessing thread
+	LaserScanConverter laserScanConverter;
+	
+	// guarded by sensorSyncLock
+	bool hasPreprocessedInput = false;
+	PM::DataPoints preprocessedInput;
+	PM::TransformationParameters sensorToOdom;
+	ros::Time preprocessedTimeStamp;
+	unsigned unsynchronizedInputCount = 0;
+};
+
+// Input waiting for the registration thread, the next input being converted in the meantime
+struct PendingRegistration
+{
+	PM::DataPoints input;
+	PM::TransformationParameters sensorToOdom;
+	ros::Time timeStamp;
+	std::vector<float> stageDurations;
+	std::chrono::time_point<std::chrono::steady_clock> submissionTime;
+};
+
+// Area searched for the sensor pose, following the odometry since the center pose was estimated
+struct RelocalizationRegion
+{
+	PM::TransformationParameters sensorToMap;
+	PM::TransformationParameters sensorToOdom;
+	float radius;
+	float yawRange;
+};
 
 std::unique_ptr<NodeParameters> params;
 std::shared_ptr<PM::Transformation> transformation;
 std::unique_ptr<Mapper> mapper;
-PM::TransformationParameters odomToMap;
+std::unique_ptr<LatencyWatchdog> latencyWatchdog;
+std::unique_ptr<StationaryDetector> stationaryDetector;
+std::unique_ptr<LatencyWatchdog> highRatePoseWatchdog;
+std::unique_ptr<ThreadPool> threadPool;
+LaserScanConverter laserScanConverter;
+AtomicTransformation odomToMap;
 ros::Subscriber sub;
+ros::Subscriber odomSub;
+ros::Subscriber initialPoseSub;
 ros::Publisher mapPublisher;
+ros::Publisher quantizedMapPublisher;
+ros::Publisher mapGenerationPublisher;
+ros::Publisher occupancyGridPublisher;
+ros::Publisher occupancyGridUpdatePublisher;
+ros::Publisher elevationGridPublisher;
 ros::Publisher odomPublisher;
+ros::Publisher highRatePosePublisher;
+ros::Publisher diagnosticsPublisher;
+ros::Publisher icpStatisticsPublisher;
 ros::ServiceServer reloadYamlConfigService;
 ros::ServiceServer saveMapService;
+ros::ServiceServer getMapDeltaService;
 std::unique_ptr<tf2_ros::Buffer> tfBuffer;
 std::unique_ptr<tf2_ros::TransformBroadcaster> tfBroadcaster;
-std::mutex mapTfLock;
 std::chrono::time_point<std::chrono::steady_clock> lastTimeInputWasProcessed;
 std::mutex idleTimeLock;
+std::atomic_uint missedInputCount(0);
+MessageSequence inputMessageSequence;
+std::vector<std::unique_ptr<SensorInput>> sensorInputs;
+std::mutex sensorSyncLock;
+std::condition_variable sensorInputPreprocessed;
+std::unique_ptr<PendingRegistration> pendingRegistration;
+unsigned droppedRegistrationCount = 0;
+std::mutex pendingRegistrationLock;
+std::condition_variable pendingRegistrationAvailable;
+RelocalizationRegion relocalizationRegion;
+std::unique_ptr<RelocalizationRegion> requestedRelocalizationRegion;
+std::atomic_bool isLocalizationLost(false);
+unsigned relocalizationAttemptCount = 0;
+unsigned relocalizationSuccessCount = 0;
+Mapper::RelocalizationResult lastRelocalizationResult = Mapper::RelocalizationResult();
+std::mutex relocalizationLock;
 
 void loadInitialMap()
 {
 	if(!params->initialMapFileName.empty())
 	{
-		PM::DataPoints initialMap = PM::DataPoints::load(params->initialMapFileName);
-		
+		// the robot starts at the origin of the map frame, whose position in the initial map is the translation of the inverse of its pose
 		int euclideanDim = params->is3D ? 3 : 2;
+		const PM::Vector startPosition = params->initialMapPose.inverse().topRightCorner(euclideanDim, 1);
+		MapFile::Statistics statistics;
+		PM::DataPoints initialMap = MapFile::load(params->initialMapFileName, startPosition, params->initialMapRadius, *threadPool, statistics);
+		ROS_INFO("Loaded %u map points from %s in %.2f s (%.1f MB/s)", statistics.pointCount, params->initialMapFileName.c_str(), statistics.duration,
+				 statistics.memoryBytes / 1e6 / std::max(statistics.duration, 1e-6f));
+		
 		if(initialMap.getEuclideanDim() != euclideanDim)
 		{
 			throw std::runtime_error("Invalid initial map dimension.");
@@ -45,7 +191,10 @@ void loadInitialMap()
 void saveMap(std::string mapFileName)
 {
 	ROS_INFO("Saving map to %s", mapFileName.c_str());
-	mapper->getMap().save(mapFileName);
+	MapFile::Statistics statistics = mapper->saveMap(mapFileName, *threadPool);
+	ROS_INFO("Saved %u map points in %.2f s: %.1f MB in memory, %.1f MB on disk (ratio %.2f, %.1f MB/s)", statistics.pointCount, statistics.duration,
+			 statistics.memoryBytes / 1e6, statistics.fileBytes / 1e6, statistics.memoryBytes / std::max<double>(statistics.fileBytes, 1),
+			 statistics.memoryBytes / 1e6 / std::max(statistics.duration, 1e-6f));
 }
 
 void mapperShutdownLoop()
@@ -78,29 +227,298 @@ PM::TransformationParameters findTransform(std::string sourceFrame, std::string
 	return PointMatcher_ROS::rosTfToPointMatcherTransformation<T>(tf, transformDimension);
 }
 
-void gotInput(PM::DataPoints input, ros::Time timeStamp)
+float lapTime(std::chrono::time_point<std::chrono::steady_clock>& lastLapTime)
 {
-	try
+	std::chrono::time_point<std::chrono::steady_clock> currentTime = std::chrono::steady_clock::now();
+	std::chrono::duration<float> elapsedTime = currentTime - lastLapTime;
+	lastLapTime = currentTime;
+	return elapsedTime.count();
+}
+
+template<typename ValueType>
+diagnostic_msgs::KeyValue toKeyValue(const std::string& key, const ValueType& value)
+{
+	std::stringstream valueStream;
+	valueStream << value;
+	diagnostic_msgs::KeyValue keyValue;
+	keyValue.key = key;
+	keyValue.value = valueStream.str();
+	return keyValue;
+}
+
+void publishDiagnostics(const std::vector<diagnostic_msgs::DiagnosticStatus>& statuses)
+{
+	diagnostic_msgs::DiagnosticArray diagnosticsMsgOut;
+	diagnosticsMsgOut.header.stamp = ros::Time::now();
+	diagnosticsMsgOut.status = statuses;
+	diagnosticsPublisher.publish(diagnosticsMsgOut);
+}
+
+void emitLatencySnapshot(float latency, const std::vector<float>& stageDurations)
+{
+	diagnostic_msgs::DiagnosticStatus snapshot;
+	snapshot.level = diagnostic_msgs::DiagnosticStatus::WARN;
+	snapshot.name = "norlab_icp_mapper: latency overrun";
+	snapshot.message = "Latency deadline overrun rate exceeded";
+	snapshot.values.push_back(toKeyValue("latency", latency));
+	for(int i = 0; i < STAGE_COUNT; i++)
+	{
+		snapshot.values.push_back(toKeyValue(stageNames[i], stageDurations[i]));
+	}
+	snapshot.values.push_back(toKeyValue("map_points", mapper->getMapPointCount()));
+	snapshot.values.push_back(toKeyValue("reference_points", mapper->getReferencePointCount()));
+	snapshot.values.push_back(toKeyValue("icp_iterations", mapper->getIcpStatistics().iterationCount));
+	snapshot.values.push_back(toKeyValue("missed_inputs", missedInputCount.load()));
+	pendingRegistrationLock.lock();
+	snapshot.values.push_back(toKeyValue("dropped_inputs", droppedRegistrationCount));
+	pendingRegistrationLock.unlock();
+	
+	std::stringstream snapshotStream;
+	for(const diagnostic_msgs::KeyValue& keyValue: snapshot.values)
+	{
+		snapshotStream << " " << keyValue.key << "=" << keyValue.value;
+	}
+	ROS_WARN_STREAM(snapshot.message << ":" << snapshotStream.str());
+	
+	publishDiagnostics({snapshot});
+}
+
+void publishIcpStatistics(const Mapper::IcpStatistics& icpStatistics, const ros::Time& timeStamp)
+{
+	diagnostic_msgs::DiagnosticStatus icpStatus;
+	icpStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+	icpStatus.name = "norlab_icp_mapper: icp";
+	icpStatus.message = "ICP statistics of the last scan";
+	icpStatus.values.push_back(toKeyValue("iterations", icpStatistics.iterationCount));
+	icpStatus.values.push_back(toKeyValue("residual", icpStatistics.residual));
+	icpStatus.values.push_back(toKeyValue("overlap", icpStatistics.overlap));
+	icpStatus.values.push_back(toKeyValue("reference_points", icpStatistics.referencePointCount));
+	icpStatus.values.push_back(toKeyValue("reading_points", icpStatistics.readingPointCount));
+	icpStatus.values.push_back(toKeyValue("filtering_time", icpStatistics.filteringTime));
+	icpStatus.values.push_back(toKeyValue("matching_time", icpStatistics.matchingTime));
+	icpStatus.values.push_back(toKeyValue("minimization_time", icpStatistics.minimizationTime));
+	icpStatus.values.push_back(toKeyValue("keyframe_registration", icpStatistics.isKeyframeRegistration));
+	
+	diagnostic_msgs::DiagnosticArray icpStatisticsMsgOut;
+	icpStatisticsMsgOut.header.stamp = timeStamp;
+	icpStatisticsMsgOut.status.push_back(icpStatus);
+	icpStatisticsPublisher.publish(icpStatisticsMsgOut);
+}
+
+std::vector<PM::TransformationParameters> generateCandidateSensorPoses(const PM::TransformationParameters& center, float radius, float yawRange)
+{
+	const int euclideanDim = center.rows() - 1;
+	const int translationStepCount = std::floor(radius / params->relocalizationTranslationStep);
+	const int yawStepCount = std::floor(yawRange / params->relocalizationYawStep);
+	
+	std::vector<std::pair<float, PM::TransformationParameters>> sortedCandidates;
+	for(int i = -translationStepCount; i <= translationStepCount; i++)
+	{
+		for(int j = -translationStepCount; j <= translationStepCount; j++)
+		{
+			const float xOffset = i * params->relocalizationTranslationStep;
+			const float yOffset = j * params->relocalizationTranslationStep;
+			if(xOffset * xOffset + yOffset * yOffset > radius * radius)
+			{
+				continue;
+			}
+			
+			for(int k = -yawStepCount; k <= yawStepCount; k++)
+			{
+				const float yawOffset = k * params->relocalizationYawStep;
+				PM::TransformationParameters candidate = center;
+				candidate.topLeftCorner(2, euclideanDim) = Eigen::Rotation2Df(yawOffset).toRotationMatrix() * center.topLeftCorner(2, euclideanDim);
+				candidate(0, euclideanDim) += xOffset;
+				candidate(1, euclideanDim) += yOffset;
+				sortedCandidates.push_back(std::make_pair(xOffset * xOffset + yOffset * yOffset + yawOffset * yawOffset, candidate));
+			}
+		}
+	}
+	
+	// closest candidates first, so that they are evaluated even when the time bound is reached
+	std::stable_sort(sortedCandidates.begin(), sortedCandidates.end(), [](const std::pair<float, PM::TransformationParameters>& a,
+																		  const std::pair<float, PM::TransformationParameters>& b)
+	{
+		return a.first < b.first;
+	});
+	
+	std::vector<PM::TransformationParameters> candidates;
+	for(const std::pair<float, PM::TransformationParameters>& sortedCandidate: sortedCandidates)
+	{
+		candidates.push_back(sortedCandidate.second);
+	}
+	return candidates;
+}
+
+// returns false when the sensor pose is unknown, in which case the input must not be registered
+bool relocalizeIfNeeded(const PM::DataPoints& input, const PM::TransformationParameters& sensorToOdom)
+{
+	relocalizationLock.lock();
+	if(requestedRelocalizationRegion)
+	{
+		relocalizationRegion = *requestedRelocalizationRegion;
+		requestedRelocalizationRegion.reset();
+		isLocalizationLost = true;
+	}
+	relocalizationLock.unlock();
+	
+	if(!isLocalizationLost)
+	{
+		return true;
+	}
+	
+	PM::TransformationParameters regionCenter = relocalizationRegion.sensorToMap * relocalizationRegion.sensorToOdom.inverse() * sensorToOdom;
+	Mapper::RelocalizationResult result = mapper->relocalize(input, generateCandidateSensorPoses(regionCenter, relocalizationRegion.radius, relocalizationRegion.yawRange),
+															  params->relocalizationVoxelSize, params->relocalizationMinOverlap, params->relocalizationTimeBound, *threadPool);
+	
+	relocalizationLock.lock();
+	relocalizationAttemptCount++;
+	relocalizationSuccessCount += result.isSuccessful;
+	lastRelocalizationResult = result;
+	relocalizationLock.unlock();
+	
+	if(!result.isSuccessful)
+	{
+		ROS_WARN_STREAM("Relocalization failed, best overlap " << result.overlap << " after " << result.evaluatedHypothesisCount << " of "
+															   << result.hypothesisCount << " hypotheses, " << result.failedHypothesisCount << " not converging"
+															   << (result.failureMessage.empty() ? "" : ": " + result.failureMessage));
+		return false;
+	}
+	
+	ROS_INFO_STREAM("Relocalized with overlap " << result.overlap << " after " << result.evaluatedHypothesisCount << " of " << result.hypothesisCount
+												<< " hypotheses in " << result.duration << " s");
+	odomToMap.store(transformation->correctParameters(result.sensorPose * sensorToOdom.inverse()));
+	isLocalizationLost = false;
+	return true;
+}
+
+void updateLocalizationState(const Mapper::IcpStatistics& icpStatistics, const PM::TransformationParameters& sensorToMap,
+							 const PM::TransformationParameters& sensorToOdom)
+{
+	if(params->relocalizationOverlapThreshold == 0 || icpStatistics.referencePointCount == 0)
+	{
+		return;
+	}
+	
+	if(icpStatistics.overlap < params->relocalizationOverlapThreshold)
+	{
+		ROS_WARN_STREAM("Localization lost, overlap " << icpStatistics.overlap);
+		isLocalizationLost = true;
+	}
+	else
+	{
+		relocalizationRegion.sensorToMap = sensorToMap;
+		relocalizationRegion.sensorToOdom = sensorToOdom;
+		relocalizationRegion.radius = params->relocalizationRadius;
+		relocalizationRegion.yawRange = params->relocalizationYawRange;
+	}
+}
+
+void registerInput(PM::DataPoints& input, const PM::TransformationParameters& sensorToOdom, const ros::Time& timeStamp, std::vector<float>& stageDurations,
+				   std::chrono::time_point<std::chrono::steady_clock>& lastLapTime)
+{
+	bool isRegistered = relocalizeIfNeeded(input, sensorToOdom) && stationaryDetector->shouldRegister(sensorToOdom, timeStamp.toSec());
+	PM::TransformationParameters sensorToMapBeforeUpdate = odomToMap.load() * sensorToOdom;
+	PM::TransformationParameters sensorToMapAfterUpdate = sensorToMapBeforeUpdate;
+	if(isRegistered)
 	{
-		PM::TransformationParameters sensorToOdom = findTransform(params->sensorFrame, params->odomFrame, timeStamp, input.getHomogeneousDim());
-		PM::TransformationParameters sensorToMapBeforeUpdate = odomToMap * sensorToOdom;
-		
 		mapper->processInput(input, sensorToMapBeforeUpdate, std::chrono::time_point<std::chrono::steady_clock>(std::chrono::nanoseconds(timeStamp.toNSec())));
-		const PM::TransformationParameters& sensorToMapAfterUpdate = mapper->getSensorPose();
-		
-		mapTfLock.lock();
-		odomToMap = transformation->correctParameters(sensorToMapAfterUpdate * sensorToOdom.inverse());
-		mapTfLock.unlock();
+		sensorToMapAfterUpdate = mapper->getSensorPose();
+		stageDurations[REGISTRATION] = lapTime(lastLapTime);
+		stationaryDetector->reportRegistration(sensorToOdom, sensorToMapAfterUpdate * sensorToMapBeforeUpdate.inverse(), timeStamp.toSec(),
+											   stageDurations[REGISTRATION]);
 		
+		odomToMap.store(transformation->correctParameters(sensorToMapAfterUpdate * sensorToOdom.inverse()));
+		updateLocalizationState(mapper->getIcpStatistics(), sensorToMapAfterUpdate, sensorToOdom);
+	}
+	
+	if(!isLocalizationLost)
+	{
 		PM::TransformationParameters robotToSensor = findTransform(params->robotFrame, params->sensorFrame, timeStamp, input.getHomogeneousDim());
 		PM::TransformationParameters robotToMap = sensorToMapAfterUpdate * robotToSensor;
 		
 		nav_msgs::Odometry odomMsgOut = PointMatcher_ROS::pointMatcherTransformationToOdomMsg<T>(robotToMap, "map", timeStamp);
 		odomPublisher.publish(odomMsgOut);
+	}
+	if(isRegistered)
+	{
+		publishIcpStatistics(mapper->getIcpStatistics(), timeStamp);
+	}
+	stageDurations[PUBLICATION] = lapTime(lastLapTime);
+	
+	float latency = (ros::Time::now() - timeStamp).toSec();
+	if(latencyWatchdog->reportScan(latency, stageDurations))
+	{
+		emitLatencySnapshot(latency, stageDurations);
+	}
+	
+	idleTimeLock.lock();
+	lastTimeInputWasProcessed = std::chrono::steady_clock::now();
+	idleTimeLock.unlock();
+}
+
+void submitInput(PM::DataPoints& input, const PM::TransformationParameters& sensorToOdom, const ros::Time& timeStamp, std::vector<float>& stageDurations,
+				 std::chrono::time_point<std::chrono::steady_clock>& lastLapTime)
+{
+	mapper->preprocessInput(input);
+	stageDurations[PREPROCESSING] += lapTime(lastLapTime);
+	
+	if(!params->isOnline)
+	{
+		registerInput(input, sensorToOdom, timeStamp, stageDurations, lastLapTime);
+		return;
+	}
+	
+	std::unique_ptr<PendingRegistration> registration(new PendingRegistration{input, sensorToOdom, timeStamp, stageDurations, lastLapTime});
+	
+	std::lock_guard<std::mutex> pendingRegistrationLockGuard(pendingRegistrationLock);
+	if(pendingRegistration)
+	{
+		// like the subscriber queue of size 1, a newer input replaces the one not registered yet
+		droppedRegistrationCount++;
+	}
+	mapper->getMemoryAccountant().setBytes("pending_registration", Mapper::computeMemoryFootprint(input));
+	pendingRegistration = std::move(registration);
+	pendingRegistrationAvailable.notify_one();
+}
+
+void registrationLoop()
+{
+	while(ros::ok())
+	{
+		std::unique_lock<std::mutex> pendingRegistrationUniqueLock(pendingRegistrationLock);
+		if(!pendingRegistrationAvailable.wait_for(pendingRegistrationUniqueLock, std::chrono::milliseconds(100), []
+		{
+			return pendingRegistration != nullptr;
+		}))
+		{
+			continue;
+		}
+		std::unique_ptr<PendingRegistration> registration = std::move(pendingRegistration);
+		mapper->getMemoryAccountant().setBytes("pending_registration", 0);
+		pendingRegistrationUniqueLock.unlock();
 		
-		idleTimeLock.lock();
-		lastTimeInputWasProcessed = std::chrono::steady_clock::now();
-		idleTimeLock.unlock();
+		std::chrono::time_point<std::chrono::steady_clock> lastLapTime = registration->submissionTime;
+		registration->stageDurations[QUEUING] = lapTime(lastLapTime);
+		try
+		{
+			registerInput(registration->input, registration->sensorToOdom, registration->timeStamp, registration->stageDurations, lastLapTime);
+		}
+		catch(tf2::TransformException& ex)
+		{
+			ROS_WARN("%s", ex.what());
+		}
+	}
+}
+
+void gotInput(PM::DataPoints input, ros::Time timeStamp, std::vector<float> stageDurations, std::chrono::time_point<std::chrono::steady_clock> lastLapTime)
+{
+	try
+	{
+		PM::TransformationParameters sensorToOdom = findTransform(params->sensorFrame, params->odomFrame, timeStamp, input.getHomogeneousDim());
+		stageDurations[TF_LOOKUP] = lapTime(lastLapTime);
+		
+		submitInput(input, sensorToOdom, timeStamp, stageDurations, lastLapTime);
 	}
 	catch(tf2::TransformException& ex)
 	{
@@ -109,14 +527,229 @@ void gotInput(PM::DataPoints input, ros::Time timeStamp)
 	}
 }
 
+void mergeSensorInputs(PM::DataPoints& input, const PM::TransformationParameters& primarySensorToOdom, const ros::Time& timeStamp)
+{
+	const ros::Duration syncTolerance(params->sensorSyncTolerance);
+	const std::chrono::time_point<std::chrono::steady_clock> syncDeadline =
+			std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(params->sensorSyncTolerance));
+	
+	std::unique_lock<std::mutex> lock(sensorSyncLock);
+	for(size_t i = 1; i < sensorInputs.size(); i++)
+	{
+		SensorInput& sensorInput = *sensorInputs[i];
+		sensorInputPreprocessed.wait_until(lock, syncDeadline, [&]
+		{
+			return sensorInput.hasPreprocessedInput && sensorInput.preprocessedTimeStamp >= timeStamp - syncTolerance;
+		});
+		
+		if(sensorInput.hasPreprocessedInput && sensorInput.preprocessedTimeStamp >= timeStamp - syncTolerance &&
+		   sensorInput.preprocessedTimeStamp <= timeStamp + syncTolerance)
+		{
+			// both clouds are expressed in the primary sensor frame, which is rigidly attached to the map frame used for registration
+			PM::TransformationParameters sensorToPrimarySensor = primarySensorToOdom.inverse() * sensorInput.sensorToOdom;
+			input.concatenate(transformation->compute(sensorInput.preprocessedInput, sensorToPrimarySensor));
+			sensorInput.hasPreprocessedInput = false;
+		}
+		else
+		{
+			sensorInput.unsynchronizedInputCount++;
+		}
+	}
+}
+
+void sensorPreprocessingLoop(size_t sensorIndex)
+{
+	SensorInput& sensorInput = *sensorInputs[sensorIndex];
+	
+	while(ros::ok())
+	{
+		std::unique_lock<std::mutex> rawInputsLock(sensorInput.rawInputsLock);
+		if(!sensorInput.rawInputAvailable.wait_for(rawInputsLock, std::chrono::milliseconds(100), [&]
+		{
+			return !sensorInput.rawInputs.empty();
+		}))
+		{
+			continue;
+		}
+		RawSensorInput rawInput = sensorInput.rawInputs.front();
+		sensorInput.rawInputs.pop_front();
+		rawInputsLock.unlock();
+		
+		std::chrono::time_point<std::chrono::steady_clock> lastLapTime = std::chrono::steady_clock::now();
+		std::vector<float> sensorStageDurations(SENSOR_STAGE_COUNT, 0);
+		sensorStageDurations[SENSOR_RECEPTION] = rawInput.receptionDuration;
+		PM::DataPoints input = rawInput.convert();
+		sensorStageDurations[SENSOR_CONVERSION] = lapTime(lastLapTime);
+		
+		try
+		{
+			PM::TransformationParameters sensorToOdom = findTransform(sensorInput.frame, params->odomFrame, rawInput.timeStamp, input.getHomogeneousDim());
+			sensorStageDurations[SENSOR_TF_LOOKUP] = lapTime(lastLapTime);
+			
+			sensorInput.filters.apply(input);
+			sensorStageDurations[SENSOR_FILTERING] = lapTime(lastLapTime);
+			sensorInput.stageTimings->reportScan((ros::Time::now() - rawInput.timeStamp).toSec(), sensorStageDurations);
+			
+			if(sensorIndex == 0)
+			{
+				std::vector<float> stageDurations(STAGE_COUNT, 0);
+				stageDurations[RECEPTION] = sensorStageDurations[SENSOR_RECEPTION];
+				stageDurations[CONVERSION] = sensorStageDurations[SENSOR_CONVERSION];
+				stageDurations[TF_LOOKUP] = sensorStageDurations[SENSOR_TF_LOOKUP];
+				stageDurations[PREPROCESSING] = sensorStageDurations[SENSOR_FILTERING];
+				
+				mergeSensorInputs(input, sensorToOdom, rawInput.timeStamp);
+				stageDurations[SYNCHRONIZATION] = lapTime(lastLapTime);
+				
+				submitInput(input, sensorToOdom, rawInput.timeStamp, stageDurations, lastLapTime);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> sensorSyncLockGuard(sensorSyncLock);
+				sensorInput.preprocessedInput = input;
+				sensorInput.sensorToOdom = sensorToOdom;
+				sensorInput.preprocessedTimeStamp = rawInput.timeStamp;
+				sensorInput.hasPreprocessedInput = true;
+				sensorInputPreprocessed.notify_all();
+			}
+		}
+		catch(tf2::TransformException& ex)
+		{
+			ROS_WARN("%s", ex.what());
+		}
+		
+		mapper->getMemoryAccountant().removeBytes("queued_inputs", rawInput.bytes);
+	}
+}
+
+// messages missing between two consecutive sequence numbers were dropped by the subscriber queue or the transport, a lower number meaning that the
+// publisher restarted
+void countMissedInputs(MessageSequence& messageSequence, const std_msgs::Header& header)
+{
+	if(messageSequence.hasLastSequence && header.seq > messageSequence.lastSequence)
+	{
+		missedInputCount += header.seq - messageSequence.lastSequence - 1;
+	}
+	messageSequence.hasLastSequence = true;
+	messageSequence.lastSequence = header.seq;
+}
+
+void enqueueSensorInput(size_t sensorIndex, const std::function<PM::DataPoints()>& convert, const ros::Time& timeStamp, size_t bytes)
+{
+	SensorInput& sensorInput = *sensorInputs[sensorIndex];
+	mapper->getMemoryAccountant().addBytes("queued_inputs", bytes);
+	RawSensorInput rawInput = {convert, timeStamp, bytes, static_cast<float>((ros::Time::now() - timeStamp).toSec())};
+	
+	std::lock_guard<std::mutex> rawInputsLockGuard(sensorInput.rawInputsLock);
+	if(params->isOnline && !sensorInput.rawInputs.empty())
+	{
+		// only the most recent input of each sensor is worth preprocessing online
+		mapper->getMemoryAccountant().removeBytes("queued_inputs", sensorInput.rawInputs.front().bytes);
+		sensorInput.rawInputs.pop_front();
+	}
+	sensorInput.rawInputs.push_back(rawInput);
+	sensorInput.rawInputAvailable.notify_one();
+}
+
+void sensorPointCloud2Callback(size_t sensorIndex, const sensor_msgs::PointCloud2ConstPtr& cloudMsgIn)
+{
+	countMissedInputs(sensorInputs[sensorIndex]->messageSequence, cloudMsgIn->header);
+	enqueueSensorInput(sensorIndex, [cloudMsgIn]
+	{
+		return PointMatcher_ROS::rosMsgToPointMatcherCloud<T>(*cloudMsgIn);
+	}, cloudMsgIn->header.stamp, cloudMsgIn->data.size());
+}
+
+void sensorLaserScanCallback(size_t sensorIndex, const sensor_msgs::LaserScanConstPtr& scanMsgIn)
+{
+	countMissedInputs(sensorInputs[sensorIndex]->messageSequence, scanMsgIn->header);
+	enqueueSensorInput(sensorIndex, [sensorIndex, scanMsgIn]
+	{
+		return sensorInputs[sensorIndex]->laserScanConverter.convert(*scanMsgIn);
+	}, scanMsgIn->header.stamp, (scanMsgIn->ranges.size() + scanMsgIn->intensities.size()) * sizeof(float));
+}
+
 void pointCloud2Callback(const sensor_msgs::PointCloud2& cloudMsgIn)
 {
-	gotInput(PointMatcher_ROS::rosMsgToPointMatcherCloud<T>(cloudMsgIn), cloudMsgIn.header.stamp);
+	countMissedInputs(inputMessageSequence, cloudMsgIn.header);
+	mapper->getMemoryAccountant().addBytes("queued_inputs", cloudMsgIn.data.size());
+	std::chrono::time_point<std::chrono::steady_clock> lastLapTime = std::chrono::steady_clock::now();
+	std::vector<float> stageDurations(STAGE_COUNT, 0);
+	stageDurations[RECEPTION] = (ros::Time::now() - cloudMsgIn.header.stamp).toSec();
+	PM::DataPoints input = PointMatcher_ROS::rosMsgToPointMatcherCloud<T>(cloudMsgIn);
+	stageDurations[CONVERSION] = lapTime(lastLapTime);
+	gotInput(input, cloudMsgIn.header.stamp, stageDurations, lastLapTime);
+	mapper->getMemoryAccountant().removeBytes("queued_inputs", cloudMsgIn.data.size());
 }
 
 void laserScanCallback(const sensor_msgs::LaserScan& scanMsgIn)
 {
-	gotInput(PointMatcher_ROS::rosMsgToPointMatcherCloud<T>(scanMsgIn), scanMsgIn.header.stamp);
+	countMissedInputs(inputMessageSequence, scanMsgIn.header);
+	size_t scanMsgInBytes = (scanMsgIn.ranges.size() + scanMsgIn.intensities.size()) * sizeof(float);
+	mapper->getMemoryAccountant().addBytes("queued_inputs", scanMsgInBytes);
+	std::chrono::time_point<std::chrono::steady_clock> lastLapTime = std::chrono::steady_clock::now();
+	std::vector<float> stageDurations(STAGE_COUNT, 0);
+	stageDurations[RECEPTION] = (ros::Time::now() - scanMsgIn.header.stamp).toSec();
+	PM::DataPoints input = laserScanConverter.convert(scanMsgIn);
+	stageDurations[CONVERSION] = lapTime(lastLapTime);
+	gotInput(input, scanMsgIn.header.stamp, stageDurations, lastLapTime);
+	mapper->getMemoryAccountant().removeBytes("queued_inputs", scanMsgInBytes);
+}
+
+void odomCallback(const nav_msgs::Odometry& odomMsgIn)
+{
+	std::chrono::time_point<std::chrono::steady_clock> lastLapTime = std::chrono::steady_clock::now();
+	std::vector<float> stageDurations(POSE_STAGE_COUNT, 0);
+	stageDurations[POSE_RECEPTION] = (ros::Time::now() - odomMsgIn.header.stamp).toSec();
+	
+	// the correction is read without locking so that a registration in progress never delays the pose
+	PM::TransformationParameters currentOdomToMap = odomToMap.load();
+	PM::TransformationParameters robotToOdom = PointMatcher_ROS::odomMsgToPointMatcherTransformation<T>(odomMsgIn, currentOdomToMap.rows());
+	
+	nav_msgs::Odometry poseMsgOut = PointMatcher_ROS::pointMatcherTransformationToOdomMsg<T>(currentOdomToMap * robotToOdom, "map", odomMsgIn.header.stamp);
+	poseMsgOut.child_frame_id = odomMsgIn.child_frame_id;
+	poseMsgOut.twist = odomMsgIn.twist;
+	highRatePosePublisher.publish(poseMsgOut);
+	stageDurations[POSE_COMPOSITION] = lapTime(lastLapTime);
+	
+	highRatePoseWatchdog->reportScan((ros::Time::now() - odomMsgIn.header.stamp).toSec(), stageDurations);
+}
+
+void initialPoseCallback(const geometry_msgs::PoseWithCovarianceStamped& poseMsgIn)
+{
+	if(poseMsgIn.header.frame_id != "map")
+	{
+		ROS_WARN_STREAM("Ignoring initial pose expressed in frame " << poseMsgIn.header.frame_id << " instead of map");
+		return;
+	}
+	
+	try
+	{
+		const int homogeneousDim = params->is3D ? 4 : 3;
+		geometry_msgs::TransformStamped robotToMapTf;
+		robotToMapTf.transform.translation.x = poseMsgIn.pose.pose.position.x;
+		robotToMapTf.transform.translation.y = poseMsgIn.pose.pose.position.y;
+		robotToMapTf.transform.translation.z = poseMsgIn.pose.pose.position.z;
+		robotToMapTf.transform.rotation = poseMsgIn.pose.pose.orientation;
+		PM::TransformationParameters robotToMap = PointMatcher_ROS::rosTfToPointMatcherTransformation<T>(robotToMapTf, homogeneousDim);
+		
+		std::unique_ptr<RelocalizationRegion> region(new RelocalizationRegion);
+		region->sensorToMap = robotToMap * findTransform(params->sensorFrame, params->robotFrame, poseMsgIn.header.stamp, homogeneousDim);
+		region->sensorToOdom = findTransform(params->sensorFrame, params->odomFrame, poseMsgIn.header.stamp, homogeneousDim);
+		
+		// the region spans three standard deviations of the given pose, or the default extent when no covariance is given
+		const double translationVariance = std::max(poseMsgIn.pose.covariance[0], poseMsgIn.pose.covariance[7]);
+		const double yawVariance = poseMsgIn.pose.covariance[35];
+		region->radius = translationVariance > 0 ? 3 * std::sqrt(translationVariance) : params->relocalizationRadius;
+		region->yawRange = yawVariance > 0 ? std::min(M_PI, 3 * std::sqrt(yawVariance)) : params->relocalizationYawRange;
+		
+		std::lock_guard<std::mutex> relocalizationLockGuard(relocalizationLock);
+		requestedRelocalizationRegion = std::move(region);
+	}
+	catch(tf2::TransformException& ex)
+	{
+		ROS_WARN("%s", ex.what());
+	}
 }
 
 bool reloadYamlConfigCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res)
@@ -139,17 +772,113 @@ bool saveMapCallback(map_msgs::SaveMap::Request& req, map_msgs::SaveMap::Respons
 	}
 }
 
+bool getMapDeltaCallback(norlab_icp_mapper::GetMapDelta::Request& req, norlab_icp_mapper::GetMapDelta::Response& res)
+{
+	Mapper::MapDelta delta = mapper->getMapDelta(req.since_epoch, req.since_generation);
+	res.epoch = delta.epoch;
+	res.generation = delta.generation;
+	res.is_full = delta.isFull;
+	res.chunk_count = delta.chunkCount;
+	res.chunk_indexes = delta.chunkIndexes;
+	ros::Time stamp = ros::Time::now();
+	for(const PM::DataPoints& chunk: delta.chunks)
+	{
+		res.chunks.push_back(PointMatcher_ROS::pointMatcherCloudToRosMsg<T>(chunk, "map", stamp));
+	}
+	return true;
+}
+
 void mapPublisherLoop()
 {
 	ros::Rate publishRate(params->mapPublishRate);
 	
 	PM::DataPoints newMap;
+	std::uint64_t newMapGeneration;
 	while(ros::ok())
 	{
-		if(mapper->getNewMap(newMap))
+		if(mapper->getNewMap(newMap, newMapGeneration))
 		{
 			sensor_msgs::PointCloud2 mapMsgOut = PointMatcher_ROS::pointMatcherCloudToRosMsg<T>(newMap, "map", ros::Time::now());
+			size_t publishedBytes = Mapper::computeMemoryFootprint(newMap) + mapMsgOut.data.size();
 			mapPublisher.publish(mapMsgOut);
+			
+			if(params->publishQuantizedMap)
+			{
+				sensor_msgs::PointCloud2 quantizedMapMsgOut = QuantizedCloud::encode(newMap, params->quantizedMapDescriptors, "map", mapMsgOut.header.stamp);
+				publishedBytes += quantizedMapMsgOut.data.size();
+				quantizedMapPublisher.publish(quantizedMapMsgOut);
+			}
+			mapper->getMemoryAccountant().setBytes("published_map", publishedBytes);
+			
+			norlab_icp_mapper::MapGeneration generationMsgOut;
+			generationMsgOut.epoch = mapper->getMapEpoch();
+			generationMsgOut.generation = newMapGeneration;
+			mapGenerationPublisher.publish(generationMsgOut);
+		}
+		
+		publishRate.sleep();
+	}
+}
+
+void occupancyGridPublisherLoop()
+{
+	ros::Rate publishRate(params->occupancyGridPublishRate);
+	
+	OccupancyGrid::Patch patch;
+	unsigned lastSubscriberCount = 0;
+	while(ros::ok())
+	{
+		// updates only make sense to subscribers that received the full grid, which is sent again when one subscribes
+		unsigned subscriberCount = occupancyGridPublisher.getNumSubscribers();
+		bool isFullGridRequested = !params->occupancyGridPublishUpdates || subscriberCount > lastSubscriberCount;
+		lastSubscriberCount = subscriberCount;
+		
+		if(mapper->getOccupancyGridChanges(patch, isFullGridRequested))
+		{
+			ros::Time timeStamp = ros::Time::now();
+			if(patch.isFullGrid)
+			{
+				nav_msgs::OccupancyGrid gridMsgOut;
+				gridMsgOut.header.frame_id = "map";
+				gridMsgOut.header.stamp = timeStamp;
+				gridMsgOut.info.map_load_time = timeStamp;
+				gridMsgOut.info.resolution = patch.resolution;
+				gridMsgOut.info.width = patch.gridWidth;
+				gridMsgOut.info.height = patch.gridHeight;
+				gridMsgOut.info.origin.position.x = patch.originX;
+				gridMsgOut.info.origin.position.y = patch.originY;
+				gridMsgOut.info.origin.orientation.w = 1;
+				gridMsgOut.data.assign(patch.cells.begin(), patch.cells.end());
+				occupancyGridPublisher.publish(gridMsgOut);
+			}
+			else
+			{
+				map_msgs::OccupancyGridUpdate updateMsgOut;
+				updateMsgOut.header.frame_id = "map";
+				updateMsgOut.header.stamp = timeStamp;
+				updateMsgOut.x = patch.x;
+				updateMsgOut.y = patch.y;
+				updateMsgOut.width = patch.width;
+				updateMsgOut.height = patch.height;
+				updateMsgOut.data.assign(patch.cells.begin(), patch.cells.end());
+				occupancyGridUpdatePublisher.publish(updateMsgOut);
+			}
+		}
+		
+		publishRate.sleep();
+	}
+}
+
+void elevationGridPublisherLoop()
+{
+	ros::Rate publishRate(params->elevationGridPublishRate);
+	
+	PM::DataPoints elevationGrid;
+	while(ros::ok())
+	{
+		if(mapper->getNewElevationGrid(elevationGrid))
+		{
+			elevationGridPublisher.publish(PointMatcher_ROS::pointMatcherCloudToRosMsg<T>(elevationGrid, "map", ros::Time::now()));
 		}
 		
 		publishRate.sleep();
@@ -162,9 +891,7 @@ void mapTfPublisherLoop()
 	
 	while(ros::ok())
 	{
-		mapTfLock.lock();
-		PM::TransformationParameters currentOdomToMap = odomToMap;
-		mapTfLock.unlock();
+		PM::TransformationParameters currentOdomToMap = odomToMap.load();
 		
 		geometry_msgs::TransformStamped currentOdomToMapTf = PointMatcher_ROS::pointMatcherTransformationToRosTf<T>(currentOdomToMap, "map", params->odomFrame,
 																													ros::Time::now());
@@ -174,6 +901,148 @@ void mapTfPublisherLoop()
 	}
 }
 
+void addLockStatistics(diagnostic_msgs::DiagnosticStatus& status, const std::string& lockName, const ProfiledMutex::Statistics& statistics)
+{
+	status.values.push_back(toKeyValue(lockName + "_acquisitions", statistics.lockCount));
+	status.values.push_back(toKeyValue(lockName + "_contentions", statistics.contentionCount));
+	status.values.push_back(toKeyValue(lockName + "_max_contenders", statistics.maxContenderCount));
+	status.values.push_back(toKeyValue(lockName + "_total_wait", statistics.totalWaitTime));
+	status.values.push_back(toKeyValue(lockName + "_max_wait", statistics.maxWaitTime));
+	status.values.push_back(toKeyValue(lockName + "_total_hold", statistics.totalHoldTime));
+	status.values.push_back(toKeyValue(lockName + "_max_hold", statistics.maxHoldTime));
+}
+
+void diagnosticsPublisherLoop()
+{
+	ros::Rate publishRate(params->diagnosticsPublishRate);
+	
+	while(ros::ok())
+	{
+		LatencyWatchdog::Statistics latencyStatistics = latencyWatchdog->getStatistics();
+		
+		diagnostic_msgs::DiagnosticStatus latencyStatus;
+		latencyStatus.name = "norlab_icp_mapper: latency";
+		if(params->latencyDeadline > 0 && latencyStatistics.maxLatency > params->latencyDeadline)
+		{
+			latencyStatus.level = diagnostic_msgs::DiagnosticStatus::WARN;
+			latencyStatus.message = "Latency deadline overrun";
+		}
+		else
+		{
+			latencyStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+			latencyStatus.message = "OK";
+		}
+		latencyStatus.values.push_back(toKeyValue("scans", latencyStatistics.scanCount));
+		latencyStatus.values.push_back(toKeyValue("overruns", latencyStatistics.overrunCount));
+		pendingRegistrationLock.lock();
+		latencyStatus.values.push_back(toKeyValue("dropped_inputs", droppedRegistrationCount));
+		pendingRegistrationLock.unlock();
+		latencyStatus.values.push_back(toKeyValue("missed_inputs", missedInputCount.load()));
+		latencyStatus.values.push_back(toKeyValue("mean_latency", latencyStatistics.meanLatency));
+		latencyStatus.values.push_back(toKeyValue("max_latency", latencyStatistics.maxLatency));
+		for(const LatencyWatchdog::StageStatistics& stage: latencyStatistics.stages)
+		{
+			latencyStatus.values.push_back(toKeyValue(stage.name + "_mean", stage.meanDuration));
+			latencyStatus.values.push_back(toKeyValue(stage.name + "_max", stage.maxDuration));
+			latencyStatus.values.push_back(toKeyValue(stage.name + "_overruns", stage.overrunCount));
+		}
+		
+		diagnostic_msgs::DiagnosticStatus memoryStatus;
+		memoryStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+		memoryStatus.name = "norlab_icp_mapper: memory";
+		memoryStatus.message = "Memory usage in bytes";
+		MemoryAccountant::ProcessMemory processMemory = MemoryAccountant::getProcessMemory();
+		memoryStatus.values.push_back(toKeyValue("process_rss", processMemory.residentBytes));
+		memoryStatus.values.push_back(toKeyValue("process_rss_high_water", processMemory.residentHighWaterMark));
+		for(const MemoryAccountant::Component& component: mapper->getMemoryAccountant().getComponents())
+		{
+			memoryStatus.values.push_back(toKeyValue(component.name, component.bytes));
+			memoryStatus.values.push_back(toKeyValue(component.name + "_high_water", component.highWaterMark));
+		}
+		memoryStatus.values.push_back(toKeyValue("map_descriptors_dropped", mapper->getDroppedDescriptorBytes()));
+		
+		std::vector<diagnostic_msgs::DiagnosticStatus> statuses = {latencyStatus, memoryStatus};
+		
+		LatencyWatchdog::Statistics highRatePoseStatistics = highRatePoseWatchdog->getStatistics();
+		diagnostic_msgs::DiagnosticStatus highRatePoseStatus;
+		highRatePoseStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+		highRatePoseStatus.name = "norlab_icp_mapper: high rate pose";
+		highRatePoseStatus.message = "Latency of the poses composed from odometry";
+		highRatePoseStatus.values.push_back(toKeyValue("poses", highRatePoseStatistics.scanCount));
+		highRatePoseStatus.values.push_back(toKeyValue("mean_latency", highRatePoseStatistics.meanLatency));
+		highRatePoseStatus.values.push_back(toKeyValue("max_latency", highRatePoseStatistics.maxLatency));
+		for(const LatencyWatchdog::StageStatistics& stage: highRatePoseStatistics.stages)
+		{
+			highRatePoseStatus.values.push_back(toKeyValue(stage.name + "_mean", stage.meanDuration));
+			highRatePoseStatus.values.push_back(toKeyValue(stage.name + "_max", stage.maxDuration));
+		}
+		statuses.push_back(highRatePoseStatus);
+		
+		diagnostic_msgs::DiagnosticStatus relocalizationStatus;
+		relocalizationStatus.name = "norlab_icp_mapper: relocalization";
+		relocalizationStatus.level = isLocalizationLost ? diagnostic_msgs::DiagnosticStatus::ERROR : diagnostic_msgs::DiagnosticStatus::OK;
+		relocalizationStatus.message = isLocalizationLost ? "Localization lost" : "Localized";
+		relocalizationLock.lock();
+		relocalizationStatus.values.push_back(toKeyValue("attempts", relocalizationAttemptCount));
+		relocalizationStatus.values.push_back(toKeyValue("successes", relocalizationSuccessCount));
+		relocalizationStatus.values.push_back(toKeyValue("last_overlap", lastRelocalizationResult.overlap));
+		relocalizationStatus.values.push_back(toKeyValue("last_hypotheses", lastRelocalizationResult.hypothesisCount));
+		relocalizationStatus.values.push_back(toKeyValue("last_evaluated_hypotheses", lastRelocalizationResult.evaluatedHypothesisCount));
+		relocalizationStatus.values.push_back(toKeyValue("last_failed_hypotheses", lastRelocalizationResult.failedHypothesisCount));
+		relocalizationStatus.values.push_back(toKeyValue("last_duration", lastRelocalizationResult.duration));
+		relocalizationLock.unlock();
+		statuses.push_back(relocalizationStatus);
+		
+		StationaryDetector::Statistics stationaryStatistics = stationaryDetector->getStatistics();
+		diagnostic_msgs::DiagnosticStatus stationaryStatus;
+		stationaryStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+		stationaryStatus.name = "norlab_icp_mapper: stationary";
+		stationaryStatus.message = stationaryStatistics.isStationary ? "Stationary, registration rate reduced" : "Moving";
+		stationaryStatus.values.push_back(toKeyValue("is_stationary", stationaryStatistics.isStationary));
+		stationaryStatus.values.push_back(toKeyValue("registered_scans", stationaryStatistics.registeredScanCount));
+		stationaryStatus.values.push_back(toKeyValue("skipped_scans", stationaryStatistics.skippedScanCount));
+		stationaryStatus.values.push_back(toKeyValue("saved_registration_time", stationaryStatistics.savedRegistrationTime));
+		statuses.push_back(stationaryStatus);
+		
+		for(const std::unique_ptr<SensorInput>& sensorInput: sensorInputs)
+		{
+			LatencyWatchdog::Statistics sensorStatistics = sensorInput->stageTimings->getStatistics();
+			
+			diagnostic_msgs::DiagnosticStatus sensorStatus;
+			sensorStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+			sensorStatus.name = "norlab_icp_mapper: sensor " + sensorInput->frame;
+			sensorStatus.message = "Preprocessing stage timings";
+			sensorStatus.values.push_back(toKeyValue("scans", sensorStatistics.scanCount));
+			sensorStatus.values.push_back(toKeyValue("mean_latency", sensorStatistics.meanLatency));
+			sensorStatus.values.push_back(toKeyValue("max_latency", sensorStatistics.maxLatency));
+			for(const LatencyWatchdog::StageStatistics& stage: sensorStatistics.stages)
+			{
+				sensorStatus.values.push_back(toKeyValue(stage.name + "_mean", stage.meanDuration));
+				sensorStatus.values.push_back(toKeyValue(stage.name + "_max", stage.maxDuration));
+			}
+			sensorSyncLock.lock();
+			sensorStatus.values.push_back(toKeyValue("unsynchronized_inputs", sensorInput->unsynchronizedInputCount));
+			sensorSyncLock.unlock();
+			statuses.push_back(sensorStatus);
+		}
+		
+		if(ProfiledMutex::isProfilingEnabled())
+		{
+			diagnostic_msgs::DiagnosticStatus lockStatus;
+			lockStatus.level = diagnostic_msgs::DiagnosticStatus::OK;
+			lockStatus.name = "norlab_icp_mapper: locks";
+			lockStatus.message = "Lock contention since startup";
+			addLockStatistics(lockStatus, "map_lock", mapper->getMapLockStatistics());
+			addLockStatistics(lockStatus, "icp_map_lock", mapper->getIcpMapLockStatistics());
+			statuses.push_back(lockStatus);
+		}
+		
+		publishDiagnostics(statuses);
+		
+		publishRate.sleep();
+	}
+}
+
 int main(int argc, char** argv)
 {
 	ros::init(argc, argv, "mapper_node");
@@ -187,15 +1056,42 @@ int main(int argc, char** argv)
 	mapper = std::unique_ptr<Mapper>(new Mapper(params->icpConfig, params->inputFiltersConfig, params->inputFiltersWorldConfig, params->mapPostFiltersConfig, params->mapUpdateCondition,
 												params->mapUpdateOverlap, params->mapUpdateDelay, params->mapUpdateDistance, params->minDistNewPoint,
 												params->sensorMaxRange, params->priorDynamic, params->thresholdDynamic, params->beamHalfAngle, params->epsilonA,
-												params->epsilonD, params->alpha, params->beta, params->is3D, params->isOnline, params->computeProbDynamic,
-												params->isMapping));
+												params->epsilonD, params->alpha, params->beta, params->keyframeRegistrationPeriod, params->keyframeMinOverlap,
+												params->mapDescriptors, params->mapReferenceDescriptors, params->registrationMethod, params->likelihoodFieldResolution,
+												params->likelihoodFieldMaxDistance, params->is3D, params->isOnline, params->computeProbDynamic, params->isMapping,
+												params->applyInputFilters));
+	
+	latencyWatchdog = std::unique_ptr<LatencyWatchdog>(new LatencyWatchdog(stageNames, params->latencyDeadline, params->maxOverrunRate, params->overrunWindowSize));
+	threadPool = std::unique_ptr<ThreadPool>(new ThreadPool(params->workerThreadCount));
+	highRatePoseWatchdog = std::unique_ptr<LatencyWatchdog>(new LatencyWatchdog(highRatePoseStageNames, 0, 1, params->overrunWindowSize));
+	stationaryDetector = std::unique_ptr<StationaryDetector>(new StationaryDetector(params->stationaryTranslationThreshold, params->stationaryRotationThreshold,
+																					params->stationaryDelay, params->stationaryRegistrationPeriod));
+	
+	if(params->occupancyGridPublishRate > 0)
+	{
+		mapper->enableOccupancyGrid(params->occupancyGridResolution, params->occupancyGridMinHeight, params->occupancyGridMaxHeight);
+	}
+	if(params->elevationGridPublishRate > 0)
+	{
+		mapper->enableElevationGrid(params->elevationGridResolution, params->elevationGridRadius);
+	}
+	mapper->enableMapHistory(params->mapHistorySize);
+	
+	// until an input is registered with enough overlap, the robot is searched around its starting pose, where odom and map frames coincide
+	const int homogeneousDim = params->is3D ? 4 : 3;
+	relocalizationRegion.sensorToMap = PM::Matrix::Identity(homogeneousDim, homogeneousDim);
+	relocalizationRegion.sensorToOdom = PM::Matrix::Identity(homogeneousDim, homogeneousDim);
+	relocalizationRegion.radius = params->relocalizationRadius;
+	relocalizationRegion.yawRange = params->relocalizationYawRange;
 	
 	loadInitialMap();
 	
 	std::thread mapperShutdownThread;
+	std::thread registrationThread;
 	int messageQueueSize;
 	if(params->isOnline)
 	{
+		registrationThread = std::thread(registrationLoop);
 		tfBuffer = std::unique_ptr<tf2_ros::Buffer>(new tf2_ros::Buffer);
 		messageQueueSize = 1;
 	}
@@ -210,30 +1106,123 @@ int main(int argc, char** argv)
 	tfBroadcaster = std::unique_ptr<tf2_ros::TransformBroadcaster>(new tf2_ros::TransformBroadcaster);
 	
 	if(params->is3D)
+	{
+		odomToMap.store(PM::Matrix::Identity(4, 4));
+	}
+	else
+	{
+		odomToMap.store(PM::Matrix::Identity(3, 3));
+	}
+	
+	if(params->sensorFrames.size() > 1 || !params->sensorInputFiltersConfigs.empty())
+	{
+		for(size_t i = 0; i < params->sensorFrames.size(); i++)
+		{
+			std::unique_ptr<SensorInput> sensorInput(new SensorInput);
+			sensorInput->frame = params->sensorFrames[i];
+			if(!params->sensorInputFiltersConfigs.empty())
+			{
+				std::ifstream ifs(params->sensorInputFiltersConfigs[i].c_str());
+				sensorInput->filters = PM::DataPointsFilters(ifs);
+				ifs.close();
+			}
+			sensorInput->stageTimings = std::unique_ptr<LatencyWatchdog>(new LatencyWatchdog(sensorStageNames, 0, 1, params->overrunWindowSize));
+			sensorInputs.push_back(std::move(sensorInput));
+		}
+		
+		for(size_t i = 0; i < sensorInputs.size(); i++)
+		{
+			std::string topic = "points_in_" + std::to_string(i);
+			if(params->is3D)
+			{
+				sensorInputs[i]->subscriber = n.subscribe<sensor_msgs::PointCloud2>(topic, messageQueueSize, [i](const sensor_msgs::PointCloud2ConstPtr& cloudMsgIn)
+				{
+					sensorPointCloud2Callback(i, cloudMsgIn);
+				});
+			}
+			else
+			{
+				sensorInputs[i]->subscriber = n.subscribe<sensor_msgs::LaserScan>(topic, messageQueueSize, [i](const sensor_msgs::LaserScanConstPtr& scanMsgIn)
+				{
+					sensorLaserScanCallback(i, scanMsgIn);
+				});
+			}
+			sensorInputs[i]->preprocessingThread = std::thread(sensorPreprocessingLoop, i);
+		}
+	}
+	else if(params->is3D)
 	{
 		sub = n.subscribe("points_in", messageQueueSize, pointCloud2Callback);
-		odomToMap = PM::Matrix::Identity(4, 4);
 	}
 	else
 	{
 		sub = n.subscribe("points_in", messageQueueSize, laserScanCallback);
-		odomToMap = PM::Matrix::Identity(3, 3);
 	}
 	
+	initialPoseSub = n.subscribe("initialpose", 1, initialPoseCallback);
+	
 	mapPublisher = n.advertise<sensor_msgs::PointCloud2>("map", 2, true);
+	if(params->publishQuantizedMap)
+	{
+		quantizedMapPublisher = n.advertise<sensor_msgs::PointCloud2>("quantized_map", 2, true);
+	}
+	mapGenerationPublisher = n.advertise<norlab_icp_mapper::MapGeneration>("map_generation", 2, true);
+	occupancyGridPublisher = n.advertise<nav_msgs::OccupancyGrid>("occupancy_grid", 1, true);
+	occupancyGridUpdatePublisher = n.advertise<map_msgs::OccupancyGridUpdate>("occupancy_grid_updates", 10);
+	elevationGridPublisher = n.advertise<sensor_msgs::PointCloud2>("elevation_grid", 2, true);
 	odomPublisher = n.advertise<nav_msgs::Odometry>("icp_odom", 50, true);
+	highRatePosePublisher = n.advertise<nav_msgs::Odometry>("icp_odom_high_rate", 200);
+	diagnosticsPublisher = n.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 10);
+	icpStatisticsPublisher = n.advertise<diagnostic_msgs::DiagnosticArray>("icp_statistics", 50);
 	
 	reloadYamlConfigService = n.advertiseService("reload_yaml_config", reloadYamlConfigCallback);
 	saveMapService = n.advertiseService("save_map", saveMapCallback);
+	getMapDeltaService = n.advertiseService("get_map_delta", getMapDeltaCallback);
+	
+	// odometry has its own queue and spinner so that input conversions on the main spinner do not delay the high rate pose
+	ros::CallbackQueue odomCallbackQueue;
+	ros::NodeHandle odomNodeHandle;
+	odomNodeHandle.setCallbackQueue(&odomCallbackQueue);
+	odomSub = odomNodeHandle.subscribe("odom_in", 200, odomCallback, ros::TransportHints().tcpNoDelay());
+	ros::AsyncSpinner odomSpinner(1, &odomCallbackQueue);
+	odomSpinner.start();
 	
 	std::thread mapPublisherThread = std::thread(mapPublisherLoop);
 	std::thread mapTfPublisherThread = std::thread(mapTfPublisherLoop);
+	std::thread diagnosticsPublisherThread = std::thread(diagnosticsPublisherLoop);
+	std::thread occupancyGridPublisherThread;
+	if(params->occupancyGridPublishRate > 0)
+	{
+		occupancyGridPublisherThread = std::thread(occupancyGridPublisherLoop);
+	}
+	std::thread elevationGridPublisherThread;
+	if(params->elevationGridPublishRate > 0)
+	{
+		elevationGridPublisherThread = std::thread(elevationGridPublisherLoop);
+	}
 	
 	ros::spin();
 	
 	mapPublisherThread.join();
 	mapTfPublisherThread.join();
-	if(!params->isOnline)
+	diagnosticsPublisherThread.join();
+	if(occupancyGridPublisherThread.joinable())
+	{
+		occupancyGridPublisherThread.join();
+	}
+	if(elevationGridPublisherThread.joinable())
+	{
+		elevationGridPublisherThread.join();
+	}
+	for(const std::unique_ptr<SensorInput>& sensorInput: sensorInputs)
+	{
+		sensorInput->preprocessingThread.join();
+	}
+	if(params->isOnline)
+	{
+		registrationThread.join();
+	}
+	else
 	{
 		mapperShutdownThread.join();
 	}